@@ -1,11 +1,31 @@
 #include "AVL.h"
+#include <algorithm>
+
+AVL::node *helper_find (const Apartment &data, double key,
+                        AVL::node *curr_node, const OrderingContext &context);
+static AVL::node *helper_find_exact (const Apartment &data, double key,
+                                     AVL::node *curr_node,
+                                     const OrderingContext &context);
 
 /**
  * Constructor. Constructs an empty AVL tree
  */
-AVL::AVL () : _root (nullptr)
+AVL::AVL ()
+    : _root (nullptr), _tombstones (0), _external (0),
+      _max_tombstone_ratio (0)
 {}
 
+/**
+ * Constructor. Constructs an empty AVL tree that orders its apartments by
+ * their distance from the reference point of context, or in Z order for
+ * OrderingContext::morton ()
+ * @param context reference point of the tree
+ */
+AVL::AVL (const OrderingContext &context) : AVL ()
+{
+  _context = context;
+}
+
 /**
  * Copy constructor
  * @param other other AVL obj to copy
@@ -16,12 +36,10 @@ AVL::AVL (const AVL &other) : AVL ()
 }
 
 /**
- * destructor for AVL class
+ * destructor for AVL class. the nodes are released together with the pool.
  */
 AVL::~AVL ()
-{
-  free_avl (_root);
-}
+{}
 
 /**
  * Assignment operator - copies the contents of another AVL object to this
@@ -34,14 +52,21 @@ AVL &AVL::operator= (const AVL &rhs)
   if (this != &rhs)
     {
       free_avl (_root);
-      _root = helper_copy (rhs.get_root ());
+      _cache.clear ();
+      set_root (helper_copy (rhs.get_root ()));
+      _tombstones = rhs._tombstones;
+      _external = 0; // the copies are owned by the pool
+      _max_tombstone_ratio = rhs._max_tombstone_ratio;
+      _context = rhs._context;
+      _filter = rhs._filter;
 
     }
   return *this;
 }
 
 /**
- * recursive func that free all nodes of a tree in post order.
+ * recursive func that free all nodes of a tree in post order. caller owned
+ * nodes are only dropped.
  * @param curr_node current node in the tree
  */
 void AVL::free_avl (AVL::node *curr_node)
@@ -53,7 +78,14 @@ void AVL::free_avl (AVL::node *curr_node)
 
   free_avl (curr_node->get_left ());
   free_avl (curr_node->get_right ());
-  delete (curr_node);
+  if (curr_node->is_external ())
+    {
+      _external--;
+    }
+  else
+    {
+      _pool.destroy (curr_node);
+    }
 
 }
 
@@ -65,11 +97,7 @@ void AVL::free_avl (AVL::node *curr_node)
  */
 AVL::AVL (const std::vector<std::pair<double, double>> &coordinates) : AVL ()
 {
-  for (auto x: coordinates)
-    {
-      Apartment a (x);
-      insert (a);
-    }
+  insert_range (coordinates);
 }
 
 /**
@@ -80,6 +108,23 @@ AVL::node *AVL::get_root () const
   return _root;
 }
 
+/**
+ * @return the ordering context of this tree
+ */
+const OrderingContext &AVL::get_context () const
+{
+  return _context;
+}
+
+/**
+ * @param apartment apartment to order
+ * @return the sort key of the apartment in the context of this tree
+ */
+float AVL::key_of (const Apartment &apartment) const
+{
+  return (float) _context.key (apartment);
+}
+
 /**
  * The function inserts the new apartment into the tree so that it maintains
  * the legality of the tree.
@@ -88,7 +133,8 @@ AVL::node *AVL::get_root () const
 void AVL::insert (const Apartment &apartment)
 {
 
-  _root = helper_insert (apartment, _root);
+  _filter.add (apartment);
+  set_root (helper_insert (apartment, key_of (apartment), _root));
 
 }
 
@@ -100,104 +146,200 @@ void AVL::insert (const Apartment &apartment)
  */
 void AVL::erase (const Apartment &apartment)
 {
-  _root = helper_erase (apartment, _root);
+  erase (find_exact (apartment));
 }
 
 /**
- * find successor for a node with left child. the successor is the left most
- * leaf
- * @param node pointer to node for it we want to find successor
- * @return the successor of node
+ * Erases the apartment of an iterator, without searching for it again. The
+ * node is unlinked through its parent links and the tree is rebalanced
+ * upward from there only as far as the heights change (or, in lazy mode,
+ * the node becomes a tombstone). Erasing end () does nothing. Invalidates
+ * the iterators of the erased apartment.
+ * @param position iterator to the apartment to erase
  */
-AVL::node *find_successor (AVL::node *node)
+void AVL::erase (const iterator &position)
 {
-  AVL::node *curr_node = node;
-
-  // go over to the most left leaf
-  while (curr_node->get_left () != nullptr)
+  if (position.cur != nullptr && !position.cur->is_dead ())
     {
-      curr_node = curr_node->get_left ();
+      erase_found (position.cur);
     }
-
-  return curr_node;
 }
 
 /**
- * recursive func for erasing the node of a given apartment
- * @param apartment apartment to erase from the tree
- * @param curr_node the current node in the tree
- * @return new root of the AVL tree after after the node of apartment was
- * erased
+ * Erases the apartments from first up to, not including, last, in the
+ * preorder of the iterators. The nodes are collected in one walk over the
+ * range. A small range is unlinked node by node; once unlinking would cost
+ * more than rebuilding, that is once k log n passes n, the rest of the tree
+ * is rebuilt without them instead. The cost is O(log n + min (k log n, n))
+ * for k erased apartments. Invalidates all iterators.
+ * @param first iterator to the first apartment to erase
+ * @param last iterator past the last apartment to erase
  */
-AVL::node *AVL::helper_erase (const Apartment &apartment,
-                              AVL::node *curr_node)
+void AVL::erase_range (iterator first, const iterator &last)
 {
-  if (curr_node == nullptr) // base case
+  std::vector<AVL::node *> nodes;
+  for (; first != last; ++first)
     {
-      return curr_node;
+      nodes.push_back (first.cur);
     }
 
-    // the apartment key is smaller than the apartment in the node,
-    // call this func with the left child
-  else if (apartment < curr_node->get_data ())
+  size_t live = _pool.size () + _external - _tombstones;
+  size_t height = get_height_of_node (_root) + HEIGHT_NODE_FACTOR;
+  if (nodes.size () * height <= live)
     {
-      curr_node->set_left (helper_erase (apartment,
-                                         curr_node->get_left ()));
+      for (AVL::node *curr_node : nodes)
+        {
+          erase_found (curr_node);
+        }
+      return;
     }
-    // the apartment key is bigger than the apartment in the node,
-    // call this func with the right child
-  else if (apartment > curr_node->get_data ())
+  for (AVL::node *curr_node : nodes)
     {
-      curr_node->set_right (helper_erase (apartment,
-                                          curr_node->get_right ()));
+      _cache.forget (curr_node);
+      _filter.remove (curr_node->get_data ());
+      curr_node->set_dead (true);
     }
+  rebuild ();
+}
 
-  else // this the node with the apartment we need to delete
+/**
+ * erases a live node of the tree: makes it a tombstone in lazy mode, and
+ * unlinks it otherwise
+ * @param found node to erase
+ */
+void AVL::erase_found (AVL::node *found)
+{
+  if (found->is_external () || _max_tombstone_ratio <= 0) // structural
     {
+      erase_node (found);
+      return;
+    }
+  _cache.forget (found);
+  _filter.remove (found->get_data ());
+  found->set_dead (true);
+  _tombstones++;
+  if (_tombstones > _max_tombstone_ratio * _pool.size ())
+    {
+      rebuild ();
+    }
+}
 
-      if ((curr_node->get_left () == nullptr) // no children case
-          && (curr_node->get_right () == nullptr))
-        {
-          delete (curr_node);
-          return nullptr;
-        }
-
-      if ((curr_node->get_left () != nullptr) // only left child case
-          && (curr_node->get_right () == nullptr))
-        {
-          AVL::node *temp = curr_node->get_left ();
-          delete (curr_node);
-          return temp;
-        }
+/**
+ * compare an exact sort key with the apartment of a node, using the cached
+ * float key first. only a tie of the float keys computes the exact key of
+ * the node.
+ * @param key exact sort key to compare
+ * @param curr_node node to compare with
+ * @param context ordering context of the tree
+ * @return true if key is smaller than the key of the apartment of curr_node
+ */
+static bool exact_key_less (double key, const AVL::node *curr_node,
+                            const OrderingContext &context)
+{
+  float float_key = (float) key;
+  return float_key < curr_node->get_key ()
+         || (float_key == curr_node->get_key ()
+             && key < context.key (curr_node->get_data ()));
+}
 
-      if ((curr_node->get_left () == nullptr) // only right child case
-          && (curr_node->get_right () != nullptr))
-        {
-          AVL::node *temp = curr_node->get_right ();
-          delete (curr_node);
-          return temp;
-        }
+/**
+ * compare an exact sort key with the apartment of a node, using the cached
+ * float key first. only a tie of the float keys computes the exact key of
+ * the node.
+ * @param key exact sort key to compare
+ * @param curr_node node to compare with
+ * @param context ordering context of the tree
+ * @return true if key is greater than the key of the apartment of curr_node
+ */
+static bool exact_key_greater (double key, const AVL::node *curr_node,
+                               const OrderingContext &context)
+{
+  float float_key = (float) key;
+  return float_key > curr_node->get_key ()
+         || (float_key == curr_node->get_key ()
+             && key > context.key (curr_node->get_data ()));
+}
 
-      if ((curr_node->get_left () != nullptr) // 2 children case
-          && (curr_node->get_right () != nullptr))
-        {
-          AVL::node *temp = find_successor (curr_node->get_right ());
+/**
+ * compare an apartment, whose exact sort key is known, with the apartment
+ * of a node, in the order of the tree. only a tie of the float keys
+ * computes the exact key of the node, and only a tie of the exact keys
+ * compares the coordinates (see OrderingContext::less)
+ * @param data apartment to compare
+ * @param key exact sort key of data
+ * @param curr_node node to compare with
+ * @param context ordering context of the tree
+ * @return true if data comes before the apartment of curr_node
+ */
+static bool exact_less (const Apartment &data, double key,
+                        const AVL::node *curr_node,
+                        const OrderingContext &context)
+{
+  float float_key = (float) key;
+  if (float_key != curr_node->get_key ())
+    {
+      return float_key < curr_node->get_key ();
+    }
+  double node_key = context.key (curr_node->get_data ());
+  return key < node_key
+         || (key == node_key
+             && OrderingContext::coordinates_less (data,
+                                                   curr_node->get_data ()));
+}
 
-          //replace data with the successor
-          curr_node->data_ = temp->get_data ();
+/**
+ * compare an apartment with the apartment of a node, using the cached sort
+ * keys first
+ * @param apartment apartment to compare
+ * @param key sort key of apartment
+ * @param curr_node node to compare with
+ * @param context ordering context of the tree
+ * @return true if apartment is greater than the apartment of curr_node
+ */
+static bool key_greater (const Apartment &apartment, float key,
+                         const AVL::node *curr_node,
+                         const OrderingContext &context)
+{
+  return key > curr_node->get_key ()
+         || (key == curr_node->get_key ()
+             && context.less (curr_node->get_data (), apartment));
+}
 
-          //call again the func with the right subtree and the successor
-          // apartment
-          curr_node->set_right (helper_erase (curr_node->data_,
-                                              curr_node->get_right ()));
+/**
+ * compare an apartment with the apartment of a node, using the cached sort
+ * keys first
+ * @param apartment apartment to compare
+ * @param key sort key of apartment
+ * @param curr_node node to compare with
+ * @param context ordering context of the tree
+ * @return true if apartment is smaller than the apartment of curr_node
+ */
+static bool key_less (const Apartment &apartment, float key,
+                      const AVL::node *curr_node,
+                      const OrderingContext &context)
+{
+  return key < curr_node->get_key ()
+         || (key == curr_node->get_key ()
+             && context.less (apartment, curr_node->get_data ()));
+}
 
-        }
+/**
+ * find successor for a node with left child. the successor is the left most
+ * leaf
+ * @param node pointer to node for it we want to find successor
+ * @return the successor of node
+ */
+AVL::node *find_successor (AVL::node *node)
+{
+  AVL::node *curr_node = node;
 
+  // go over to the most left leaf
+  while (curr_node->get_left () != nullptr)
+    {
+      curr_node = curr_node->get_left ();
     }
 
-  update_height (curr_node);
-  return balance_tree (curr_node);
-
+  return curr_node;
 }
 
 /**
@@ -321,31 +463,109 @@ AVL::ConstIterator AVL::cend ()
 }
 
 /**
- * recursive func for find the node of the given apartment
+ * recursive func for find the node of the given apartment. Tombstones
+ * (see AVL::set_lazy_erase) do not stop the search: copies of an
+ * apartment may be on both sides of a tombstone with its coordinates, so
+ * both sides are searched there, and other tombstones only route it.
  * @param data Apartment obj we want to find
+ * @param key exact sort key of data, computed once by the caller
  * @param curr_node the current node in tree
- * @return the node that corresponds to the apartment we were looking for.
- * If there is no such node, return nullptr.
+ * @param context ordering context of the tree
+ * @return the live node that corresponds to the apartment we were looking
+ * for. If there is no such node, return nullptr.
  */
-AVL::node *helper_find (const Apartment &data, AVL::node *curr_node)
+AVL::node *helper_find (const Apartment &data, double key,
+                        AVL::node *curr_node, const OrderingContext &context)
 {
-  if (curr_node == nullptr || curr_node->get_data () == data) // base case
+  if (curr_node == nullptr) // base case
     {
       return curr_node;
     }
+  else if (curr_node->get_data () == data && !curr_node->is_dead ())
+    {
+      return curr_node;
+    }
+  else if (curr_node->is_dead ()
+           && OrderingContext::same_coordinates (curr_node->get_data (), data))
+    {
+      AVL::node *found = helper_find (data, key, curr_node->get_left (),
+                                      context);
+      return (found != nullptr)
+             ? found
+             : helper_find (data, key, curr_node->get_right (), context);
+    }
 
     // the apartment we are looking for is smaller than the apartment in the
     // current node, call this func with the left child
-  else if (data < curr_node->get_data ())
+  else if (exact_less (data, key, curr_node, context))
     {
-      return helper_find (data, curr_node->get_left ());
+      return helper_find (data, key, curr_node->get_left (), context);
     }
     // the apartment we are looking for is bigger than the apartment in the
     // current node, call this func with the right child
   else
     {
-      return helper_find (data, curr_node->get_right ());
+      return helper_find (data, key, curr_node->get_right (), context);
+    }
+}
+
+/**
+ * find the node of the given apartment itself. unlike helper_find, a node
+ * whose apartment is less than EPSILON away but not at the same place does
+ * not stop the search, it only routes it. Tombstones are passed over as in
+ * helper_find.
+ * @param data Apartment obj we want to find
+ * @param key exact sort key of data, computed once by the caller
+ * @param curr_node the current node in tree
+ * @param context ordering context of the tree
+ * @return the live node with the coordinates of data, or nullptr if there
+ * is no such node
+ */
+static AVL::node *helper_find_exact (const Apartment &data, double key,
+                                     AVL::node *curr_node,
+                                     const OrderingContext &context)
+{
+  while (curr_node != nullptr
+         && !OrderingContext::same_coordinates (curr_node->get_data (), data))
+    {
+      curr_node = exact_less (data, key, curr_node, context)
+                  ? curr_node->get_left () : curr_node->get_right ();
+    }
+  if (curr_node == nullptr || !curr_node->is_dead ())
+    {
+      return curr_node;
+    }
+  AVL::node *found = helper_find_exact (data, key, curr_node->get_left (),
+                                        context);
+  return (found != nullptr)
+         ? found
+         : helper_find_exact (data, key, curr_node->get_right (), context);
+}
+
+/**
+ * recursive func for find a node by the sort key of its apartment
+ * @param key exact sort key to look for
+ * @param curr_node the current node in tree
+ * @param context ordering context of the tree
+ * @return a node whose apartment has the sort key, or nullptr if there is
+ * no such node
+ */
+static AVL::node *helper_find_key (double key, AVL::node *curr_node,
+                                   const OrderingContext &context)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return curr_node;
+    }
+  else if (exact_key_less (key, curr_node, context))
+    {
+      return helper_find_key (key, curr_node->get_left (), context);
+    }
+  else if (exact_key_greater (key, curr_node, context))
+    {
+      return helper_find_key (key, curr_node->get_right (), context);
     }
+  return curr_node;
 }
 
 /**
@@ -357,10 +577,29 @@ AVL::node *helper_find (const Apartment &data, AVL::node *curr_node)
  */
 AVL::iterator AVL::find (const Apartment &data)
 {
-
-  AVL::iterator itr (helper_find (data, _root));
+  if (!_filter.may_contain (data))
+    {
+      return end ();
+    }
+  AVL::node *found = _cache.lookup (data);
+  if (found == nullptr)
+    {
+      found = helper_find (data, _context.key (data), _root, _context);
+      if (found != nullptr && found->is_dead ())
+        {
+          found = nullptr;
+        }
+      if (found != nullptr)
+        {
+          _cache.remember (found);
+        }
+      else if (_filter.enabled ())
+        {
+          _filter.false_positives++;
+        }
+    }
+  AVL::iterator itr (found);
   return itr;
-
 }
 
 /**
@@ -372,112 +611,752 @@ AVL::iterator AVL::find (const Apartment &data)
  */
 AVL::const_iterator AVL::find (const Apartment &data) const
 {
-
-  AVL::const_iterator c_itr (helper_find (data, _root));
+  if (!_filter.may_contain (data))
+    {
+      return end ();
+    }
+  AVL::node *found = _cache.lookup (data);
+  if (found == nullptr)
+    {
+      found = helper_find (data, _context.key (data), _root, _context);
+      if (found != nullptr && found->is_dead ())
+        {
+          found = nullptr;
+        }
+      if (found != nullptr)
+        {
+          _cache.remember (found);
+        }
+      else if (_filter.enabled ())
+        {
+          _filter.false_positives++;
+        }
+    }
+  AVL::const_iterator c_itr (found);
   return c_itr;
+}
 
+/**
+ * Looks up the apartment at (x, y) without the caller building an
+ * apartment. Same as find (const Apartment &), the sort key is computed
+ * once for the whole descent.
+ * @param x x coordinate of the apartment
+ * @param y y coordinate of the apartment
+ * @return iterator to the apartment, or end () if there is no such member
+ */
+AVL::iterator AVL::find (double x, double y)
+{
+  return find (Apartment (std::make_pair (x, y)));
 }
 
 /**
- * Insertion operator, prints the apartment in the tree in preorder traversal.
- * Each apartment will be printed in the format: (x,y)\n
- * @param os reference to std::ostream
- * @param avl tree
- * @return os reference to std::ostream
+ * Looks up the apartment at (x, y) without the caller building an
+ * apartment. Same as find (const Apartment &), the sort key is computed
+ * once for the whole descent.
+ * @param x x coordinate of the apartment
+ * @param y y coordinate of the apartment
+ * @return const iterator to the apartment, or end () if there is no such
+ * member
  */
-std::ostream &operator<< (std::ostream &os, const AVL &avl)
+AVL::const_iterator AVL::find (double x, double y) const
 {
-  for (auto x : avl)
+  return find (Apartment (std::make_pair (x, y)));
+}
+
+/**
+ * Looks up the apartment itself: unlike find (), an apartment less than
+ * EPSILON away with other coordinates is not a match. This is the
+ * apartment that erase (const Apartment &) erases.
+ * @param data apartment to search
+ * @return iterator to an apartment with the coordinates of data, or
+ * end () if there is none
+ */
+AVL::iterator AVL::find_exact (const Apartment &data)
+{
+  if (!_filter.may_contain (data))
     {
-      os << x;
+      return end ();
     }
-  return os;
+  AVL::iterator itr (helper_find_exact (data, _context.key (data), _root,
+                                        _context));
+  return itr;
 }
 
 /**
- * recursive func for create new AVL according other AVL
- * @param other other AVL to copy
- * @return new AVL tree the same as other AVL
+ * Looks up the apartment itself. See find_exact (const Apartment &).
+ * @param data apartment to search
+ * @return const iterator to an apartment with the coordinates of data, or
+ * end () if there is none
  */
-AVL::node *AVL::helper_copy (AVL::node *other)
+AVL::const_iterator AVL::find_exact (const Apartment &data) const
 {
-  if (other == nullptr) // base case
+  if (!_filter.may_contain (data))
     {
-      return nullptr;
+      return end ();
     }
-  auto *new_root = new AVL::node (other->get_data (),
-                                  helper_copy (other->get_left ()),
-                                  helper_copy (other->get_right ()));
-  return new_root;
+  AVL::const_iterator c_itr (helper_find_exact (data, _context.key (data),
+                                                _root, _context));
+  return c_itr;
 }
 
 /**
- * balance the tree according the legality of AVL tree
- * @param curr_node pointer to node to balance if balance is needed
- * @return balanced node (sub tree)
+ * Looks up an apartment by a precomputed sort key, the squared distance
+ * from the reference point as returned by get_context ().key (). The
+ * descent compares raw keys only. When a few apartments are at the same
+ * distance, any one of them is found.
+ * @param key sort key to search
+ * @return iterator to an apartment with the key, or end () if there is
+ * none
  */
-AVL::node *AVL::balance_tree (AVL::node *curr_node)
+AVL::iterator AVL::find_by_key (double key)
 {
-  if (curr_node == nullptr) // no need to balance
+  AVL::node *found = helper_find_key (key, _root, _context);
+  if (found != nullptr && found->is_dead ())
     {
-      return curr_node;
+      found = nullptr;
     }
+  AVL::iterator itr (found);
+  return itr;
+}
 
-  if (get_balance_factor_of_node (curr_node) < R_BF_FACTOR) // R case
+/**
+ * Looks up an apartment by a precomputed sort key. See
+ * find_by_key (double).
+ * @param key sort key to search
+ * @return const iterator to an apartment with the key, or end () if there
+ * is none
+ */
+AVL::const_iterator AVL::find_by_key (double key) const
+{
+  AVL::node *found = helper_find_key (key, _root, _context);
+  if (found != nullptr && found->is_dead ())
     {
+      found = nullptr;
+    }
+  AVL::const_iterator c_itr (found);
+  return c_itr;
+}
 
-      if (get_balance_factor_of_node (curr_node->get_right ())
-          <= RR_BF_FACTOR) //RR case
-        {
+/**
+ * @param data apartment to search
+ * @return true if the apartment is in the tree
+ */
+bool AVL::contains (const Apartment &data) const
+{
+  return find (data) != end ();
+}
 
-          return AVL::do_ll_rotation (curr_node);
-        }
-      else
-        {
+/**
+ * @param x x coordinate of the apartment
+ * @param y y coordinate of the apartment
+ * @return true if the apartment at (x, y) is in the tree
+ */
+bool AVL::contains (double x, double y) const
+{
+  return find (x, y) != end ();
+}
 
-          return AVL::do_rl_rotation (curr_node); //RL case
-        }
-    }
+/**
+ * @param key sort key, as returned by get_context ().key ()
+ * @return true if an apartment with the key is in the tree
+ */
+bool AVL::contains_key (double key) const
+{
+  return find_by_key (key) != end ();
+}
 
-  if (get_balance_factor_of_node (curr_node) > L_BF_FACTOR) // L case
+/**
+ * make a node the root of the tree
+ * @param root the new root, may be nullptr
+ */
+void AVL::set_root (AVL::node *root)
+{
+  _root = root;
+  if (_root != nullptr)
     {
+      _root->parent_ = nullptr;
+    }
+}
 
-      if (get_balance_factor_of_node (curr_node->get_left ())
-          >= LL_BF_FACTOR) //LL case
+/**
+ * climbs from a node until the apartment falls inside the sub tree of the
+ * node reached, following the insert order (greater goes right)
+ * @param start node to climb from
+ * @param apartment apartment to look for
+ * @param key sort key of apartment
+ * @param context ordering context of the tree
+ * @return the root of the smallest sub tree on the way that holds the
+ * place of the apartment. apartments equal to it may lie outside that
+ * sub tree, so the climb does not stop at them
+ */
+AVL::node *AVL::climb (AVL::node *start, const Apartment &apartment,
+                       float key, const OrderingContext &context)
+{
+  bool go_right = key_greater (apartment, key, start, context);
+  AVL::node *curr_node = start;
+  while (curr_node->get_parent () != nullptr)
+    {
+      AVL::node *parent = curr_node->get_parent ();
+      // the parent bounds the sub tree of curr_node on one side. once the
+      // apartment is strictly on the inner side of that bound (and it
+      // already is on the inner side of start), it belongs to this sub tree.
+      // an apartment that ties with the parent may be the parent itself
+      bool is_left_child = (parent->get_left () == curr_node);
+      if (go_right && is_left_child
+          && key_less (apartment, key, parent, context))
         {
-
-          return AVL::do_rr_rotation (curr_node);
+          return curr_node;
         }
-      else
+      if (!go_right && !is_left_child
+          && key_greater (apartment, key, parent, context))
         {
-
-          return AVL::do_lr_rotation (curr_node); // LR case
+          return curr_node;
         }
+      curr_node = parent;
     }
-
-  return curr_node; // balance is not needed
-
+  return curr_node;
 }
 
 /**
- * recursive func for insertion a new apartment into the tree so that it
- * maintains the legality of the tree.
- * @param apartment apartment to add the tree
- * @param curr_node pointer to the current node in tree
- * @return new root of the tree that includes the new apartment
+ * Finger search: looks for an apartment starting from the node of hint
+ * instead of the root. The search climbs from hint only until the
+ * apartment is inside the sub tree it reached, and descends from there, so
+ * it costs O(log d) where d is the rank distance between the two
+ * apartments. A hint of end () searches from the root.
+ * @param hint iterator to a previously found apartment
+ * @param data apartment to search
+ * @return iterator to the item, or end () if there is no such member
  */
-AVL::node *AVL::helper_insert (const Apartment &apartment,
-                               AVL::node *curr_node)
+AVL::iterator AVL::find_from (const iterator &hint, const Apartment &data)
 {
-  if (curr_node == nullptr) // base case
+  if (hint.cur == nullptr)
     {
-      return new AVL::node (apartment, nullptr, nullptr);
+      return find (data);
     }
-    // the apartment key is bigger than the apartment in the node,
+  double exact_key = _context.key (data);
+  AVL::node *found = helper_find (data, exact_key,
+                                  climb (hint.cur, data, (float) exact_key,
+                                         _context),
+                                  _context);
+  if (found != nullptr && found->is_dead ())
+    {
+      found = nullptr;
+    }
+  AVL::iterator itr (found);
+  return itr;
+}
+
+/**
+ * Finger search: looks for an apartment starting from the node of hint
+ * instead of the root. See find_from (const iterator &, ...).
+ * @param hint const iterator to a previously found apartment
+ * @param data apartment to search
+ * @return const iterator to the item, or end () if there is no such member
+ */
+AVL::const_iterator AVL::find_from (const const_iterator &hint,
+                                    const Apartment &data) const
+{
+  if (hint.cur == nullptr)
+    {
+      return find (data);
+    }
+  double exact_key = _context.key (data);
+  AVL::node *found = helper_find (data, exact_key,
+                                  climb (hint.cur, data, (float) exact_key,
+                                         _context),
+                                  _context);
+  if (found != nullptr && found->is_dead ())
+    {
+      found = nullptr;
+    }
+  AVL::const_iterator c_itr (found);
+  return c_itr;
+}
+
+/**
+ * Hinted insert, like std::map: the new node is linked starting from the
+ * node of hint, and the tree is rebalanced upward from the new node only as
+ * far as the heights change. For near sorted input, passing the iterator
+ * returned by the previous insert makes every insert O(log d) in the rank
+ * distance d. A hint of end () starts from the root.
+ * @param hint iterator to an apartment close to the new one
+ * @param apartment Apartment object to add to tree
+ * @return iterator to the inserted apartment
+ */
+AVL::iterator AVL::insert (const iterator &hint, const Apartment &apartment)
+{
+  _filter.add (apartment);
+  float key = key_of (apartment);
+  if (_root == nullptr)
+    {
+      set_root (_pool.create (apartment, key, nullptr, nullptr));
+      return AVL::iterator (_root);
+    }
+
+  AVL::node *curr_node = (hint.cur == nullptr)
+                         ? _root
+                         : climb (hint.cur, apartment, key, _context);
+  while (true)
+    {
+      if (curr_node->is_dead ()
+          && OrderingContext::same_coordinates (curr_node->get_data (),
+                                                apartment))
+        {
+          // the apartment was lazily erased, bring its node back
+          curr_node->set_data (apartment, key);
+          curr_node->set_dead (false);
+          _tombstones--;
+          return AVL::iterator (curr_node);
+        }
+      bool go_right = key_greater (apartment, key, curr_node, _context);
+      AVL::node *next = go_right ? curr_node->get_right ()
+                                 : curr_node->get_left ();
+      if (next == nullptr)
+        {
+          break;
+        }
+      curr_node = next;
+    }
+
+  AVL::node *new_node = _pool.create (apartment, key, nullptr, nullptr);
+  if (key_greater (apartment, key, curr_node, _context))
+    {
+      curr_node->set_right (new_node);
+    }
+  else
+    {
+      curr_node->set_left (new_node);
+    }
+  rebalance_up (curr_node);
+  return AVL::iterator (new_node);
+}
+
+/**
+ * Inserts the apartment at (x, y). The apartment is built once and copied
+ * straight into its new node, and the insert walks down from the root
+ * without recursion, rebalancing upward only as far as heights change.
+ * @param x x coordinate of the apartment
+ * @param y y coordinate of the apartment
+ * @return iterator to the inserted apartment
+ */
+AVL::iterator AVL::emplace (double x, double y)
+{
+  return insert (end (), Apartment (std::make_pair (x, y)));
+}
+
+/**
+ * Inserts an apartment for every pair of coordinates
+ * @param coordinates vector of pairs
+ */
+void AVL::insert_range (
+    const std::vector<std::pair<double, double>> &coordinates)
+{
+  insert_range (coordinates.begin (), coordinates.end ());
+}
+
+/**
+ * rebalances the tree from a node up to the root, stopping as soon as a
+ * sub tree keeps its height
+ * @param curr_node lowest node whose sub tree was changed
+ */
+void AVL::rebalance_up (AVL::node *curr_node)
+{
+  while (curr_node != nullptr)
+    {
+      int old_height = curr_node->get_height ();
+      AVL::node *parent = curr_node->get_parent ();
+      bool is_left_child = (parent != nullptr
+                            && parent->get_left () == curr_node);
+
+      update_height (curr_node);
+      AVL::node *sub_root = balance_tree (curr_node);
+      if (parent == nullptr)
+        {
+          set_root (sub_root);
+        }
+      else if (is_left_child)
+        {
+          parent->set_left (sub_root);
+        }
+      else
+        {
+          parent->set_right (sub_root);
+        }
+
+      if (sub_root->get_height () == old_height) // nothing changes above
+        {
+          // but the bounding boxes above may still grow
+          if (parent != nullptr)
+            {
+              parent->update_boxes_up ();
+            }
+          return;
+        }
+      curr_node = parent;
+    }
+}
+
+/**
+ * puts new_node in the place of old_node under the parent of old_node (or
+ * as the root)
+ * @param old_node node to replace
+ * @param new_node node to put in its place, may be nullptr
+ */
+void AVL::replace_in_parent (AVL::node *old_node, AVL::node *new_node)
+{
+  AVL::node *parent = old_node->get_parent ();
+  if (parent == nullptr)
+    {
+      set_root (new_node);
+    }
+  else if (parent->get_left () == old_node)
+    {
+      parent->set_left (new_node);
+    }
+  else
+    {
+      parent->set_right (new_node);
+    }
+}
+
+/**
+ * links a node into the tree without allocating or copying its
+ * apartment. The sort key of the node is set from the context of the
+ * tree.
+ * @param new_node node to link, not linked in any tree
+ * @param hint node of the tree to start the search from (see climb), or
+ * nullptr to start from the root
+ */
+void AVL::link (AVL::node *new_node, AVL::node *hint)
+{
+  const Apartment &apartment = new_node->get_data ();
+  float key = key_of (apartment);
+  new_node->key_ = key;
+  new_node->left_ = new_node->right_ = new_node->parent_ = nullptr;
+  new_node->set_height (HEIGHT_NEW_NODE);
+  new_node->set_dead (false);
+  new_node->dirty_ = true;
+  new_node->update_box ();
+  _filter.add (apartment);
+  if (_root == nullptr)
+    {
+      set_root (new_node);
+      return;
+    }
+
+  AVL::node *curr_node = (hint == nullptr)
+                         ? _root
+                         : climb (hint, apartment, key, _context);
+  bool go_right;
+  while (true)
+    {
+      go_right = key_greater (apartment, key, curr_node, _context);
+      AVL::node *next = go_right ? curr_node->get_right ()
+                                 : curr_node->get_left ();
+      if (next == nullptr)
+        {
+          break;
+        }
+      curr_node = next;
+    }
+  if (go_right)
+    {
+      curr_node->set_right (new_node);
+    }
+  else
+    {
+      curr_node->set_left (new_node);
+    }
+  rebalance_up (curr_node);
+}
+
+/**
+ * unlinks a live node from the tree without freeing it, and rebalances
+ * upward from where it was. In the two children case the successor node
+ * is moved into its place, so no apartment is copied and every other node
+ * keeps its apartment.
+ * @param curr_node node to unlink
+ */
+void AVL::unlink (AVL::node *curr_node)
+{
+  _cache.forget (curr_node);
+  AVL::node *left = curr_node->get_left ();
+  AVL::node *right = curr_node->get_right ();
+  AVL::node *lowest_changed;
+
+  if (left == nullptr || right == nullptr) // at most one child
+    {
+      lowest_changed = curr_node->get_parent ();
+      replace_in_parent (curr_node, (left != nullptr) ? left : right);
+    }
+  else
+    {
+      AVL::node *successor = find_successor (right);
+      if (successor == right)
+        {
+          lowest_changed = successor;
+        }
+      else
+        {
+          // the successor has no left child, its right child takes its place
+          lowest_changed = successor->get_parent ();
+          lowest_changed->set_left (successor->get_right ());
+          successor->set_right (right);
+        }
+      successor->set_left (left);
+      successor->set_height (curr_node->get_height ());
+      replace_in_parent (curr_node, successor);
+    }
+
+  curr_node->left_ = curr_node->right_ = curr_node->parent_ = nullptr;
+  rebalance_up (lowest_changed);
+#ifdef AVL_BOUNDING_BOXES
+  // the successor moved up with the box of its old place, and a box below
+  // it may stay the same while its own changes, so the walk does not stop
+  // early
+  for (AVL::node *curr = lowest_changed; curr != nullptr;
+       curr = curr->get_parent ())
+    {
+      curr->update_box ();
+    }
+#endif
+}
+
+/**
+ * Inserts a batch of apartments, like an LSM tree merges a buffer into its
+ * next level. The batch is sorted by the order of the tree first. A batch
+ * that is small next to the tree is linked node after node, each search
+ * climbing from the node linked before it, which costs O(b log (n / b)) for
+ * b apartments and touches the tree in order. A batch so large that this
+ * would cost more than O(n + b) is merged with the nodes of the tree in one
+ * linear pass, and the tree is rebuilt perfectly balanced (dropping its
+ * tombstones). Tombstones are not revived by a batch. Invalidates all
+ * iterators.
+ * @param apartments apartments to insert
+ */
+void AVL::insert_batch (const std::vector<Apartment> &apartments)
+{
+  // sort the apartments with their keys before they get nodes, so the
+  // nodes of a batch are laid out in order in the pool
+  std::vector<std::pair<double, const Apartment *>> sorted;
+  sorted.reserve (apartments.size ());
+  for (const Apartment &apartment : apartments)
+    {
+      sorted.emplace_back (_context.key (apartment), &apartment);
+    }
+  std::sort (sorted.begin (), sorted.end (),
+             [] (const std::pair<double, const Apartment *> &lhs,
+                 const std::pair<double, const Apartment *> &rhs)
+             {
+               return lhs.first < rhs.first
+                      || (lhs.first == rhs.first
+                          && OrderingContext::coordinates_less (
+                              *lhs.second, *rhs.second));
+             });
+  std::vector<AVL::node *> batch;
+  batch.reserve (sorted.size ());
+  _pool.reserve (sorted.size ());
+  for (const auto &curr : sorted)
+    {
+      batch.push_back (_pool.create (*curr.second, (float) curr.first,
+                                     nullptr, nullptr));
+    }
+  const OrderingContext &context = _context;
+  auto node_less = [&context] (const AVL::node *lhs, const AVL::node *rhs)
+  {
+    return lhs->get_key () < rhs->get_key ()
+           || (lhs->get_key () == rhs->get_key ()
+               && context.less (lhs->get_data (), rhs->get_data ()));
+  };
+
+  size_t live = _pool.size () + _external - _tombstones - batch.size ();
+  size_t height = get_height_of_node (_root) + HEIGHT_NODE_FACTOR;
+  if (batch.size () * height <= live + batch.size ())
+    {
+      AVL::node *prev = nullptr;
+      for (AVL::node *curr_node : batch)
+        {
+          link (curr_node, prev);
+          prev = curr_node;
+        }
+      return;
+    }
+
+  std::vector<AVL::node *> nodes;
+  nodes.reserve (live);
+  helper_collect_live (_root, nodes);
+  _tombstones = 0;
+  std::vector<AVL::node *> merged (nodes.size () + batch.size ());
+  std::merge (nodes.begin (), nodes.end (), batch.begin (), batch.end (),
+              merged.begin (), node_less);
+  for (AVL::node *curr_node : batch)
+    {
+      _filter.add (curr_node->get_data ());
+    }
+  set_root (helper_build (merged, 0, merged.size ()));
+}
+
+/**
+ * Intrusive insert: links a node that the caller owns, typically a member
+ * of a record from the caller's own allocator, without allocating and
+ * without copying its apartment. The node goes through the same descent
+ * and rebalancing as insert (), and is then found and iterated like any
+ * other node. The caller must keep the node alive and in place until it is
+ * erased from the tree; the tree never frees it, and compact () leaves a
+ * tree that holds caller owned nodes as it is. Such nodes are never made
+ * tombstones, erase () always unlinks them.
+ * @param hook node to link, built with node (const Apartment &) and not
+ * linked in any tree
+ * @return iterator to the linked apartment
+ */
+AVL::iterator AVL::insert_node (AVL::node *hook)
+{
+  link (hook, nullptr);
+  hook->external_ = true;
+  _external++;
+  return iterator (hook);
+}
+
+/**
+ * Unlinks a node from the tree and rebalances upward from where it was.
+ * A caller owned node is handed back untouched, apart from its links, and
+ * may be linked again; a node of the pool is freed.
+ * @param hook node of this tree to erase
+ */
+void AVL::erase_node (AVL::node *hook)
+{
+  if (hook->is_dead ())
+    {
+      _tombstones--;
+    }
+  else
+    {
+      _filter.remove (hook->get_data ());
+    }
+  unlink (hook);
+  if (hook->is_external ())
+    {
+      _external--;
+    }
+  else
+    {
+      _pool.destroy (hook);
+    }
+}
+
+/**
+ * Insertion operator, prints the apartment in the tree in preorder traversal.
+ * Each apartment will be printed in the format: (x,y)\n
+ * @param os reference to std::ostream
+ * @param avl tree
+ * @return os reference to std::ostream
+ */
+std::ostream &operator<< (std::ostream &os, const AVL &avl)
+{
+  for (auto x : avl)
+    {
+      os << x;
+    }
+  return os;
+}
+
+/**
+ * recursive func for create new AVL according other AVL
+ * @param other other AVL to copy
+ * @return new AVL tree the same as other AVL
+ */
+AVL::node *AVL::helper_copy (AVL::node *other)
+{
+  if (other == nullptr) // base case
+    {
+      return nullptr;
+    }
+  auto *new_root = _pool.create (other->get_data (), other->get_key (),
+                                 helper_copy (other->get_left ()),
+                                 helper_copy (other->get_right ()));
+  new_root->set_height (other->get_height ());
+  new_root->set_dead (other->is_dead ());
+  return new_root;
+}
+
+/**
+ * balance the tree according the legality of AVL tree
+ * @param curr_node pointer to node to balance if balance is needed
+ * @return balanced node (sub tree)
+ */
+AVL::node *AVL::balance_tree (AVL::node *curr_node)
+{
+  if (curr_node == nullptr) // no need to balance
+    {
+      return curr_node;
+    }
+
+  if (get_balance_factor_of_node (curr_node) < R_BF_FACTOR) // R case
+    {
+
+      if (get_balance_factor_of_node (curr_node->get_right ())
+          <= RR_BF_FACTOR) //RR case
+        {
+
+          return AVL::do_ll_rotation (curr_node);
+        }
+      else
+        {
+
+          return AVL::do_rl_rotation (curr_node); //RL case
+        }
+    }
+
+  if (get_balance_factor_of_node (curr_node) > L_BF_FACTOR) // L case
+    {
+
+      if (get_balance_factor_of_node (curr_node->get_left ())
+          >= LL_BF_FACTOR) //LL case
+        {
+
+          return AVL::do_rr_rotation (curr_node);
+        }
+      else
+        {
+
+          return AVL::do_lr_rotation (curr_node); // LR case
+        }
+    }
+
+  return curr_node; // balance is not needed
+
+}
+
+/**
+ * recursive func for insertion a new apartment into the tree so that it
+ * maintains the legality of the tree.
+ * @param apartment apartment to add the tree
+ * @param key sort key of apartment
+ * @param curr_node pointer to the current node in tree
+ * @return new root of the tree that includes the new apartment
+ */
+AVL::node *AVL::helper_insert (const Apartment &apartment, float key,
+                               AVL::node *curr_node)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return _pool.create (apartment, key, nullptr, nullptr);
+    }
+  else if (curr_node->is_dead ()
+           && OrderingContext::same_coordinates (curr_node->get_data (),
+                                                 apartment))
+    {
+      // the apartment was lazily erased, bring its node back
+      curr_node->set_data (apartment, key);
+      curr_node->set_dead (false);
+      _tombstones--;
+      return curr_node;
+    }
+    // the apartment key is bigger than the apartment in the node,
     // call this func with the right child
-  else if (apartment > curr_node->get_data ())
+  else if (key_greater (apartment, key, curr_node, _context))
     {
-      curr_node->set_right (helper_insert (apartment,
+      curr_node->set_right (helper_insert (apartment, key,
                                            curr_node->get_right ()));
     }
 
@@ -486,7 +1365,7 @@ AVL::node *AVL::helper_insert (const Apartment &apartment,
       // the apartment key is smaller than the apartment in the node,
       // call this func with the left child.
       // we assume that there are not two equal apartments
-      curr_node->set_left (helper_insert (apartment,
+      curr_node->set_left (helper_insert (apartment, key,
                                           curr_node->get_left ()));
     }
 
@@ -509,7 +1388,7 @@ int AVL::get_height_of_node (const AVL::node *curr_node)
 }
 
 /**
- * update height of a node
+ * update height of a node, and its bounding box (see node::update_box)
  * @param curr_node pointer to node we ant to update its height
  */
 void AVL::update_height (AVL::node *curr_node)
@@ -532,6 +1411,7 @@ void AVL::update_height (AVL::node *curr_node)
           HEIGHT_NODE_FACTOR +
           get_height_of_node (curr_node->get_right ()));
     }
+  curr_node->update_box ();
 }
 
 /**
@@ -549,3 +1429,474 @@ int AVL::get_balance_factor_of_node (const AVL::node *p_node)
          get_height_of_node (p_node->get_right ());
 }
 
+/**
+ * Walks the whole tree once and collects its shape and memory statistics.
+ * @return tree_stats of this tree
+ */
+AVL::tree_stats AVL::stats () const
+{
+  tree_stats stats = {};
+  stats.height = get_height_of_node (_root);
+  stats.cache_hits = _cache.hits;
+  stats.cache_misses = _cache.misses;
+  stats.tombstones = _tombstones;
+  stats.filter_rejects = _filter.rejects;
+  stats.filter_passes = _filter.passes;
+  stats.filter_false_positives = _filter.false_positives;
+  stats.filter_bytes = _filter.bytes ();
+  size_t depth_sum = 0;
+  uintptr_t low = UINTPTR_MAX, high = 0;
+  helper_stats (_root, ROOT_SEARCH_DEPTH, stats, depth_sum, low, high);
+
+  if (stats.node_count == 0) // empty tree
+    {
+      return stats;
+    }
+  stats.avg_search_depth = (double) depth_sum / stats.node_count;
+  stats.node_bytes = stats.node_count * sizeof (AVL::node);
+  stats.payload_bytes = stats.node_count * sizeof (Apartment);
+
+  // the nodes occupy [low, high + sizeof (node)), everything else in that
+  // range is a gap between them
+  double span = (double) (high - low) + sizeof (AVL::node);
+  stats.fragmentation = 1.0 - stats.node_bytes / span;
+  return stats;
+}
+
+/**
+ * recursive func that accumulates the statistics of a sub tree
+ * @param curr_node the current node in the tree
+ * @param depth search depth of curr_node
+ * @param stats statistics to accumulate into
+ * @param depth_sum sum of the search depths seen so far
+ * @param low lowest node address seen so far
+ * @param high highest node address seen so far
+ */
+void AVL::helper_stats (const AVL::node *curr_node, int depth,
+                        tree_stats &stats, size_t &depth_sum,
+                        uintptr_t &low, uintptr_t &high)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+
+  stats.node_count++;
+  depth_sum += depth;
+  if (depth > stats.max_search_depth)
+    {
+      stats.max_search_depth = depth;
+    }
+
+  int balance_factor = get_balance_factor_of_node (curr_node);
+  if (balance_factor >= R_BF_FACTOR && balance_factor <= L_BF_FACTOR)
+    {
+      stats.balance_histogram[balance_factor - R_BF_FACTOR]++;
+    }
+
+  auto address = reinterpret_cast<uintptr_t> (curr_node);
+  low = std::min (low, address);
+  high = std::max (high, address);
+
+  helper_stats (curr_node->get_left (), depth + 1, stats, depth_sum,
+                low, high);
+  helper_stats (curr_node->get_right (), depth + 1, stats, depth_sum,
+                low, high);
+}
+
+/**
+ * Checks the AVL invariants: the order of the apartments, the cached height
+ * of every node and that every balance factor is -1, 0 or 1.
+ * Runs in O(n) without allocating.
+ * @return true if the tree is a legal AVL tree, false otherwise
+ */
+bool AVL::validate () const
+{
+  return helper_validate (_root, nullptr, nullptr, _context)
+         != HEIGHT_INVALID_TREE;
+}
+
+/**
+ * recursive func that checks the AVL invariants of a sub tree
+ * @param curr_node the current node in the tree
+ * @param low apartment that bounds the sub tree from below (or nullptr)
+ * @param high apartment that bounds the sub tree from above (or nullptr)
+ * @param context ordering context of the tree
+ * @return the real height of the sub tree, or HEIGHT_INVALID_TREE if an
+ * invariant is broken
+ */
+int AVL::helper_validate (const AVL::node *curr_node,
+                          const Apartment *low, const Apartment *high,
+                          const OrderingContext &context)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return HEIGHT_NULL_NODE;
+    }
+
+  const Apartment &data = curr_node->get_data ();
+  if ((low != nullptr && context.less (data, *low))
+      || (high != nullptr && context.less (*high, data))
+      || curr_node->get_key () != (float) context.key (data))
+    {
+      return HEIGHT_INVALID_TREE;
+    }
+
+  int left = helper_validate (curr_node->get_left (), low, &data, context);
+  int right = helper_validate (curr_node->get_right (), &data, high,
+                               context);
+  if (left == HEIGHT_INVALID_TREE || right == HEIGHT_INVALID_TREE)
+    {
+      return HEIGHT_INVALID_TREE;
+    }
+
+  int height = HEIGHT_NODE_FACTOR + std::max (left, right);
+  if (height != curr_node->get_height () || left - right < R_BF_FACTOR
+      || left - right > L_BF_FACTOR)
+    {
+      return HEIGHT_INVALID_TREE;
+    }
+  return height;
+}
+
+/**
+ * Moves all the nodes to fresh memory in van Emde Boas order: the top half
+ * of the levels is laid out first, followed by each of the bottom sub trees,
+ * recursively. A descent then touches few cache lines and pages no matter
+ * how the nodes were allocated. Meant to be called after bulk updates.
+ * Runs in O(n log log n). Invalidates all iterators and node pointers.
+ * Does nothing while the tree holds caller owned nodes, which cannot move.
+ */
+void AVL::compact ()
+{
+  if (_root == nullptr || _external > 0) // nothing to move
+    {
+      return;
+    }
+
+  std::vector<AVL::node *> order;
+  order.reserve (_pool.size ());
+  helper_veb_order (_root, get_height_of_node (_root) + HEIGHT_NODE_FACTOR,
+                    order);
+
+  // copy the nodes in layout order. the copies still point to the old
+  // children, and each old node keeps a forwarding pointer to its copy in
+  // its right child, which is no longer needed
+  Pool<AVL::node> new_pool;
+  new_pool.reserve (order.size ());
+  std::vector<bool> dirty;
+  dirty.reserve (order.size ());
+  for (const AVL::node *old_node : order)
+    {
+      dirty.push_back (old_node->is_dirty ());
+    }
+  std::vector<AVL::node *> copies;
+  copies.reserve (order.size ());
+  for (AVL::node *old_node : order)
+    {
+      AVL::node *copy = new_pool.create (*old_node);
+      old_node->set_right (copy);
+      copies.push_back (copy);
+    }
+
+  // rewire the copies to the copies of their children
+  for (AVL::node *copy : copies)
+    {
+      if (copy->get_left () != nullptr)
+        {
+          copy->set_left (copy->get_left ()->get_right ());
+        }
+      if (copy->get_right () != nullptr)
+        {
+          copy->set_right (copy->get_right ()->get_right ());
+        }
+    }
+  // moving changes no sub tree, the copies keep the dirty flags of the
+  // originals
+  for (size_t i = 0; i < copies.size (); i++)
+    {
+      copies[i]->dirty_ = dirty[i];
+    }
+
+  set_root (_root->get_right ());
+  _pool.swap (new_pool);
+  _cache.clear ();
+}
+
+/**
+ * @return a splittable range of the whole tree
+ */
+AVL::Range AVL::whole_range () const
+{
+  return Range (_root);
+}
+
+/**
+ * Marks the whole tree unchanged, for example after a full checkpoint.
+ * Costs O(c log n) for c dirty nodes.
+ */
+void AVL::mark_unchanged ()
+{
+  auto ignore_apartment = [] (const Apartment &)
+  {};
+  auto ignore_range = [] (const Apartment &, size_t, const Apartment &,
+                          size_t)
+  {};
+  collect_changes (ignore_apartment, ignore_range);
+}
+
+/**
+ * @param curr_node root of a sub tree
+ * @param leftmost true for the first live node, false for the last
+ * @return the first or the last live node of the sub tree in order, or
+ * nullptr if it holds only tombstones
+ */
+const AVL::node *AVL::edge_live (const AVL::node *curr_node, bool leftmost)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return nullptr;
+    }
+  const AVL::node *near = leftmost ? curr_node->get_left ()
+                                   : curr_node->get_right ();
+  const AVL::node *far = leftmost ? curr_node->get_right ()
+                                  : curr_node->get_left ();
+  const AVL::node *found = edge_live (near, leftmost);
+  if (found != nullptr)
+    {
+      return found;
+    }
+  return curr_node->is_dead () ? edge_live (far, leftmost) : curr_node;
+}
+
+/**
+ * recursive func that counts the copies at one end of a sub tree (see
+ * AVL::edge_copies)
+ * @param curr_node the current node in the tree
+ * @param leftmost true to count from the start, false from the end
+ * @param edge apartment whose copies are counted, nullptr until the first
+ * live apartment is met
+ * @param count number of copies so far
+ * @return false once a live apartment with other coordinates is met
+ */
+static bool helper_edge_copies (const AVL::node *curr_node, bool leftmost,
+                                const Apartment *&edge, size_t &count)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return true;
+    }
+  const AVL::node *near = leftmost ? curr_node->get_left ()
+                                   : curr_node->get_right ();
+  const AVL::node *far = leftmost ? curr_node->get_right ()
+                                  : curr_node->get_left ();
+  if (!helper_edge_copies (near, leftmost, edge, count))
+    {
+      return false;
+    }
+  if (!curr_node->is_dead ())
+    {
+      if (edge == nullptr)
+        {
+          edge = &curr_node->get_data ();
+        }
+      else if (!OrderingContext::same_coordinates (*edge,
+                                                   curr_node->get_data ()))
+        {
+          return false;
+        }
+      count++;
+    }
+  return helper_edge_copies (far, leftmost, edge, count);
+}
+
+/**
+ * @param curr_node root of a sub tree
+ * @param leftmost true to count at the start of the sub tree, false at
+ * the end
+ * @return number of live apartments at that end of the sub tree, in
+ * order, with the coordinates of the first or the last live apartment
+ */
+size_t AVL::edge_copies (const AVL::node *curr_node, bool leftmost)
+{
+  const Apartment *edge = nullptr;
+  size_t count = 0;
+  helper_edge_copies (curr_node, leftmost, edge, count);
+  return count;
+}
+
+/**
+ * Puts a bounded cache of recently found nodes in front of find (), for
+ * workloads where a few apartments get most of the lookups. A hit skips
+ * the descent from the root. erase () drops the entries of the nodes it
+ * frees, insert () leaves the cache alone. Iterators are not affected.
+ * @param capacity number of cached nodes (rounded up to a power of 2), 0
+ * turns the cache off
+ */
+void AVL::set_find_cache (size_t capacity)
+{
+  _cache.resize (capacity);
+}
+
+/**
+ * Puts an approximate membership filter (see ApartmentFilter) in front of
+ * find () and erase (), for workloads where most lookups are for
+ * apartments that are not in the tree. A lookup that the filter rejects
+ * returns end () without descending. The filter is kept up to date by
+ * every insert and erase, and is filled with the current apartments.
+ * @param expected_size number of apartments the filter is sized for, 0
+ * turns the filter off
+ * @param false_positive_rate wanted part of the lookups for absent
+ * apartments that still descend, in (0, 1). A lower rate costs more
+ * memory, see stats ().filter_bytes
+ */
+void AVL::set_filter (size_t expected_size, double false_positive_rate)
+{
+  _filter.resize (expected_size, false_positive_rate);
+  for_each_in_order ([this] (const Apartment &apartment)
+                     { _filter.add (apartment); });
+}
+
+/**
+ * Switches erase () to lazy mode, for bursts of erases. A lazy erase only
+ * marks the node as a tombstone in a single descent, without restructuring
+ * the tree. find () and the iterators skip tombstones, and inserting the
+ * apartment again revives its node. Once more than max_tombstone_ratio of
+ * the nodes are tombstones, the tree is rebuilt without them in O(n).
+ * @param max_tombstone_ratio ratio of tombstones that triggers a rebuild,
+ * 0 goes back to structural erase (and drops the current tombstones)
+ */
+void AVL::set_lazy_erase (double max_tombstone_ratio)
+{
+  _max_tombstone_ratio = max_tombstone_ratio;
+  if (_max_tombstone_ratio <= 0 && _tombstones > 0)
+    {
+      rebuild ();
+    }
+}
+
+/**
+ * Rebuilds the tree as a perfectly balanced tree of its live apartments,
+ * dropping all tombstones. Runs in O(n) and reuses the live nodes.
+ * Invalidates all iterators.
+ */
+void AVL::rebuild ()
+{
+  std::vector<AVL::node *> nodes;
+  nodes.reserve (_pool.size () - _tombstones);
+  helper_collect_live (_root, nodes);
+  set_root (helper_build (nodes, 0, nodes.size ()));
+  _tombstones = 0;
+}
+
+/**
+ * recursive func that collects the live nodes of a sub tree in order and
+ * frees its tombstones (caller owned ones are only unlinked)
+ * @param curr_node the current node in the tree
+ * @param nodes vector to append the live nodes to
+ */
+void AVL::helper_collect_live (AVL::node *curr_node,
+                               std::vector<AVL::node *> &nodes)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+  AVL::node *right = curr_node->get_right ();
+  helper_collect_live (curr_node->get_left (), nodes);
+  if (curr_node->is_dead () && curr_node->is_external ())
+    {
+      // erase_range hands caller owned nodes back unlinked
+      curr_node->left_ = curr_node->right_ = curr_node->parent_ = nullptr;
+      curr_node->set_dead (false);
+      _external--;
+    }
+  else if (curr_node->is_dead ())
+    {
+      _pool.destroy (curr_node);
+    }
+  else
+    {
+      nodes.push_back (curr_node);
+    }
+  helper_collect_live (right, nodes);
+}
+
+/**
+ * recursive func that links sorted nodes into a perfectly balanced tree
+ * @param nodes sorted nodes
+ * @param begin index of the first node of the sub tree
+ * @param end index past the last node of the sub tree
+ * @return root of the sub tree
+ */
+AVL::node *AVL::helper_build (const std::vector<AVL::node *> &nodes,
+                              size_t begin, size_t end)
+{
+  if (begin == end) // base case
+    {
+      return nullptr;
+    }
+  size_t mid = begin + (end - begin) / 2;
+  AVL::node *curr_node = nodes[mid];
+  // the nodes are relinked while their parent links are stale, so they
+  // are marked here rather than through their ancestors
+  curr_node->dirty_ = true;
+  curr_node->set_left (helper_build (nodes, begin, mid));
+  curr_node->set_right (helper_build (nodes, mid + 1, end));
+  update_height (curr_node);
+  return curr_node;
+}
+
+/**
+ * recursive func that lists the top levels of a sub tree in van Emde Boas
+ * order
+ * @param curr_node root of the sub tree
+ * @param levels number of levels of the sub tree to list
+ * @param order vector to append the nodes to
+ */
+void AVL::helper_veb_order (AVL::node *curr_node, int levels,
+                            std::vector<AVL::node *> &order)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+  if (levels == 1) // a single node
+    {
+      order.push_back (curr_node);
+      return;
+    }
+
+  // lay out the top half of the levels, then every bottom sub tree
+  int top_levels = levels / 2;
+  helper_veb_order (curr_node, top_levels, order);
+
+  std::vector<AVL::node *> bottoms;
+  helper_nodes_at_depth (curr_node, top_levels, bottoms);
+  for (AVL::node *bottom : bottoms)
+    {
+      helper_veb_order (bottom, levels - top_levels, order);
+    }
+}
+
+/**
+ * recursive func that lists the nodes at a given depth of a sub tree
+ * @param curr_node root of the sub tree
+ * @param depth depth of the wanted nodes below curr_node
+ * @param nodes vector to append the nodes to
+ */
+void AVL::helper_nodes_at_depth (AVL::node *curr_node, int depth,
+                                 std::vector<AVL::node *> &nodes)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+  if (depth == 0)
+    {
+      nodes.push_back (curr_node);
+      return;
+    }
+  helper_nodes_at_depth (curr_node->get_left (), depth - 1, nodes);
+  helper_nodes_at_depth (curr_node->get_right (), depth - 1, nodes);
+}
@@ -2,7 +2,20 @@
 #define _AVL_H_
 #include <vector>
 #include "Apartment.h"
+#include "Pool.h"
+#include "FindCache.h"
+#include "ApartmentFilter.h"
+#include "OrderingContext.h"
+#include "WorkStealingPool.h"
+#include <mutex>
 #include <stack>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
 
 #define HEIGHT_NODE_FACTOR 1
 #define HEIGHT_NULL_NODE -1
@@ -12,6 +25,10 @@
 #define L_BF_FACTOR 1
 #define LL_BF_FACTOR 0
 #define HEIGHT_NEW_NODE 0
+#define BF_HISTOGRAM_SIZE 3
+#define ROOT_SEARCH_DEPTH 1
+#define HEIGHT_INVALID_TREE -2
+#define PARALLEL_GRAIN_HEIGHT 12
 
 /**
  * this class represents AVL tree
@@ -23,18 +40,64 @@ class AVL {
    * To manage the tree nodes, we use a nested struct. This struct contains
    * the apartment corresponding to the node, the left son and the right son
    * of the node, both of them node type themselves.
+   * The node also caches the key of its apartment in the ordering context of
+   * the tree (the squared distance from its reference point) as a float, so
+   * most comparisons during a descent are a single float compare. Rounding
+   * to float keeps the order of the keys, so when two keys differ the
+   * apartments compare the same way; only equal keys fall back to the exact
+   * keys, and equal exact keys to the coordinates. The key, the height and
+   * the tombstone flag fit in the padding after the pointers, so a node is
+   * 48 bytes (40 with the 8 byte apartments of APARTMENT_FIXED_POINT).
+   * Every node also points to its parent (nullptr for the root), so a search
+   * or an update can start from a node and walk up. set_left and set_right
+   * keep the parent of the new child up to date.
+   * A node is either created by the tree in its pool, or embedded by the
+   * caller in its own object and linked with insert_node () (see there).
+   * The external flag tells them apart, so the tree never frees or moves a
+   * node that it does not own.
+   * The dirty flag marks a node whose sub tree changed since the last
+   * collect_changes (): a new node, a node whose child was replaced (by an
+   * insert, an erase or a rotation) or whose apartment or tombstone flag
+   * changed. Marking a node marks its ancestors as well, so a clean node
+   * heads a sub tree that is exactly as it was. The flag takes the last
+   * byte of padding, the node stays 48 bytes.
+   * Built with AVL_BOUNDING_BOXES, every node also keeps the bounding box of
+   * the apartments of its sub tree (tombstones included), as floats rounded
+   * outward, so query_rect () skips the sub trees outside a rectangle. The
+   * box is kept up to date wherever the height is, and a node is 64 bytes.
+   * The links stay pointers here because the nodes embedded with
+   * insert_node () live outside any pool and node * is what get_root () and
+   * the iterators hand out. For large sets that need none of that, see
+   * CompactAVL: its nodes link by 32 bit indices and keep a 2 bit balance
+   * factor, 32 bytes a node (20 with APARTMENT_FIXED_POINT).
    */
   struct node {
       /**
        * Constructor - It can be expanded
        * @param data the corresponding apartment object
+       * @param key the sort key of data
        * @param left child
        * @param right child
        */
-      node (Apartment data, node *left, node *right)
-          : data_ (data), left_ (left), right_ (right),
-            height_ (HEIGHT_NEW_NODE)
+      node (const Apartment &data, float key, node *left, node *right)
+          : data_ (data), left_ (nullptr), right_ (nullptr), parent_ (nullptr),
+            key_ (key), height_ (HEIGHT_NEW_NODE), dead_ (false),
+            external_ (false), dirty_ (true)
+      {
+        set_left (left);
+        set_right (right);
+        update_box ();
+      }
+
+      /**
+       * Constructor of a node that the caller owns, to embed in its own
+       * object and link with insert_node ()
+       * @param data the corresponding apartment object
+       */
+      explicit node (const Apartment &data)
+          : node (data, 0, nullptr, nullptr)
       {}
+
       /**
        * @return the left child of this node
        */
@@ -59,11 +122,20 @@ class AVL {
       }
 
       /**
-       * set the height of this node
+       * set the height of this node. an AVL tree with 2^32 nodes is less
+       * than 47 levels high, so the height fits in a byte.
        */
       void set_height (int height)
       {
-        height_ = height;
+        height_ = (signed char) height;
+      }
+
+      /**
+       * @return the parent of this node, nullptr for the root
+       */
+      node *get_parent () const
+      {
+        return parent_;
       }
 
       /**
@@ -71,7 +143,15 @@ class AVL {
        */
       void set_right (node *right)
       {
+        if (right_ != right)
+          {
+            mark_dirty ();
+          }
         right_ = right;
+        if (right != nullptr)
+          {
+            right->parent_ = this;
+          }
       }
 
       /**
@@ -79,7 +159,15 @@ class AVL {
        */
       void set_left (node *left)
       {
+        if (left_ != left)
+          {
+            mark_dirty ();
+          }
         left_ = left;
+        if (left != nullptr)
+          {
+            left->parent_ = this;
+          }
       }
 
       /**
@@ -89,9 +177,169 @@ class AVL {
       {
         return data_;
       }
+
+      /**
+       * @return the cached sort key of this node
+       */
+      float get_key () const
+      {
+        return key_;
+      }
+
+      /**
+       * replace the apartment of this node, together with its sort key
+       * @param data the new apartment
+       * @param key the sort key of data
+       */
+      void set_data (const Apartment &data, float key)
+      {
+        data_ = data;
+        key_ = key;
+        mark_dirty ();
+        update_boxes_up ();
+      }
+      /**
+       * @return true if the apartment of this node was lazily erased
+       */
+      bool is_dead () const
+      {
+        return dead_;
+      }
+
+      /**
+       * mark this node as a tombstone or bring it back to life
+       */
+      void set_dead (bool dead)
+      {
+        if (dead_ != dead)
+          {
+            mark_dirty ();
+          }
+        dead_ = dead;
+      }
+
+      /**
+       * @return true if the node is owned by the caller and not by the pool
+       * of a tree
+       */
+      bool is_external () const
+      {
+        return external_;
+      }
+
+      /**
+       * @return true if the sub tree of this node changed since the last
+       * collect_changes ()
+       */
+      bool is_dirty () const
+      {
+        return dirty_;
+      }
+
+      /**
+       * mark this node and its ancestors as changed. the ancestors of a
+       * dirty node are already dirty, so the walk stops at the first one
+       */
+      void mark_dirty ()
+      {
+        for (node *curr = this; curr != nullptr && !curr->dirty_;
+             curr = curr->parent_)
+          {
+            curr->dirty_ = true;
+          }
+      }
+
+      /**
+       * recompute the bounding box of the sub tree of this node from its
+       * apartment and the boxes of its children. Does nothing without
+       * AVL_BOUNDING_BOXES.
+       * @return true if the box changed
+       */
+      bool update_box ()
+      {
+#ifdef AVL_BOUNDING_BOXES
+        float min_x = round_down (data_.get_x ());
+        float min_y = round_down (data_.get_y ());
+        float max_x = round_up (data_.get_x ());
+        float max_y = round_up (data_.get_y ());
+        for (const node *child : {left_, right_})
+          {
+            if (child != nullptr)
+              {
+                min_x = std::min (min_x, child->min_x_);
+                min_y = std::min (min_y, child->min_y_);
+                max_x = std::max (max_x, child->max_x_);
+                max_y = std::max (max_y, child->max_y_);
+              }
+          }
+        bool changed = min_x != min_x_ || min_y != min_y_
+                       || max_x != max_x_ || max_y != max_y_;
+        min_x_ = min_x;
+        min_y_ = min_y;
+        max_x_ = max_x;
+        max_y_ = max_y;
+        return changed;
+#else
+        return false;
+#endif
+      }
+
+      /**
+       * recompute the bounding boxes of this node and its ancestors after
+       * the sub tree of this node changed. a box that stays the same leaves
+       * the boxes above it the same, so the walk stops there
+       */
+      void update_boxes_up ()
+      {
+        for (node *curr = this; curr != nullptr && curr->update_box ();
+             curr = curr->parent_)
+          {}
+      }
+
+#ifdef AVL_BOUNDING_BOXES
+      /**
+       * @return true if the bounding box of the sub tree of this node meets
+       * the rectangle [min_x, max_x] x [min_y, max_y]
+       */
+      bool box_meets (double min_x, double min_y, double max_x,
+                      double max_y) const
+      {
+        return !(max_x_ < min_x || min_x_ > max_x || max_y_ < min_y
+                 || min_y_ > max_y);
+      }
+
+      /**
+       * @return the largest float not above value
+       */
+      static float round_down (double value)
+      {
+        float rounded = (float) value;
+        return (rounded > value)
+               ? std::nextafter (rounded, -std::numeric_limits<float>::max ())
+               : rounded;
+      }
+
+      /**
+       * @return the smallest float not below value
+       */
+      static float round_up (double value)
+      {
+        float rounded = (float) value;
+        return (rounded < value)
+               ? std::nextafter (rounded, std::numeric_limits<float>::max ())
+               : rounded;
+      }
+#endif
       Apartment data_;
-      node *left_, *right_;
-      int height_;
+      node *left_, *right_, *parent_;
+      float key_;
+      signed char height_;
+      bool dead_;
+      bool external_;
+      bool dirty_;
+#ifdef AVL_BOUNDING_BOXES
+      float min_x_ = 0, min_y_ = 0, max_x_ = 0, max_y_ = 0;
+#endif
 
   };
 
@@ -100,6 +348,14 @@ class AVL {
    */
   AVL ();
 
+  /**
+   * Constructor. Constructs an empty AVL tree that orders its apartments by
+   * their distance from the reference point of context, or in Z order for
+   * OrderingContext::morton ()
+   * @param context reference point of the tree
+   */
+  AVL (const OrderingContext &context);
+
   /**
    * Copy constructor
    * @param other other AVL obj to copy
@@ -131,6 +387,11 @@ class AVL {
    */
   node *get_root () const;
 
+  /**
+   * @return the ordering context of this tree
+   */
+  const OrderingContext &get_context () const;
+
   /**
    * The function inserts the new apartment into the tree so that it maintains
    * the legality of the tree.
@@ -170,6 +431,10 @@ class AVL {
         : cur (cur)
     {
       stack.push (cur);
+      if (cur != nullptr && cur->is_dead ())
+        {
+          ++*this;
+        }
     }
 
     /**
@@ -191,15 +456,14 @@ class AVL {
     }
 
     /**
-     * Pre-increment operator.
-     * @return reference to this
+     * moves to the next node in preorder, tombstones included
      */
-    Iterator &operator++ ()
+    void step ()
     {
       if (stack.empty ()) // end of iterator
         {
           cur = nullptr;
-          return *this;
+          return;
         }
       // in pre-order take the first in stack(the parent) and put his 2
       // children in stack
@@ -217,10 +481,23 @@ class AVL {
       if (stack.empty ()) // end of iterator
         {
           cur = nullptr;
-          return *this;
+          return;
         }
       node *new_top = stack.top ();
       cur = new_top;
+    }
+
+    /**
+     * Pre-increment operator. Tombstones (see set_lazy_erase) are skipped.
+     * @return reference to this
+     */
+    Iterator &operator++ ()
+    {
+      do
+        {
+          step ();
+        }
+      while (cur != nullptr && cur->is_dead ());
       return *this;
     }
 
@@ -230,34 +507,8 @@ class AVL {
      */
     Iterator operator++ (int)
     {
-
       iterator it = *this;
-      if (stack.empty ()) // end of iterator
-        {
-          cur = nullptr;
-          return it;
-        }
-
-      // in pre-order take the first in stack(the parent) and put his 2
-      // children in stack
-      node *prev_top = stack.top ();
-      stack.pop ();
-
-      if (prev_top->get_right () != nullptr)
-        {
-          stack.push (prev_top->get_right ());
-        }
-
-      if (prev_top->get_left () != nullptr)
-        { stack.push (prev_top->get_left ()); }
-
-      if (stack.empty ()) // end of iterator
-        {
-          cur = nullptr;
-          return it;
-        }
-      node *new_top = stack.top ();
-      cur = new_top;
+      ++*this;
       return it;
     }
 
@@ -289,6 +540,7 @@ class AVL {
    * The iterator will move in preorder.
    */
   class ConstIterator {
+    friend class AVL;
     AVL::node *cur;
     std::stack<node *> stack;
 
@@ -308,6 +560,10 @@ class AVL {
         : cur (cur)
     {
       stack.push (cur);
+      if (cur != nullptr && cur->is_dead ())
+        {
+          ++*this;
+        }
     }
 
     /**
@@ -337,15 +593,14 @@ class AVL {
     }
 
     /**
-     * Pre-increment operator.
-     * @return reference to this
+     * moves to the next node in preorder, tombstones included
      */
-    ConstIterator &operator++ ()
+    void step ()
     {
       if (stack.empty ()) // end of iterator
         {
           cur = nullptr;
-          return *this;
+          return;
         }
       // in pre-order take the first in stack(the parent) and put his 2
       // children in stack
@@ -363,10 +618,23 @@ class AVL {
       if (stack.empty ()) // end of iterator
         {
           cur = nullptr;
-          return *this;
+          return;
         }
       node *new_top = stack.top ();
       cur = new_top;
+    }
+
+    /**
+     * Pre-increment operator. Tombstones (see set_lazy_erase) are skipped.
+     * @return reference to this
+     */
+    ConstIterator &operator++ ()
+    {
+      do
+        {
+          step ();
+        }
+      while (cur != nullptr && cur->is_dead ());
       return *this;
     }
 
@@ -377,31 +645,7 @@ class AVL {
     ConstIterator operator++ (int)
     {
       const_iterator it = *this;
-      if (stack.empty ()) // end of iterator
-        {
-          cur = nullptr;
-          return it;
-        }
-      // in pre-order take the first in stack(the parent) and put his 2
-      // children in stack
-      node *prev_top = stack.top ();
-      stack.pop ();
-
-      if (prev_top->get_right () != nullptr)
-        {
-          stack.push (prev_top->get_right ());
-        }
-
-      if (prev_top->get_left () != nullptr)
-        { stack.push (prev_top->get_left ()); }
-
-      if (stack.empty ()) // end of iterator
-        {
-          cur = nullptr;
-          return it;
-        }
-      node *new_top = stack.top ();
-      cur = new_top;
+      ++*this;
       return it;
     }
 
@@ -430,6 +674,132 @@ class AVL {
   typedef Iterator iterator;
   typedef ConstIterator const_iterator;
 
+  /**
+   * A splittable range of the tree, in order, for parallel algorithms (it
+   * models the Range of TBB, see WorkStealingPool::for_each_range). A range
+   * is a node with its left sub tree, its right sub tree, both or neither.
+   * A whole sub tree splits into its left sub tree and the rest, and the
+   * rest into its node and its right sub tree, so the pieces stay in order
+   * and never overlap. A range of height PARALLEL_GRAIN_HEIGHT or less (at
+   * most a few thousand nodes) is not split. The tree must not change while
+   * a range of it is in use.
+   */
+  class Range {
+    const AVL::node *_node;
+    bool _left, _right;
+
+    /**
+     * Constructor.
+     * @param curr_node node of the range
+     * @param left true if the left sub tree of curr_node is in the range
+     * @param right true if the right sub tree of curr_node is in the range
+     */
+    Range (const AVL::node *curr_node, bool left, bool right)
+        : _node (curr_node), _left (left), _right (right)
+    {}
+
+   public:
+    /**
+     * Constructor.
+     * @param root root of the sub tree of the range, may be nullptr
+     */
+    explicit Range (const AVL::node *root)
+        : Range (root, true, true)
+    {}
+
+    /**
+     * @return true if the range holds no node
+     */
+    bool empty () const
+    {
+      return _node == nullptr;
+    }
+
+    /**
+     * @return true if the range is large enough to split
+     */
+    bool is_divisible () const
+    {
+      return _node != nullptr && (_left || _right)
+             && _node->get_height () > PARALLEL_GRAIN_HEIGHT;
+    }
+
+    /**
+     * Splits a divisible range: this range keeps the first part, in order
+     * @return the second part
+     */
+    Range split ()
+    {
+      if (_left)
+        {
+          Range second (_node, false, _right);
+          *this = Range (_node->get_left ());
+          return second;
+        }
+      Range second (_node->get_right ());
+      _right = false;
+      return second;
+    }
+
+    /**
+     * Calls f on every apartment of the range in order. Tombstones are
+     * skipped.
+     * @param f function that gets a const Apartment &
+     */
+    template<class Function>
+    void for_each (Function f) const
+    {
+      if (_node == nullptr)
+        {
+          return;
+        }
+      if (_left)
+        {
+          helper_in_order (_node->get_left (), f);
+        }
+      if (!_node->is_dead ())
+        {
+          f (_node->get_data ());
+        }
+      if (_right)
+        {
+          helper_in_order (_node->get_right (), f);
+        }
+    }
+  };
+
+  /**
+   * Shape and memory statistics of the tree, as returned by stats ().
+   * The depth of a successful search is the number of nodes visited until
+   * the apartment is found (1 for the root).
+   * balance_histogram[i] counts the nodes whose balance factor is
+   * i + R_BF_FACTOR, i.e. -1, 0 and 1. fragmentation is the part of the
+   * address range spanned by the nodes that is not used by them (0 means the
+   * nodes are packed back to back). cache_hits and cache_misses count the
+   * find () calls answered by the find cache and those that were not.
+   * node_count includes the tombstones, which are also counted on their own.
+   * filter_rejects counts the find () and erase () calls that the membership
+   * filter answered without a search, filter_passes those it let through,
+   * and filter_false_positives the passes that found nothing.
+   */
+  struct tree_stats {
+      size_t node_count;
+      int height;
+      double avg_search_depth;
+      int max_search_depth;
+      size_t balance_histogram[BF_HISTOGRAM_SIZE];
+      size_t node_bytes;
+      size_t payload_bytes;
+      double fragmentation;
+      size_t cache_hits;
+      size_t cache_misses;
+      size_t tombstones;
+      size_t filter_rejects;
+      size_t filter_passes;
+      size_t filter_false_positives;
+      size_t filter_bytes;
+  };
+
   /**
    * @return Iterator object that corresponds to the beginning of the tree
    * (root)
@@ -482,6 +852,203 @@ class AVL {
    * we were looking for. If there is no such member, returns end ().
    */
   const_iterator find (const Apartment &data) const;
+
+  /**
+   * Looks up the apartment at (x, y) without the caller building an
+   * apartment. Same as find (const Apartment &), the sort key is computed
+   * once for the whole descent.
+   * @param x x coordinate of the apartment
+   * @param y y coordinate of the apartment
+   * @return iterator to the apartment, or end () if there is no such member
+   */
+  iterator find (double x, double y);
+
+  /**
+   * Looks up the apartment at (x, y) without the caller building an
+   * apartment. Same as find (const Apartment &), the sort key is computed
+   * once for the whole descent.
+   * @param x x coordinate of the apartment
+   * @param y y coordinate of the apartment
+   * @return const iterator to the apartment, or end () if there is no such
+   * member
+   */
+  const_iterator find (double x, double y) const;
+
+  /**
+   * Looks up the apartment itself: unlike find (), an apartment less than
+   * EPSILON away with other coordinates is not a match. This is the
+   * apartment that erase (const Apartment &) erases.
+   * @param data apartment to search
+   * @return iterator to an apartment with the coordinates of data, or
+   * end () if there is none
+   */
+  iterator find_exact (const Apartment &data);
+
+  /**
+   * Looks up the apartment itself. See find_exact (const Apartment &).
+   * @param data apartment to search
+   * @return const iterator to an apartment with the coordinates of data, or
+   * end () if there is none
+   */
+  const_iterator find_exact (const Apartment &data) const;
+
+  /**
+   * Looks up an apartment by a precomputed sort key, the squared distance
+   * from the reference point as returned by get_context ().key (). The
+   * descent compares raw keys only. When a few apartments are at the same
+   * distance, any one of them is found.
+   * @param key sort key to search
+   * @return iterator to an apartment with the key, or end () if there is
+   * none
+   */
+  iterator find_by_key (double key);
+
+  /**
+   * Looks up an apartment by a precomputed sort key. See
+   * find_by_key (double).
+   * @param key sort key to search
+   * @return const iterator to an apartment with the key, or end () if there
+   * is none
+   */
+  const_iterator find_by_key (double key) const;
+
+  /**
+   * @param data apartment to search
+   * @return true if the apartment is in the tree
+   */
+  bool contains (const Apartment &data) const;
+
+  /**
+   * @param x x coordinate of the apartment
+   * @param y y coordinate of the apartment
+   * @return true if the apartment at (x, y) is in the tree
+   */
+  bool contains (double x, double y) const;
+
+  /**
+   * @param key sort key, as returned by get_context ().key ()
+   * @return true if an apartment with the key is in the tree
+   */
+  bool contains_key (double key) const;
+  /**
+   * Finger search: looks for an apartment starting from the node of hint
+   * instead of the root. The search climbs from hint only until the
+   * apartment is inside the sub tree it reached, and descends from there, so
+   * it costs O(log d) where d is the rank distance between the two
+   * apartments. A hint of end () searches from the root.
+   * @param hint iterator to a previously found apartment
+   * @param data apartment to search
+   * @return iterator to the item, or end () if there is no such member
+   */
+  iterator find_from (const iterator &hint, const Apartment &data);
+
+  /**
+   * Finger search: looks for an apartment starting from the node of hint
+   * instead of the root. See find_from (const iterator &, ...).
+   * @param hint const iterator to a previously found apartment
+   * @param data apartment to search
+   * @return const iterator to the item, or end () if there is no such member
+   */
+  const_iterator find_from (const const_iterator &hint,
+                            const Apartment &data) const;
+
+  /**
+   * Hinted insert, like std::map: the new node is linked starting from the
+   * node of hint, and the tree is rebalanced upward from the new node only as
+   * far as the heights change. For near sorted input, passing the iterator
+   * returned by the previous insert makes every insert O(log d) in the rank
+   * distance d. A hint of end () starts from the root.
+   * @param hint iterator to an apartment close to the new one
+   * @param apartment Apartment object to add to tree
+   * @return iterator to the inserted apartment
+   */
+  iterator insert (const iterator &hint, const Apartment &apartment);
+
+  /**
+   * Inserts the apartment at (x, y). The apartment is built once and copied
+   * straight into its new node, and the insert walks down from the root
+   * without recursion, rebalancing upward only as far as heights change.
+   * @param x x coordinate of the apartment
+   * @param y y coordinate of the apartment
+   * @return iterator to the inserted apartment
+   */
+  iterator emplace (double x, double y);
+
+  /**
+   * Inserts a range of apartments, or of pairs of coordinates. When the size
+   * of the range is known the nodes are allocated up front. The tree ends up
+   * the same as after inserting the items one by one.
+   * @param first iterator to the first item
+   * @param last iterator past the last item
+   */
+  template<class InputIt>
+  void insert_range (InputIt first, InputIt last);
+
+  /**
+   * Inserts an apartment for every pair of coordinates
+   * @param coordinates vector of pairs
+   */
+  void insert_range (const std::vector<std::pair<double, double>> &coordinates);
+
+  /**
+   * Erases the apartment of an iterator, without searching for it again. The
+   * node is unlinked through its parent links and the tree is rebalanced
+   * upward from there only as far as the heights change (or, in lazy mode,
+   * the node becomes a tombstone). Erasing end () does nothing. Invalidates
+   * the iterators of the erased apartment.
+   * @param position iterator to the apartment to erase
+   */
+  void erase (const iterator &position);
+
+  /**
+   * Erases the apartments from first up to, not including, last, in the
+   * preorder of the iterators. The nodes are collected in one walk over the
+   * range. A small range is unlinked node by node; once unlinking would cost
+   * more than rebuilding, that is once k log n passes n, the rest of the tree
+   * is rebuilt without them instead. The cost is O(log n + min (k log n, n))
+   * for k erased apartments. Invalidates all iterators.
+   * @param first iterator to the first apartment to erase
+   * @param last iterator past the last apartment to erase
+   */
+  void erase_range (iterator first, const iterator &last);
+
+  /**
+   * Inserts a batch of apartments, like an LSM tree merges a buffer into its
+   * next level. The batch is sorted by the order of the tree first. A batch
+   * that is small next to the tree is linked node after node, each search
+   * climbing from the node linked before it, which costs O(b log (n / b)) for
+   * b apartments and touches the tree in order. A batch so large that this
+   * would cost more than O(n + b) is merged with the nodes of the tree in one
+   * linear pass, and the tree is rebuilt perfectly balanced (dropping its
+   * tombstones). Tombstones are not revived by a batch. Invalidates all
+   * iterators.
+   * @param apartments apartments to insert
+   */
+  void insert_batch (const std::vector<Apartment> &apartments);
+
+  /**
+   * Intrusive insert: links a node that the caller owns, typically a member
+   * of a record from the caller's own allocator, without allocating and
+   * without copying its apartment. The node goes through the same descent
+   * and rebalancing as insert (), and is then found and iterated like any
+   * other node. The caller must keep the node alive and in place until it is
+   * erased from the tree; the tree never frees it, and compact () leaves a
+   * tree that holds caller owned nodes as it is. Such nodes are never made
+   * tombstones, erase () always unlinks them.
+   * @param hook node to link, built with node (const Apartment &) and not
+   * linked in any tree
+   * @return iterator to the linked apartment
+   */
+  iterator insert_node (node *hook);
+
+  /**
+   * Unlinks a node from the tree and rebalances upward from where it was.
+   * A caller owned node is handed back untouched, apart from its links, and
+   * may be linked again; a node of the pool is freed.
+   * @param hook node of this tree to erase
+   */
+  void erase_node (node *hook);
+
   /**
    * Insertion operator, prints the apartment in the tree in preorder
    * traversal.
@@ -492,8 +1059,211 @@ class AVL {
    */
   friend std::ostream &operator<< (std::ostream &os, const AVL &avl);
 
+  /**
+   * Calls f on every apartment of the tree in order, closest first.
+   * Tombstones are skipped.
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_in_order (Function f) const;
+
+  /**
+   * Calls f in order on every apartment whose distance from the reference
+   * point of the tree is in [low, high]. Sub trees outside the range are not
+   * visited, so it costs O(log n + k) for k apartments in the range.
+   * Tombstones are skipped. Only for a tree in the distance order.
+   * @param low smallest distance to visit
+   * @param high largest distance to visit
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_in_range (double low, double high, Function f) const;
+
+  /**
+   * Calls f in order on every apartment in the rectangle [min_x, max_x] x
+   * [min_y, max_y], like a map viewport. In the distance order, the
+   * apartments of the rectangle lie between the distance of its nearest
+   * point and of its farthest corner from the reference point of the tree,
+   * so only the sub trees in that ring are visited, as in
+   * for_each_in_range (). In Z order (OrderingContext::morton ()), the
+   * rectangle is covered by intervals of keys and only those are visited,
+   * so a map tile is read as a few runs of neighbouring nodes. Built with
+   * AVL_BOUNDING_BOXES, the sub trees whose bounding box misses the
+   * rectangle are skipped as well.
+   * Tombstones are skipped.
+   * @param min_x smallest x coordinate to visit
+   * @param min_y smallest y coordinate to visit
+   * @param max_x largest x coordinate to visit
+   * @param max_y largest y coordinate to visit
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void query_rect (double min_x, double min_y, double max_x, double max_y,
+                   Function f) const;
+
+  /**
+   * @return a splittable range of the whole tree
+   */
+  Range whole_range () const;
+
+  /**
+   * Calls f on every apartment of the tree, in parallel on the threads of
+   * the shared WorkStealingPool. Whole sub trees go to the threads, so the
+   * apartments are not visited in order and f is called concurrently; it
+   * must be safe for that and must not throw. The tree must not change
+   * meanwhile.
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void parallel_for_each (Function f) const;
+
+  /**
+   * Calls f on every apartment of the tree, in parallel on the threads of
+   * pool. See parallel_for_each (Function).
+   * @param pool pool of threads to use
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void parallel_for_each (WorkStealingPool &pool, Function f) const;
+
+  /**
+   * Maps every apartment of the tree to a value and combines the values, in
+   * parallel on the threads of the shared WorkStealingPool, like
+   * std::transform_reduce. Every piece of the tree is reduced on its own
+   * thread starting from init, and the pieces are then combined in no
+   * particular order, so init must be an identity of combine, and combine
+   * must be associative and commutative. map and combine must not throw.
+   * @param init identity value of combine
+   * @param map function from const Apartment & to T
+   * @param combine function from two T to T
+   * @return the combined value, init for an empty tree
+   */
+  template<class T, class Map, class Combine>
+  T parallel_reduce (T init, Map map, Combine combine) const;
+
+  /**
+   * Maps and combines every apartment of the tree in parallel on the threads
+   * of pool. See parallel_reduce (T, Map, Combine).
+   * @param pool pool of threads to use
+   * @param init identity value of combine
+   * @param map function from const Apartment & to T
+   * @param combine function from two T to T
+   * @return the combined value, init for an empty tree
+   */
+  template<class T, class Map, class Combine>
+  T parallel_reduce (WorkStealingPool &pool, T init, Map map,
+                     Combine combine) const;
+
+  /**
+   * Describes the tree in order as the changes since the last call, for
+   * incremental checkpoints, and marks the whole tree unchanged. Every live
+   * apartment of a dirty node is passed to on_apartment, and every largest
+   * clean sub tree is passed to on_unchanged as its first and last live
+   * apartment, each with the number of copies of it (apartments with the
+   * same coordinates) at that end of the sub tree. The copies tell which of
+   * several identical apartments the run starts and ends with. Such a sub
+   * tree holds exactly the apartments that were between those two at the
+   * last call. Only dirty nodes are visited, so it costs O(c log n) for c
+   * changed nodes (plus the copies at the ends of the runs) rather than
+   * O(n). A new tree, and a tree after rebuild (), insert_batch () or a
+   * copy, is all dirty.
+   * @param on_apartment function that gets a const Apartment &
+   * @param on_unchanged function that gets the first apartment of an
+   * unchanged run, its number of copies at the start of the run, the last
+   * apartment and its number of copies at the end of the run, as
+   * (const Apartment &, size_t, const Apartment &, size_t)
+   */
+  template<class ApartmentFunction, class RangeFunction>
+  void collect_changes (ApartmentFunction on_apartment,
+                        RangeFunction on_unchanged);
+
+  /**
+   * Marks the whole tree unchanged, for example after a full checkpoint.
+   * Costs O(c log n) for c dirty nodes.
+   */
+  void mark_unchanged ();
+
+  /**
+   * Puts a bounded cache of recently found nodes in front of find (), for
+   * workloads where a few apartments get most of the lookups. A hit skips
+   * the descent from the root. erase () drops the entries of the nodes it
+   * frees, insert () leaves the cache alone. Iterators are not affected.
+   * @param capacity number of cached nodes (rounded up to a power of 2), 0
+   * turns the cache off
+   */
+  void set_find_cache (size_t capacity);
+
+  /**
+   * Puts an approximate membership filter (see ApartmentFilter) in front of
+   * find () and erase (), for workloads where most lookups are for
+   * apartments that are not in the tree. A lookup that the filter rejects
+   * returns end () without descending. The filter is kept up to date by
+   * every insert and erase, and is filled with the current apartments.
+   * @param expected_size number of apartments the filter is sized for, 0
+   * turns the filter off
+   * @param false_positive_rate wanted part of the lookups for absent
+   * apartments that still descend, in (0, 1). A lower rate costs more
+   * memory, see stats ().filter_bytes
+   */
+  void set_filter (size_t expected_size, double false_positive_rate);
+
+  /**
+   * Switches erase () to lazy mode, for bursts of erases. A lazy erase only
+   * marks the node as a tombstone in a single descent, without restructuring
+   * the tree. find () and the iterators skip tombstones, and inserting the
+   * apartment again revives its node. Once more than max_tombstone_ratio of
+   * the nodes are tombstones, the tree is rebuilt without them in O(n).
+   * @param max_tombstone_ratio ratio of tombstones that triggers a rebuild,
+   * 0 goes back to structural erase (and drops the current tombstones)
+   */
+  void set_lazy_erase (double max_tombstone_ratio);
+
+  /**
+   * Rebuilds the tree as a perfectly balanced tree of its live apartments,
+   * dropping all tombstones. Runs in O(n) and reuses the live nodes.
+   * Invalidates all iterators.
+   */
+  void rebuild ();
+
+  /**
+   * Moves all the nodes to fresh memory in van Emde Boas order: the top half
+   * of the levels is laid out first, followed by each of the bottom sub trees,
+   * recursively. A descent then touches few cache lines and pages no matter
+   * how the nodes were allocated. Meant to be called after bulk updates.
+   * Runs in O(n log log n). Invalidates all iterators and node pointers.
+   * Does nothing while the tree holds caller owned nodes, which cannot move.
+   */
+  void compact ();
+
+  /**
+   * Walks the whole tree once and collects its shape and memory statistics.
+   * @return tree_stats of this tree
+   */
+  tree_stats stats () const;
+
+  /**
+   * Checks the AVL invariants: the order of the apartments, the cached height
+   * of every node and that every balance factor is -1, 0 or 1.
+   * Runs in O(n) without allocating.
+   * @return true if the tree is a legal AVL tree, false otherwise
+   */
+  bool validate () const;
+
  private:
   node *_root;
+  Pool<node> _pool;
+  mutable FindCache<node> _cache;
+  mutable ApartmentFilter _filter;
+  size_t _tombstones;
+  size_t _external;
+  double _max_tombstone_ratio;
+  OrderingContext _context;
+
+  /**
+   * @param apartment apartment to order
+   * @return the sort key of the apartment in the context of this tree
+   */
+  float key_of (const Apartment &apartment) const;
 
   /**
    * recursive func for create new AVL according other AVL
@@ -503,7 +1273,8 @@ class AVL {
   AVL::node *helper_copy (AVL::node *other);
 
   /**
-   * recursive func that free all nodes of a tree in post order.
+   * recursive func that free all nodes of a tree in post order. caller owned
+   * nodes are only dropped.
    * @param curr_node current node in the tree
    */
   void free_avl (AVL::node *curr);
@@ -512,19 +1283,19 @@ class AVL {
    * recursive func for insertion a new apartment into the tree so that it
    * maintains the legality of the tree.
    * @param apartment apartment to add the tree
+   * @param key sort key of apartment
    * @param curr_node pointer to the current node in tree
    * @return new root of the tree that includes the new apartment
    */
-  AVL::node *helper_insert (const Apartment &apartment, AVL::node *node);
+  AVL::node *helper_insert (const Apartment &apartment, float key,
+                            AVL::node *node);
 
   /**
-   * recursive func for erasing the node of a given apartment
-   * @param apartment apartment to erase from the tree
-   * @param curr_node the current node in the tree
-   * @return new root of the AVL tree after after the node of apartment was
-   * erased
+   * erases a live node of the tree: makes it a tombstone in lazy mode, and
+   * unlinks it otherwise
+   * @param found node to erase
    */
-  node *helper_erase (const Apartment &apartment, AVL::node *curr_node);
+  void erase_found (AVL::node *found);
 
   /**
    * rl rotation
@@ -568,7 +1339,7 @@ class AVL {
   static int get_height_of_node (const AVL::node *curr_node);
 
   /**
-   * update height of a node
+   * update height of a node, and its bounding box (see node::update_box)
    * @param curr_node pointer to node we ant to update its height
    */
   static void update_height (AVL::node *curr_node);
@@ -580,6 +1351,559 @@ class AVL {
    */
   static int get_balance_factor_of_node (const AVL::node *p_node);
 
+  /**
+   * make a node the root of the tree
+   * @param root the new root, may be nullptr
+   */
+  void set_root (AVL::node *root);
+
+  /**
+   * climbs from a node until the apartment falls inside the sub tree of the
+   * node reached, following the insert order (greater goes right)
+   * @param start node to climb from
+   * @param apartment apartment to look for
+   * @param key sort key of apartment
+   * @param context ordering context of the tree
+   * @return the root of the smallest sub tree on the way that holds the
+   * place of the apartment. apartments equal to it may lie outside that
+   * sub tree, so the climb does not stop at them
+   */
+  static AVL::node *climb (AVL::node *start, const Apartment &apartment,
+                           float key, const OrderingContext &context);
+
+  /**
+   * rebalances the tree from a node up to the root, stopping as soon as a
+   * sub tree keeps its height
+   * @param curr_node lowest node whose sub tree was changed
+   */
+  void rebalance_up (AVL::node *curr_node);
+
+  /**
+   * puts new_node in the place of old_node under the parent of old_node (or
+   * as the root)
+   * @param old_node node to replace
+   * @param new_node node to put in its place, may be nullptr
+   */
+  void replace_in_parent (AVL::node *old_node, AVL::node *new_node);
+
+  /**
+   * links a node into the tree without allocating or copying its
+   * apartment. The sort key of the node is set from the context of the
+   * tree.
+   * @param new_node node to link, not linked in any tree
+   * @param hint node of the tree to start the search from (see climb), or
+   * nullptr to start from the root
+   */
+  void link (AVL::node *new_node, AVL::node *hint);
+
+  /**
+   * unlinks a live node from the tree without freeing it, and rebalances
+   * upward from where it was. In the two children case the successor node
+   * is moved into its place, so no apartment is copied and every other node
+   * keeps its apartment.
+   * @param curr_node node to unlink
+   */
+  void unlink (AVL::node *curr_node);
+
+  /**
+   * recursive func that collects the live nodes of a sub tree in order and
+   * frees its tombstones (caller owned ones are only unlinked)
+   * @param curr_node the current node in the tree
+   * @param nodes vector to append the live nodes to
+   */
+  void helper_collect_live (AVL::node *curr_node,
+                            std::vector<AVL::node *> &nodes);
+
+  /**
+   * recursive func that links sorted nodes into a perfectly balanced tree
+   * @param nodes sorted nodes
+   * @param begin index of the first node of the sub tree
+   * @param end index past the last node of the sub tree
+   * @return root of the sub tree
+   */
+  static AVL::node *helper_build (const std::vector<AVL::node *> &nodes,
+                                  size_t begin, size_t end);
+
+  /**
+   * recursive func that lists the top levels of a sub tree in van Emde Boas
+   * order
+   * @param curr_node root of the sub tree
+   * @param levels number of levels of the sub tree to list
+   * @param order vector to append the nodes to
+   */
+  static void helper_veb_order (AVL::node *curr_node, int levels,
+                                std::vector<AVL::node *> &order);
+
+  /**
+   * recursive func that lists the nodes at a given depth of a sub tree
+   * @param curr_node root of the sub tree
+   * @param depth depth of the wanted nodes below curr_node
+   * @param nodes vector to append the nodes to
+   */
+  static void helper_nodes_at_depth (AVL::node *curr_node, int depth,
+                                     std::vector<AVL::node *> &nodes);
+
+  /**
+   * recursive func that accumulates the statistics of a sub tree
+   * @param curr_node the current node in the tree
+   * @param depth search depth of curr_node
+   * @param stats statistics to accumulate into
+   * @param depth_sum sum of the search depths seen so far
+   * @param low lowest node address seen so far
+   * @param high highest node address seen so far
+   */
+  static void helper_stats (const AVL::node *curr_node, int depth,
+                            tree_stats &stats, size_t &depth_sum,
+                            uintptr_t &low, uintptr_t &high);
+
+  /**
+   * recursive func that checks the AVL invariants of a sub tree
+   * @param curr_node the current node in the tree
+   * @param low apartment that bounds the sub tree from below (or nullptr)
+   * @param high apartment that bounds the sub tree from above (or nullptr)
+   * @param context ordering context of the tree
+   * @return the real height of the sub tree, or HEIGHT_INVALID_TREE if an
+   * invariant is broken
+   */
+  static int helper_validate (const AVL::node *curr_node,
+                              const Apartment *low, const Apartment *high,
+                              const OrderingContext &context);
+
+  /**
+   * recursive func that visits a sub tree in order
+   * @param curr_node the current node in the tree
+   * @param f function to call on every live apartment
+   */
+  template<class Function>
+  static void helper_in_order (const AVL::node *curr_node, Function &f);
+
+  /**
+   * recursive func that describes the changes of a sub tree in order (see
+   * collect_changes) and clears its dirty flags
+   * @param curr_node the current node in the tree
+   * @param on_apartment function to call on every live apartment of a
+   * dirty node
+   * @param on_unchanged function to call on every clean sub tree
+   */
+  template<class ApartmentFunction, class RangeFunction>
+  static void helper_changes (AVL::node *curr_node,
+                              ApartmentFunction &on_apartment,
+                              RangeFunction &on_unchanged);
+
+  /**
+   * @param curr_node root of a sub tree
+   * @param leftmost true for the first live node, false for the last
+   * @return the first or the last live node of the sub tree in order, or
+   * nullptr if it holds only tombstones
+   */
+  static const AVL::node *edge_live (const AVL::node *curr_node,
+                                     bool leftmost);
+
+  /**
+   * @param curr_node root of a sub tree
+   * @param leftmost true to count at the start of the sub tree, false at
+   * the end
+   * @return number of live apartments at that end of the sub tree, in
+   * order, with the coordinates of the first or the last live apartment
+   */
+  static size_t edge_copies (const AVL::node *curr_node, bool leftmost);
+
+  /**
+   * recursive func that visits the apartments of a sub tree in a key
+   * range, in order. The float keys are only used to prune sub trees.
+   * @param curr_node the current node in the tree
+   * @param low_key float key of low
+   * @param high_key float key of high
+   * @param low smallest key to visit
+   * @param high largest key to visit
+   * @param context ordering context of the tree
+   * @param f function to call on every live apartment in the range
+   */
+  template<class Function>
+  static void helper_in_range (const AVL::node *curr_node, float low_key,
+                               float high_key, double low, double high,
+                               const OrderingContext &context, Function &f);
+
+  /**
+   * A rectangle to visit, with a range of keys that holds it: the ring
+   * around the reference point, or one interval of Morton keys
+   */
+  struct rect_query {
+      float low_key, high_key;
+      double low, high;
+      double min_x, min_y, max_x, max_y;
+  };
+
+  /**
+   * recursive func that visits the apartments of a sub tree in a
+   * rectangle and in its range of keys, in order. The float keys prune
+   * the sub trees, and the exact keys settle the nodes whose float key
+   * ties with a bound, as Morton keys often do. The bounding boxes, if
+   * there are any, prune as well.
+   * @param curr_node the current node in the tree
+   * @param rect rectangle to visit
+   * @param context ordering context of the tree
+   * @param f function to call on every live apartment in the rectangle
+   */
+  template<class Function>
+  static void helper_in_rect (const AVL::node *curr_node,
+                              const rect_query &rect,
+                              const OrderingContext &context, Function &f);
 };
 
+/**
+ * Inserts a range of apartments, or of pairs of coordinates. When the size
+ * of the range is known the nodes are allocated up front. The tree ends up
+ * the same as after inserting the items one by one.
+ * @param first iterator to the first item
+ * @param last iterator past the last item
+ */
+template<class InputIt>
+void AVL::insert_range (InputIt first, InputIt last)
+{
+  typedef typename std::iterator_traits<InputIt>::iterator_category category;
+  if (std::is_base_of<std::forward_iterator_tag, category>::value)
+    {
+      _pool.reserve (std::distance (first, last));
+    }
+  for (; first != last; ++first)
+    {
+      insert (end (), Apartment (*first));
+    }
+}
+
+/**
+ * Calls f on every apartment of the tree in order, closest first.
+ * Tombstones are skipped.
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void AVL::for_each_in_order (Function f) const
+{
+  helper_in_order (_root, f);
+}
+
+/**
+ * Calls f in order on every apartment whose distance from the reference
+ * point of the tree is in [low, high]. Sub trees outside the range are not
+ * visited, so it costs O(log n + k) for k apartments in the range.
+ * Tombstones are skipped. Only for a tree in the distance order.
+ * @param low smallest distance to visit
+ * @param high largest distance to visit
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void AVL::for_each_in_range (double low, double high, Function f) const
+{
+  if (high < 0)
+    {
+      return;
+    }
+  double low_key = OrderingContext::key_of_distance (low);
+  double high_key = OrderingContext::key_of_distance (high);
+  helper_in_range (_root, (float) low_key, (float) high_key, low_key,
+                   high_key, _context, f);
+}
+
+/**
+ * Calls f in order on every apartment in the rectangle [min_x, max_x] x
+ * [min_y, max_y], like a map viewport. In the distance order, the
+ * apartments of the rectangle lie between the distance of its nearest
+ * point and of its farthest corner from the reference point of the tree,
+ * so only the sub trees in that ring are visited, as in
+ * for_each_in_range (). In Z order (OrderingContext::morton ()), the
+ * rectangle is covered by intervals of keys and only those are visited,
+ * so a map tile is read as a few runs of neighbouring nodes. Built with
+ * AVL_BOUNDING_BOXES, the sub trees whose bounding box misses the
+ * rectangle are skipped as well.
+ * Tombstones are skipped.
+ * @param min_x smallest x coordinate to visit
+ * @param min_y smallest y coordinate to visit
+ * @param max_x largest x coordinate to visit
+ * @param max_y largest y coordinate to visit
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void AVL::query_rect (double min_x, double min_y, double max_x, double max_y,
+                      Function f) const
+{
+  if (min_x > max_x || min_y > max_y)
+    {
+      return;
+    }
+  if (_context.is_morton ())
+    {
+      for (const auto &interval : OrderingContext::morton_intervals (
+          min_x, min_y, max_x, max_y))
+        {
+          rect_query rect = {(float) interval.first, (float) interval.second,
+                             interval.first, interval.second,
+                             min_x, min_y, max_x, max_y};
+          helper_in_rect (_root, rect, _context, f);
+        }
+      return;
+    }
+  double x = _context.get_x ();
+  double y = _context.get_y ();
+  // the nearest point of the rectangle and its farthest corner
+  double low = _context.key_of_point (std::max (min_x, std::min (x, max_x)),
+                                      std::max (min_y, std::min (y, max_y)));
+  double high = _context.key_of_point (
+      (x - min_x > max_x - x) ? min_x : max_x,
+      (y - min_y > max_y - y) ? min_y : max_y);
+  rect_query rect = {(float) low, (float) high, low, high,
+                     min_x, min_y, max_x, max_y};
+  helper_in_rect (_root, rect, _context, f);
+}
+
+/**
+ * Calls f on every apartment of the tree, in parallel on the threads of
+ * the shared WorkStealingPool. Whole sub trees go to the threads, so the
+ * apartments are not visited in order and f is called concurrently; it
+ * must be safe for that and must not throw. The tree must not change
+ * meanwhile.
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void AVL::parallel_for_each (Function f) const
+{
+  parallel_for_each (WorkStealingPool::shared (), f);
+}
+
+/**
+ * Calls f on every apartment of the tree, in parallel on the threads of
+ * pool. See parallel_for_each (Function).
+ * @param pool pool of threads to use
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void AVL::parallel_for_each (WorkStealingPool &pool, Function f) const
+{
+  pool.for_each_range (whole_range (), [&f] (const Range &piece)
+  {
+    piece.for_each (f);
+  });
+}
+
+/**
+ * Maps every apartment of the tree to a value and combines the values, in
+ * parallel on the threads of the shared WorkStealingPool, like
+ * std::transform_reduce. Every piece of the tree is reduced on its own
+ * thread starting from init, and the pieces are then combined in no
+ * particular order, so init must be an identity of combine, and combine
+ * must be associative and commutative. map and combine must not throw.
+ * @param init identity value of combine
+ * @param map function from const Apartment & to T
+ * @param combine function from two T to T
+ * @return the combined value, init for an empty tree
+ */
+template<class T, class Map, class Combine>
+T AVL::parallel_reduce (T init, Map map, Combine combine) const
+{
+  return parallel_reduce (WorkStealingPool::shared (), init, map, combine);
+}
+
+/**
+ * Maps and combines every apartment of the tree in parallel on the threads
+ * of pool. See parallel_reduce (T, Map, Combine).
+ * @param pool pool of threads to use
+ * @param init identity value of combine
+ * @param map function from const Apartment & to T
+ * @param combine function from two T to T
+ * @return the combined value, init for an empty tree
+ */
+template<class T, class Map, class Combine>
+T AVL::parallel_reduce (WorkStealingPool &pool, T init, Map map,
+                        Combine combine) const
+{
+  T result = init;
+  std::mutex result_lock;
+  pool.for_each_range (whole_range (), [&] (const Range &piece)
+  {
+    T partial = init;
+    piece.for_each ([&partial, &map, &combine] (const Apartment &apartment)
+                    {
+                      partial = combine (partial, map (apartment));
+                    });
+    std::lock_guard<std::mutex> lock (result_lock);
+    result = combine (result, partial);
+  });
+  return result;
+}
+
+/**
+ * Describes the tree in order as the changes since the last call, for
+ * incremental checkpoints, and marks the whole tree unchanged. Every live
+ * apartment of a dirty node is passed to on_apartment, and every largest
+ * clean sub tree is passed to on_unchanged as its first and last live
+ * apartment, each with the number of copies of it (apartments with the
+ * same coordinates) at that end of the sub tree. The copies tell which of
+ * several identical apartments the run starts and ends with. Such a sub
+ * tree holds exactly the apartments that were between those two at the
+ * last call. Only dirty nodes are visited, so it costs O(c log n) for c
+ * changed nodes (plus the copies at the ends of the runs) rather than
+ * O(n). A new tree, and a tree after rebuild (), insert_batch () or a
+ * copy, is all dirty.
+ * @param on_apartment function that gets a const Apartment &
+ * @param on_unchanged function that gets the first apartment of an
+ * unchanged run, its number of copies at the start of the run, the last
+ * apartment and its number of copies at the end of the run, as
+ * (const Apartment &, size_t, const Apartment &, size_t)
+ */
+template<class ApartmentFunction, class RangeFunction>
+void AVL::collect_changes (ApartmentFunction on_apartment,
+                           RangeFunction on_unchanged)
+{
+  helper_changes (_root, on_apartment, on_unchanged);
+}
+
+/**
+ * recursive func that describes the changes of a sub tree in order (see
+ * collect_changes) and clears its dirty flags
+ * @param curr_node the current node in the tree
+ * @param on_apartment function to call on every live apartment of a
+ * dirty node
+ * @param on_unchanged function to call on every clean sub tree
+ */
+template<class ApartmentFunction, class RangeFunction>
+void AVL::helper_changes (AVL::node *curr_node,
+                          ApartmentFunction &on_apartment,
+                          RangeFunction &on_unchanged)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+  if (!curr_node->is_dirty ())
+    {
+      const AVL::node *first = edge_live (curr_node, true);
+      if (first != nullptr)
+        {
+          on_unchanged (first->get_data (), edge_copies (curr_node, true),
+                        edge_live (curr_node, false)->get_data (),
+                        edge_copies (curr_node, false));
+        }
+      return;
+    }
+  helper_changes (curr_node->get_left (), on_apartment, on_unchanged);
+  if (!curr_node->is_dead ())
+    {
+      on_apartment (curr_node->get_data ());
+    }
+  curr_node->dirty_ = false;
+  helper_changes (curr_node->get_right (), on_apartment, on_unchanged);
+}
+
+/**
+ * recursive func that visits a sub tree in order
+ * @param curr_node the current node in the tree
+ * @param f function to call on every live apartment
+ */
+template<class Function>
+void AVL::helper_in_order (const AVL::node *curr_node, Function &f)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+  helper_in_order (curr_node->get_left (), f);
+  if (!curr_node->is_dead ())
+    {
+      f (curr_node->get_data ());
+    }
+  helper_in_order (curr_node->get_right (), f);
+}
+
+/**
+ * recursive func that visits the apartments of a sub tree in a key
+ * range, in order. The float keys are only used to prune sub trees.
+ * @param curr_node the current node in the tree
+ * @param low_key float key of low
+ * @param high_key float key of high
+ * @param low smallest key to visit
+ * @param high largest key to visit
+ * @param context ordering context of the tree
+ * @param f function to call on every live apartment in the range
+ */
+template<class Function>
+void AVL::helper_in_range (const AVL::node *curr_node, float low_key,
+                           float high_key, double low, double high,
+                           const OrderingContext &context, Function &f)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+  // a key below low_key means the node and its left sub tree are closer
+  // than low, a key above high_key means they are farther than high
+  if (!(curr_node->get_key () < low_key))
+    {
+      helper_in_range (curr_node->get_left (), low_key, high_key, low, high,
+                       context, f);
+    }
+  if (!curr_node->is_dead ())
+    {
+      double key = context.key (curr_node->get_data ());
+      if (key >= low && key <= high)
+        {
+          f (curr_node->get_data ());
+        }
+    }
+  if (!(curr_node->get_key () > high_key))
+    {
+      helper_in_range (curr_node->get_right (), low_key, high_key, low, high,
+                       context, f);
+    }
+}
+
+/**
+ * recursive func that visits the apartments of a sub tree in a
+ * rectangle and in its range of keys, in order. The float keys prune
+ * the sub trees, and the exact keys settle the nodes whose float key
+ * ties with a bound, as Morton keys often do. The bounding boxes, if
+ * there are any, prune as well.
+ * @param curr_node the current node in the tree
+ * @param rect rectangle to visit
+ * @param context ordering context of the tree
+ * @param f function to call on every live apartment in the rectangle
+ */
+template<class Function>
+void AVL::helper_in_rect (const AVL::node *curr_node,
+                          const rect_query &rect,
+                          const OrderingContext &context, Function &f)
+{
+  if (curr_node == nullptr) // base case
+    {
+      return;
+    }
+#ifdef AVL_BOUNDING_BOXES
+  if (!curr_node->box_meets (rect.min_x, rect.min_y, rect.max_x, rect.max_y))
+    {
+      return;
+    }
+#endif
+  const Apartment &apartment = curr_node->get_data ();
+  float key = curr_node->get_key ();
+  double exact = (key == rect.low_key || key == rect.high_key)
+                 ? context.key (apartment) : 0;
+  bool below = key < rect.low_key
+               || (key == rect.low_key && exact < rect.low);
+  bool above = key > rect.high_key
+               || (key == rect.high_key && exact > rect.high);
+  if (!below)
+    {
+      helper_in_rect (curr_node->get_left (), rect, context, f);
+    }
+  if (!below && !above && !curr_node->is_dead ()
+      && apartment.get_x () >= rect.min_x && apartment.get_x () <= rect.max_x
+      && apartment.get_y () >= rect.min_y && apartment.get_y () <= rect.max_y)
+    {
+      f (apartment);
+    }
+  if (!above)
+    {
+      helper_in_rect (curr_node->get_right (), rect, context, f);
+    }
+}
+
 #endif //_AVL_H_
@@ -8,8 +8,13 @@
  */
 Apartment::Apartment (const std::pair<double, double> &Coordinates)
 {
+#ifdef APARTMENT_FIXED_POINT
+  _x = to_fixed (Coordinates.first);
+  _y = to_fixed (Coordinates.second);
+#else
   _x = Coordinates.first;
   _y = Coordinates.second;
+#endif
 }
 
 /**
@@ -17,7 +22,11 @@ Apartment::Apartment (const std::pair<double, double> &Coordinates)
  */
 double Apartment::get_x () const
 {
+#ifdef APARTMENT_FIXED_POINT
+  return (double) _x / FIXED_POINT_SCALE;
+#else
   return _x;
+#endif
 }
 
 /**
@@ -25,34 +34,57 @@ double Apartment::get_x () const
  */
 double Apartment::get_y () const
 {
+#ifdef APARTMENT_FIXED_POINT
+  return (double) _y / FIXED_POINT_SCALE;
+#else
   return _y;
+#endif
+}
+
+/**
+ * @return the distance of the apartment from [35.213506, 31.772425]
+ */
+double Apartment::get_distance () const
+{
+#ifdef APARTMENT_FIXED_POINT
+  return std::sqrt ((double) get_fixed_key ()) / FIXED_POINT_SCALE;
+#else
+  return get_distance_from_feelbox (_x, _y);
+#endif
 }
 
 /**
  * Operator <, apartment is smaller than other if it closer to
- * [35.213506, 31.772425]
+ * [35.213506, 31.772425], or at the same distance and before it by x,
+ * then by y
  * @param other Apartment obj
  * @return true, if this apartment is smaller than the other one,
  * false otherwise
  */
 bool Apartment::operator< (const Apartment &other) const
 {
-  return (get_distance_from_feelbox (_x, _y)
-          < get_distance_from_feelbox (other._x, other._y));
-
+#ifdef APARTMENT_FIXED_POINT
+  int64_t key = get_fixed_key (), other_key = other.get_fixed_key ();
+#else
+  double key = get_distance_from_feelbox (_x, _y);
+  double other_key = get_distance_from_feelbox (other._x, other._y);
+#endif
+  return key < other_key
+         || (key == other_key
+             && (_x < other._x || (_x == other._x && _y < other._y)));
 }
 
 /**
  * Operator >, apartment is greater than other if it farther from
- * [35.213506, 31.772425]
+ * [35.213506, 31.772425], or at the same distance and after it by x,
+ * then by y
  * @param other Apartment obj
  * @return true, if this apartment is greater than the other one,
  * false otherwise
  */
 bool Apartment::operator> (const Apartment &other) const
 {
-  return (get_distance_from_feelbox (_x, _y)
-          > get_distance_from_feelbox (other._x, other._y));
+  return other < *this;
 }
 
 /**
@@ -77,8 +109,14 @@ double Apartment::get_distance_from_feelbox (double point_x, double point_y)
  */
 bool Apartment::operator== (const Apartment &other) const
 {
+#ifdef APARTMENT_FIXED_POINT
+  // both compares are made, without a branch between them
+  return ((std::abs ((int64_t) _x - other._x) <= FIXED_EPSILON) &
+          (std::abs ((int64_t) _y - other._y) <= FIXED_EPSILON));
+#else
   return ((std::abs (_x - other._x) <= EPSILON) &&
           (std::abs (_y - other._y) <= EPSILON));
+#endif
 
 }
 
@@ -90,7 +128,7 @@ bool Apartment::operator== (const Apartment &other) const
  */
 std::ostream &operator<< (std::ostream &os, const Apartment &apartment)
 {
-  os << LEFT_PARENTHESIS << apartment._x << COMMA << apartment._y
+  os << LEFT_PARENTHESIS << apartment.get_x () << COMMA << apartment.get_y ()
      << RIGHT_PARENTHESIS << std::endl;
   return os;
 }
@@ -7,17 +7,37 @@
 #define COMMA ","
 #define LEFT_PARENTHESIS "("
 #define RIGHT_PARENTHESIS ")"
+#define FIXED_POINT_SCALE 1000000
+#define FIXED_EPSILON 100
+// feelbox in micro-degrees, rounded to the nearest (its coordinates are
+// positive)
+#define X_FEEL_BOX_FIXED ((int64_t) (X_FEEL_BOX * FIXED_POINT_SCALE + 0.5))
+#define Y_FEEL_BOX_FIXED ((int64_t) (Y_FEEL_BOX * FIXED_POINT_SCALE + 0.5))
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 
 /**
  * this class represents an apartment
+ * Built with APARTMENT_FIXED_POINT, the coordinates are stored as int32
+ * micro-degrees (1 / FIXED_POINT_SCALE of a degree, rounded), which halves
+ * the apartment to 8 bytes. The apartments are then compared by their int64
+ * squared distance from feelbox, without a square root, and operator== is
+ * an exact integer compare with the same tolerance of EPSILON
+ * (FIXED_EPSILON micro-degrees).
+ * In both modes, operator< and operator> order apartments at the same
+ * distance by their coordinates (x first), so sorting and searching by them
+ * is a total order. Integer distances tie often.
  */
 class Apartment {
   /**
    * X and y coordinates of the apartment.
    */
+#ifdef APARTMENT_FIXED_POINT
+  int32_t _x, _y;
+#else
   double _x, _y;
+#endif
  public:
   /**
    * Constructor that get pair of points, and creates new apartment.
@@ -36,9 +56,53 @@ class Apartment {
    */
   double get_y () const;
 
+#ifdef APARTMENT_FIXED_POINT
+  /**
+   * @return the x coordinate of the apartment in micro-degrees
+   */
+  int32_t get_fixed_x () const
+  {
+    return _x;
+  }
+
+  /**
+   * @return the y coordinate of the apartment in micro-degrees
+   */
+  int32_t get_fixed_y () const
+  {
+    return _y;
+  }
+
+  /**
+   * @param coordinate coordinate in degrees
+   * @return the coordinate in micro-degrees, rounded to the nearest
+   */
+  static int32_t to_fixed (double coordinate)
+  {
+    return (int32_t) std::lround (coordinate * FIXED_POINT_SCALE);
+  }
+
+  /**
+   * @return the squared distance of the apartment from feelbox, in square
+   * micro-degrees
+   */
+  int64_t get_fixed_key () const
+  {
+    int64_t x = (int64_t) _x - X_FEEL_BOX_FIXED;
+    int64_t y = (int64_t) _y - Y_FEEL_BOX_FIXED;
+    return x * x + y * y;
+  }
+#endif
+
+  /**
+   * @return the distance of the apartment from [35.213506, 31.772425]
+   */
+  double get_distance () const;
+
   /**
    * Operator <, apartment is smaller than other if it closer to
-   * [35.213506, 31.772425]
+   * [35.213506, 31.772425], or at the same distance and before it by x,
+   * then by y
    * @param other Apartment obj
    * @return true, if this apartment is smaller than the other one,
    * false otherwise
@@ -47,7 +111,8 @@ class Apartment {
 
   /**
    * Operator >, apartment is greater than other if it farther from
-   * [35.213506, 31.772425]
+   * [35.213506, 31.772425], or at the same distance and after it by x,
+   * then by y
    * @param other Apartment obj
    * @return true, if this apartment is greater than the other one,
    * false otherwise
@@ -0,0 +1,565 @@
+#include "ApartmentBTree.h"
+#include "OrderingContext.h"
+#include <cstring>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SIMD_WIDTH 4
+
+/**
+ * Constructor. Constructs an empty node
+ * @param is_leaf true if the node has no children
+ */
+ApartmentBTree::node::node (bool is_leaf) : count (0), leaf (is_leaf)
+{
+  for (int i = 0; i < BTREE_KEY_SLOTS; i++)
+    {
+      keys[i] = std::numeric_limits<float>::infinity ();
+      children[i] = nullptr;
+    }
+}
+
+/**
+ * Constructor. Constructs an empty tree
+ */
+ApartmentBTree::ApartmentBTree () : _root (nullptr), _size (0)
+{}
+
+/**
+ * Copy constructor
+ * @param other other tree to copy
+ */
+ApartmentBTree::ApartmentBTree (const ApartmentBTree &other)
+    : ApartmentBTree ()
+{
+  *this = other;
+}
+
+/**
+ * A constructor that receives a vector of pairs. Each such pair is an
+ * apartment that will inserted to the tree.
+ * @param coordinates vector of pairs
+ */
+ApartmentBTree::ApartmentBTree (
+    const std::vector<std::pair<double, double>> &coordinates)
+    : ApartmentBTree ()
+{
+  for (const auto &x : coordinates)
+    {
+      insert (Apartment (x));
+    }
+}
+
+/**
+ * destructor, the nodes are released together with the pool
+ */
+ApartmentBTree::~ApartmentBTree ()
+{}
+
+/**
+ * Assignment operator - copies the contents of another tree to this
+ * @param rhs tree to copy values from
+ * @return reference to this tree
+ */
+ApartmentBTree &ApartmentBTree::operator= (const ApartmentBTree &rhs)
+{
+  if (this != &rhs)
+    {
+      Pool<node> old_pool;
+      _pool.swap (old_pool);
+      _root = helper_copy (rhs._root);
+      _size = rhs._size;
+    }
+  return *this;
+}
+
+/**
+ * recursive func for copying a sub tree into this tree's pool
+ * @param other root of the sub tree to copy
+ * @return root of the copy
+ */
+ApartmentBTree::node *ApartmentBTree::helper_copy (const node *other)
+{
+  if (other == nullptr) // base case
+    {
+      return nullptr;
+    }
+  node *copy = _pool.create (*other);
+  if (!other->leaf)
+    {
+      for (int i = 0; i <= other->count; i++)
+        {
+          copy->children[i] = helper_copy (other->children[i]);
+        }
+    }
+  return copy;
+}
+
+/**
+ * @return number of apartments in the tree
+ */
+size_t ApartmentBTree::size () const
+{
+  return _size;
+}
+
+/**
+ * The order of the tree: by the distance from feelbox, and apartments at
+ * the same distance by their coordinates, like OrderingContext::less.
+ * Apartment::operator< alone leaves ties, and a symmetric grid around
+ * feelbox has many of them
+ * @param lhs apartment to compare
+ * @param rhs apartment to compare
+ * @return true if lhs comes before rhs in the tree
+ */
+static bool ordered_before (const Apartment &lhs, const Apartment &rhs)
+{
+  static const OrderingContext feelbox;
+  return feelbox.less (lhs, rhs);
+}
+
+/**
+ * @param curr_node node to search in
+ * @param apartment apartment to look for
+ * @param key float distance of apartment
+ * @return index of the first apartment in curr_node that is not smaller
+ * than apartment
+ */
+int ApartmentBTree::position (const node *curr_node,
+                              const Apartment &apartment, float key)
+{
+  // count the keys that are smaller than key. the unused slots are infinity
+  // so they are never counted
+  int i = 0;
+#ifdef __SSE2__
+  __m128 query = _mm_set1_ps (key);
+  for (int j = 0; j < BTREE_KEY_SLOTS; j += SIMD_WIDTH)
+    {
+      __m128 keys = _mm_loadu_ps (curr_node->keys + j);
+      i += __builtin_popcount (_mm_movemask_ps (_mm_cmplt_ps (keys, query)));
+    }
+#else
+  while (i < curr_node->count && curr_node->keys[i] < key)
+    {
+      i++;
+    }
+#endif
+
+  // equal keys are ordered by the exact distance, then by coordinates
+  while (i < curr_node->count && curr_node->keys[i] == key
+         && ordered_before (curr_node->value (i), apartment))
+    {
+      i++;
+    }
+  return i;
+}
+
+/**
+ * Inserts the apartment into the tree
+ * @param apartment Apartment object to add to tree
+ */
+void ApartmentBTree::insert (const Apartment &apartment)
+{
+  float key = (float) apartment.get_distance ();
+  if (_root == nullptr)
+    {
+      _root = _pool.create (true);
+    }
+
+  // split full nodes on the way down, so there is always room to insert
+  if (_root->count == BTREE_MAX_KEYS)
+    {
+      node *new_root = _pool.create (false);
+      new_root->children[0] = _root;
+      _root = new_root;
+      split_child (_root, 0);
+    }
+
+  node *curr_node = _root;
+  while (!curr_node->leaf)
+    {
+      int i = position (curr_node, apartment, key);
+      if (curr_node->children[i]->count == BTREE_MAX_KEYS)
+        {
+          split_child (curr_node, i);
+          if (i < curr_node->count
+              && ordered_before (curr_node->value (i), apartment))
+            {
+              i++;
+            }
+        }
+      curr_node = curr_node->children[i];
+    }
+
+  insert_at (curr_node, position (curr_node, apartment, key), apartment, key,
+             nullptr);
+  _size++;
+}
+
+/**
+ * places an apartment at index i of a node, shifting the apartments and
+ * the children after it one index to the right
+ */
+void ApartmentBTree::insert_at (node *curr_node, int i,
+                                const Apartment &apartment, float key,
+                                node *right_child)
+{
+  int count = curr_node->count;
+  std::memmove (&curr_node->keys[i + 1], &curr_node->keys[i],
+                (count - i) * sizeof (float));
+  std::memmove (&curr_node->value (i + 1), &curr_node->value (i),
+                (count - i) * sizeof (Apartment));
+  std::memmove (&curr_node->children[i + 2], &curr_node->children[i + 1],
+                (count - i) * sizeof (node *));
+  curr_node->keys[i] = key;
+  new (&curr_node->value (i)) Apartment (apartment);
+  curr_node->children[i + 1] = right_child;
+  curr_node->count++;
+}
+
+/**
+ * removes the apartment at index i of a node together with the child to
+ * its right, shifting the rest one index to the left
+ */
+void ApartmentBTree::remove_at (node *curr_node, int i)
+{
+  int count = curr_node->count;
+  std::memmove (&curr_node->keys[i], &curr_node->keys[i + 1],
+                (count - i - 1) * sizeof (float));
+  std::memmove (&curr_node->value (i), &curr_node->value (i + 1),
+                (count - i - 1) * sizeof (Apartment));
+  std::memmove (&curr_node->children[i + 1], &curr_node->children[i + 2],
+                (count - i - 1) * sizeof (node *));
+  curr_node->count--;
+  curr_node->keys[curr_node->count] = std::numeric_limits<float>::infinity ();
+  curr_node->children[curr_node->count + 1] = nullptr;
+}
+
+/**
+ * splits the full child i of parent into two nodes, moving its middle
+ * apartment up to parent
+ */
+void ApartmentBTree::split_child (node *parent, int i)
+{
+  node *full = parent->children[i];
+  node *right = _pool.create (full->leaf);
+  const int mid = BTREE_MIN_DEGREE - 1;
+
+  // the right half goes to the new node
+  right->count = BTREE_MAX_KEYS - mid - 1;
+  std::memcpy (right->keys, &full->keys[mid + 1],
+               right->count * sizeof (float));
+  std::memcpy (&right->value (0), &full->value (mid + 1),
+               right->count * sizeof (Apartment));
+  if (!full->leaf)
+    {
+      std::memcpy (right->children, &full->children[mid + 1],
+                   (right->count + 1) * sizeof (node *));
+    }
+
+  insert_at (parent, i, full->value (mid), full->keys[mid], right);
+
+  full->count = mid;
+  for (int j = mid; j < BTREE_KEY_SLOTS; j++)
+    {
+      full->keys[j] = std::numeric_limits<float>::infinity ();
+    }
+  for (int j = mid + 1; j < BTREE_KEY_SLOTS; j++)
+    {
+      full->children[j] = nullptr;
+    }
+}
+
+/**
+ * merges child i + 1 of parent and apartment i of parent into child i
+ */
+void ApartmentBTree::merge_children (node *parent, int i)
+{
+  node *left = parent->children[i];
+  node *right = parent->children[i + 1];
+
+  int count = left->count;
+  left->keys[count] = parent->keys[i];
+  new (&left->value (count)) Apartment (parent->value (i));
+  std::memcpy (&left->keys[count + 1], right->keys,
+               right->count * sizeof (float));
+  std::memcpy (&left->value (count + 1), &right->value (0),
+               right->count * sizeof (Apartment));
+  if (!left->leaf)
+    {
+      std::memcpy (&left->children[count + 1], right->children,
+                   (right->count + 1) * sizeof (node *));
+    }
+  left->count += right->count + 1;
+
+  remove_at (parent, i);
+  _pool.destroy (right);
+}
+
+/**
+ * makes sure child i of parent has at least BTREE_MIN_DEGREE apartments,
+ * by borrowing from a sibling or merging with it
+ * @return index of the child that now holds the range of child i
+ */
+int ApartmentBTree::fill_child (node *parent, int i)
+{
+  node *child = parent->children[i];
+  if (child->count >= BTREE_MIN_DEGREE)
+    {
+      return i;
+    }
+
+  if (i > 0 && parent->children[i - 1]->count >= BTREE_MIN_DEGREE)
+    {
+      // borrow through the parent from the left sibling
+      node *left = parent->children[i - 1];
+      insert_at (child, 0, parent->value (i - 1), parent->keys[i - 1],
+                 child->children[0]);
+      child->children[0] = left->children[left->count];
+      int last = left->count - 1;
+      parent->keys[i - 1] = left->keys[last];
+      parent->value (i - 1) = left->value (last);
+      left->children[left->count] = nullptr;
+      left->keys[last] = std::numeric_limits<float>::infinity ();
+      left->count--;
+      return i;
+    }
+
+  if (i < parent->count
+      && parent->children[i + 1]->count >= BTREE_MIN_DEGREE)
+    {
+      // borrow through the parent from the right sibling
+      node *right = parent->children[i + 1];
+      child->keys[child->count] = parent->keys[i];
+      new (&child->value (child->count)) Apartment (parent->value (i));
+      child->children[child->count + 1] = right->children[0];
+      child->count++;
+      parent->keys[i] = right->keys[0];
+      parent->value (i) = right->value (0);
+      // remove_at drops the child to the right of the index, so move the
+      // first child out of the way first
+      right->children[0] = right->children[1];
+      remove_at (right, 0);
+      return i;
+    }
+
+  if (i < parent->count)
+    {
+      merge_children (parent, i);
+      return i;
+    }
+  merge_children (parent, i - 1);
+  return i - 1;
+}
+
+/**
+ * recursive func for erasing an apartment from a sub tree whose root has
+ * at least BTREE_MIN_DEGREE apartments (or is the root of the tree)
+ * @return true if the apartment was erased
+ */
+bool ApartmentBTree::helper_erase (node *curr_node,
+                                   const Apartment &apartment, float key)
+{
+  // only the apartment itself, not a neighbour less than EPSILON from it
+  int i = position (curr_node, apartment, key);
+  bool here = (i < curr_node->count
+               && OrderingContext::same_coordinates (curr_node->value (i),
+                                                     apartment));
+
+  if (curr_node->leaf)
+    {
+      if (here)
+        {
+          remove_at (curr_node, i);
+        }
+      return here;
+    }
+
+  if (!here)
+    {
+      int child = fill_child (curr_node, i);
+      return helper_erase (curr_node->children[child], apartment, key);
+    }
+
+  node *left = curr_node->children[i];
+  node *right = curr_node->children[i + 1];
+  if (left->count >= BTREE_MIN_DEGREE)
+    {
+      // replace with the predecessor and erase it from the left child
+      node *pred = left;
+      while (!pred->leaf)
+        {
+          pred = pred->children[pred->count];
+        }
+      Apartment replacement = pred->value (pred->count - 1);
+      float replacement_key = pred->keys[pred->count - 1];
+      curr_node->value (i) = replacement;
+      curr_node->keys[i] = replacement_key;
+      return helper_erase (left, replacement, replacement_key);
+    }
+  if (right->count >= BTREE_MIN_DEGREE)
+    {
+      // replace with the successor and erase it from the right child
+      node *succ = right;
+      while (!succ->leaf)
+        {
+          succ = succ->children[0];
+        }
+      Apartment replacement = succ->value (0);
+      float replacement_key = succ->keys[0];
+      curr_node->value (i) = replacement;
+      curr_node->keys[i] = replacement_key;
+      return helper_erase (right, replacement, replacement_key);
+    }
+
+  // both children are minimal, merge them around the apartment
+  merge_children (curr_node, i);
+  return helper_erase (left, apartment, key);
+}
+
+/**
+ * Deletes the apartment from the tree (if it is in that tree)
+ * @param apartment Apartment object to erase from the tree
+ */
+void ApartmentBTree::erase (const Apartment &apartment)
+{
+  if (_root == nullptr)
+    {
+      return;
+    }
+  if (helper_erase (_root, apartment, (float) apartment.get_distance ()))
+    {
+      _size--;
+    }
+
+  // the root lost its last apartment in a merge, its only child replaces it
+  if (_root->count == 0)
+    {
+      node *old_root = _root;
+      _root = _root->leaf ? nullptr : _root->children[0];
+      _pool.destroy (old_root);
+    }
+}
+
+/**
+ * descends to the apartment and records the path to it
+ * @param data apartment to search
+ * @param path vector to fill with the path, left empty if not found
+ */
+void ApartmentBTree::helper_find (const Apartment &data,
+                                  std::vector<std::pair<node *, int>> &path)
+const
+{
+  float key = (float) data.get_distance ();
+  node *curr_node = _root;
+  while (curr_node != nullptr)
+    {
+      int i = position (curr_node, data, key);
+      path.emplace_back (curr_node, i);
+      if (i < curr_node->count && curr_node->value (i) == data)
+        {
+          return;
+        }
+      curr_node = curr_node->leaf ? nullptr : curr_node->children[i];
+    }
+  path.clear ();
+}
+
+/**
+ * The function returns an iterator to the item that corresponds to the item
+ * we were looking for. If there is no such member, returns end ().
+ * @param data apartment to search
+ * @return iterator to the item, or end ()
+ */
+ApartmentBTree::iterator ApartmentBTree::find (const Apartment &data)
+{
+  iterator itr;
+  helper_find (data, itr.path);
+  return itr;
+}
+
+/**
+ * The function returns a const iterator to the item that corresponds to the
+ * item we were looking for. If there is no such member, returns end ().
+ * @param data apartment to search
+ * @return const iterator to the item, or end ()
+ */
+ApartmentBTree::const_iterator
+ApartmentBTree::find (const Apartment &data) const
+{
+  const_iterator c_itr;
+  helper_find (data, c_itr.path);
+  return c_itr;
+}
+
+/**
+ * @return iterator to the closest apartment
+ */
+ApartmentBTree::iterator ApartmentBTree::begin ()
+{
+  iterator itr;
+  for (node *curr_node = _root; curr_node != nullptr && curr_node->count > 0;
+       curr_node = curr_node->leaf ? nullptr : curr_node->children[0])
+    {
+      itr.path.emplace_back (curr_node, 0);
+    }
+  return itr;
+}
+
+/**
+ * @return const iterator to the closest apartment
+ */
+ApartmentBTree::const_iterator ApartmentBTree::begin () const
+{
+  return const_cast<ApartmentBTree *> (this)->begin ();
+}
+
+/**
+ * @return const iterator to the closest apartment
+ */
+ApartmentBTree::const_iterator ApartmentBTree::cbegin () const
+{
+  return begin ();
+}
+
+/**
+ * @return iterator past the farthest apartment
+ */
+ApartmentBTree::iterator ApartmentBTree::end ()
+{
+  return iterator ();
+}
+
+/**
+ * @return const iterator past the farthest apartment
+ */
+ApartmentBTree::const_iterator ApartmentBTree::end () const
+{
+  return const_iterator ();
+}
+
+/**
+ * @return const iterator past the farthest apartment
+ */
+ApartmentBTree::const_iterator ApartmentBTree::cend () const
+{
+  return const_iterator ();
+}
+
+/**
+ * Insertion operator, prints the apartments of the tree in order.
+ * Each apartment will be printed in the format: (x,y)\n
+ * @param os reference to std::ostream
+ * @param tree tree to print
+ * @return os reference to std::ostream
+ */
+std::ostream &operator<< (std::ostream &os, const ApartmentBTree &tree)
+{
+  for (const auto &x : tree)
+    {
+      os << x;
+    }
+  return os;
+}
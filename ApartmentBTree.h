@@ -0,0 +1,353 @@
+#ifndef _APARTMENTBTREE_H_
+#define _APARTMENTBTREE_H_
+#include <vector>
+#include "Apartment.h"
+#include "Pool.h"
+
+#define BTREE_MIN_DEGREE 8
+#define BTREE_MAX_KEYS (2 * BTREE_MIN_DEGREE - 1)
+#define BTREE_KEY_SLOTS (2 * BTREE_MIN_DEGREE)
+#define BTREE_NODE_ALIGN 64
+
+/**
+ * this class represents a B-tree of apartments, ordered like AVL by the
+ * distance from feelbox. Every node holds up to BTREE_MAX_KEYS apartments,
+ * so a search touches a handful of nodes instead of one node per level. The
+ * distances of a node are kept as floats in one 64 byte cache line and are
+ * searched with SIMD compares where available.
+ * It has the same API as AVL, except that the iterators move in order
+ * (closest apartment first).
+ */
+class ApartmentBTree {
+
+ public:
+  /**
+   * A node of the tree. keys[i] is the float distance of apartment i,
+   * unused key slots hold +infinity so a whole line can be compared at once.
+   */
+  struct alignas (BTREE_NODE_ALIGN) node {
+      float keys[BTREE_KEY_SLOTS];
+      node *children[BTREE_KEY_SLOTS];
+      alignas (Apartment) unsigned char storage[BTREE_MAX_KEYS
+                                                * sizeof (Apartment)];
+      int count;
+      bool leaf;
+
+      /**
+       * Constructor. Constructs an empty node
+       * @param is_leaf true if the node has no children
+       */
+      node (bool is_leaf);
+
+      /**
+       * @param i index of an apartment in the node
+       * @return reference to apartment i
+       */
+      Apartment &value (int i)
+      {
+        return reinterpret_cast<Apartment *> (storage)[i];
+      }
+
+      /**
+       * @param i index of an apartment in the node
+       * @return const reference to apartment i
+       */
+      const Apartment &value (int i) const
+      {
+        return reinterpret_cast<const Apartment *> (storage)[i];
+      }
+  };
+
+  /**
+   * Constructor. Constructs an empty tree
+   */
+  ApartmentBTree ();
+
+  /**
+   * Copy constructor
+   * @param other other tree to copy
+   */
+  ApartmentBTree (const ApartmentBTree &other);
+
+  /**
+   * A constructor that receives a vector of pairs. Each such pair is an
+   * apartment that will inserted to the tree.
+   * @param coordinates vector of pairs
+   */
+  ApartmentBTree (const std::vector<std::pair<double, double>> &coordinates);
+
+  /**
+   * destructor, the nodes are released together with the pool
+   */
+  ~ApartmentBTree ();
+
+  /**
+   * Assignment operator - copies the contents of another tree to this
+   * @param rhs tree to copy values from
+   * @return reference to this tree
+   */
+  ApartmentBTree &operator= (const ApartmentBTree &rhs);
+
+  /**
+   * Inserts the apartment into the tree
+   * @param apartment Apartment object to add to tree
+   */
+  void insert (const Apartment &apartment);
+
+  /**
+   * Deletes the apartment from the tree (if it is in that tree)
+   * @param apartment Apartment object to erase from the tree
+   */
+  void erase (const Apartment &apartment);
+
+  /**
+   * @return number of apartments in the tree
+   */
+  size_t size () const;
+
+  /**
+   * forward iterator, moves in order. It keeps the path from the root to the
+   * current apartment, every entry is a node and an index in it.
+   */
+  template<class Value>
+  class BasicIterator {
+    friend class ApartmentBTree;
+    std::vector<std::pair<node *, int>> path;
+
+   public:
+    typedef Value value_type;
+    typedef Value &reference;
+    typedef Value *pointer;
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::ptrdiff_t difference_type;
+
+    /**
+     * Constructor. Constructs the end iterator
+     */
+    BasicIterator ()
+    {}
+
+    /**
+     * Constructor, converts an iterator to a const iterator
+     * @param other iterator to convert
+     */
+    template<class Other>
+    BasicIterator (const BasicIterator<Other> &other) : path (other.path)
+    {}
+
+    /**
+     * pointer operator
+     * @return pointer to the current Apartment
+     */
+    pointer operator-> () const
+    {
+      return &path.back ().first->value (path.back ().second);
+    }
+
+    /**
+     * dereference operator
+     * @return reference to the current Apartment
+     */
+    reference operator* () const
+    {
+      return path.back ().first->value (path.back ().second);
+    }
+
+    /**
+     * Pre-increment operator.
+     * @return reference to this
+     */
+    BasicIterator &operator++ ()
+    {
+      node *curr_node = path.back ().first;
+      if (!curr_node->leaf)
+        {
+          // the next apartment is the smallest of the right child. when we
+          // come back to this node we continue from the next index
+          int next = ++path.back ().second;
+          path.emplace_back (curr_node->children[next], 0);
+          while (!path.back ().first->leaf)
+            {
+              path.emplace_back (path.back ().first->children[0], 0);
+            }
+          return *this;
+        }
+
+      path.back ().second++;
+      while (!path.empty ()
+             && path.back ().second >= path.back ().first->count)
+        {
+          path.pop_back ();
+        }
+      return *this;
+    }
+
+    /**
+     *  Post-increment operator.
+     * @return this
+     */
+    BasicIterator operator++ (int)
+    {
+      BasicIterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    /**
+     * Operator ==, Two iterators are identical if they point to the same
+     * apartment of the same node, or both are end
+     * @param rhs other iterator
+     * @return true if the two iterators are equal, false otherwise
+     */
+    bool operator== (const BasicIterator &rhs) const
+    {
+      if (path.empty () || rhs.path.empty ())
+        {
+          return path.empty () && rhs.path.empty ();
+        }
+      return path.back () == rhs.path.back ();
+    }
+
+    /**
+     * Operator !=
+     * @param rhs other iterator
+     * @return true if the two iterators are not equal, false otherwise
+     */
+    bool operator!= (const BasicIterator &rhs) const
+    {
+      return !(rhs == *this);
+    }
+
+    template<class Other> friend
+    class BasicIterator;
+  };
+
+  typedef BasicIterator<Apartment> iterator;
+  typedef BasicIterator<const Apartment> const_iterator;
+
+  /**
+   * @return iterator to the closest apartment
+   */
+  iterator begin ();
+
+  /**
+   * @return const iterator to the closest apartment
+   */
+  const_iterator begin () const;
+
+  /**
+   * @return const iterator to the closest apartment
+   */
+  const_iterator cbegin () const;
+
+  /**
+   * @return iterator past the farthest apartment
+   */
+  iterator end ();
+
+  /**
+   * @return const iterator past the farthest apartment
+   */
+  const_iterator end () const;
+
+  /**
+   * @return const iterator past the farthest apartment
+   */
+  const_iterator cend () const;
+
+  /**
+   * The function returns an iterator to the item that corresponds to the item
+   * we were looking for. If there is no such member, returns end ().
+   * @param data apartment to search
+   * @return iterator to the item, or end ()
+   */
+  iterator find (const Apartment &data);
+
+  /**
+   * The function returns a const iterator to the item that corresponds to the
+   * item we were looking for. If there is no such member, returns end ().
+   * @param data apartment to search
+   * @return const iterator to the item, or end ()
+   */
+  const_iterator find (const Apartment &data) const;
+
+  /**
+   * Insertion operator, prints the apartments of the tree in order.
+   * Each apartment will be printed in the format: (x,y)\n
+   * @param os reference to std::ostream
+   * @param tree tree to print
+   * @return os reference to std::ostream
+   */
+  friend std::ostream &operator<< (std::ostream &os,
+                                   const ApartmentBTree &tree);
+
+ private:
+  node *_root;
+  size_t _size;
+  Pool<node> _pool;
+
+  /**
+   * @param curr_node node to search in
+   * @param apartment apartment to look for
+   * @param key float distance of apartment
+   * @return index of the first apartment in curr_node that is not smaller
+   * than apartment
+   */
+  static int position (const node *curr_node, const Apartment &apartment,
+                       float key);
+
+  /**
+   * descends to the apartment and records the path to it
+   * @param data apartment to search
+   * @param path vector to fill with the path, left empty if not found
+   */
+  void helper_find (const Apartment &data,
+                    std::vector<std::pair<node *, int>> &path) const;
+
+  /**
+   * recursive func for copying a sub tree into this tree's pool
+   * @param other root of the sub tree to copy
+   * @return root of the copy
+   */
+  node *helper_copy (const node *other);
+
+  /**
+   * places an apartment at index i of a node, shifting the apartments and
+   * the children after it one index to the right
+   */
+  static void insert_at (node *curr_node, int i, const Apartment &apartment,
+                         float key, node *right_child);
+
+  /**
+   * removes the apartment at index i of a node together with the child to
+   * its right, shifting the rest one index to the left
+   */
+  static void remove_at (node *curr_node, int i);
+
+  /**
+   * splits the full child i of parent into two nodes, moving its middle
+   * apartment up to parent
+   */
+  void split_child (node *parent, int i);
+
+  /**
+   * merges child i + 1 of parent and apartment i of parent into child i
+   */
+  void merge_children (node *parent, int i);
+
+  /**
+   * makes sure child i of parent has at least BTREE_MIN_DEGREE apartments,
+   * by borrowing from a sibling or merging with it
+   * @return index of the child that now holds the range of child i
+   */
+  int fill_child (node *parent, int i);
+
+  /**
+   * recursive func for erasing an apartment from a sub tree whose root has
+   * at least BTREE_MIN_DEGREE apartments (or is the root of the tree)
+   * @return true if the apartment was erased
+   */
+  bool helper_erase (node *curr_node, const Apartment &apartment, float key);
+};
+
+#endif //_APARTMENTBTREE_H_
@@ -0,0 +1,246 @@
+#ifndef _APARTMENTFILTER_H_
+#define _APARTMENTFILTER_H_
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "Apartment.h"
+
+#define FILTER_CELL (2 * EPSILON)
+#define FILTER_BLOCK_SIZE 64
+#define FILTER_BLOCK_SHIFT 6
+#define FILTER_MIN_HASHES 1
+#define FILTER_MAX_HASHES 8
+#define FILTER_MAX_COUNT UINT8_MAX
+#define FILTER_QUERY_CELLS 4
+#define FILTER_HASH_X 0x9E3779B97F4A7C15ULL
+#define FILTER_HASH_Y 0xC2B2AE3D27D4EB4FULL
+#define FILTER_HASH_MIX 0xFF51AFD7ED558CCDULL
+#define FILTER_HASH_SHIFT 32
+
+/**
+ * this class represents an approximate set of apartments: a counting Bloom
+ * filter over the coordinates quantized to cells of 2 * EPSILON. It answers
+ * "surely not in the set" or "maybe in the set", so a lookup that it
+ * rejects can skip the search. Every cell sets its counters in a single
+ * block of FILTER_BLOCK_SIZE counters (one cache line), so testing a cell
+ * costs one cache miss. Counters are bytes, so apartments can be removed
+ * again; a counter that reached FILTER_MAX_COUNT stays there, which can only
+ * add false positives.
+ * An apartment is added under its own cell. An apartment equal to it is at
+ * most EPSILON (half a cell) away, so a query tests its own cell and the
+ * three neighbours on the side it is closest to.
+ */
+class ApartmentFilter {
+  std::vector<uint8_t> counters;
+  size_t blocks;
+  int hashes;
+
+  /**
+   * @param value coordinate
+   * @return the filter cell of the coordinate
+   */
+  static int64_t cell (double value)
+  {
+    return (int64_t) std::floor (value / FILTER_CELL);
+  }
+
+  /**
+   * @param cell_x cell of the x coordinate
+   * @param cell_y cell of the y coordinate
+   * @return hash of the cell
+   */
+  static uint64_t hash (int64_t cell_x, int64_t cell_y)
+  {
+    uint64_t hash = (uint64_t) cell_x * FILTER_HASH_X
+                    ^ (uint64_t) cell_y * FILTER_HASH_Y;
+    return (hash ^ (hash >> FILTER_HASH_SHIFT)) * FILTER_HASH_MIX;
+  }
+
+  /**
+   * @param cell_hash hash of a cell
+   * @return index of the first counter of the block of the cell
+   */
+  size_t block (uint64_t cell_hash) const
+  {
+    // maps the high half of the hash onto [0, blocks) without a division
+    return (size_t) (((cell_hash >> FILTER_HASH_SHIFT) * blocks)
+                     >> FILTER_HASH_SHIFT) * FILTER_BLOCK_SIZE;
+  }
+
+  /**
+   * @param cell_hash hash of a cell
+   * @param i number of the probe
+   * @return index of the i-th counter of the cell inside its block. the
+   * probes step through the block by an odd stride, so they never repeat a
+   * counter
+   */
+  static size_t probe (uint64_t cell_hash, int i)
+  {
+    uint32_t low = (uint32_t) cell_hash;
+    uint32_t stride = (low >> FILTER_BLOCK_SHIFT) | 1;
+    return (size_t) (low + i * stride) & (FILTER_BLOCK_SIZE - 1);
+  }
+
+  /**
+   * @param cell_x cell of the x coordinate
+   * @param cell_y cell of the y coordinate
+   * @return true if an apartment may have been added under the cell
+   */
+  bool cell_may_contain (int64_t cell_x, int64_t cell_y) const
+  {
+    uint64_t cell_hash = hash (cell_x, cell_y);
+    const uint8_t *curr_block = &counters[block (cell_hash)];
+    for (int i = 0; i < hashes; i++)
+      {
+        if (curr_block[probe (cell_hash, i)] == 0)
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  /**
+   * adds delta to the counters of the cell of an apartment
+   * @param apartment apartment to count
+   * @param delta 1 or -1
+   */
+  void update (const Apartment &apartment, int delta)
+  {
+    if (!enabled ())
+      {
+        return;
+      }
+    uint64_t cell_hash = hash (cell (apartment.get_x ()),
+                               cell (apartment.get_y ()));
+    uint8_t *curr_block = &counters[block (cell_hash)];
+    for (int i = 0; i < hashes; i++)
+      {
+        uint8_t &counter = curr_block[probe (cell_hash, i)];
+        if (counter != FILTER_MAX_COUNT && (delta > 0 || counter > 0))
+          {
+            counter = (uint8_t) (counter + delta);
+          }
+      }
+  }
+
+ public:
+  size_t rejects, passes, false_positives;
+
+  /**
+   * Constructor. Constructs a disabled filter, that lets every query pass
+   */
+  ApartmentFilter () : blocks (0), hashes (0), rejects (0), passes (0),
+                       false_positives (0)
+  {}
+
+  /**
+   * Sizes the filter for a number of apartments and a false positive rate,
+   * and drops its content. The usual Bloom filter sizing is used for the
+   * rate of one cell, which is a quarter of the rate of a query since a
+   * query tests four cells. Memory is about 2.1 * ln (4 / rate) bytes per
+   * apartment, 12.5 bytes at a rate of 1%; the blocks make the real rate a
+   * little higher than requested.
+   * @param expected_size number of apartments the filter should hold, 0
+   * disables the filter
+   * @param false_positive_rate wanted part of the queries for absent
+   * apartments that pass, in (0, 1)
+   */
+  void resize (size_t expected_size, double false_positive_rate)
+  {
+    rejects = passes = false_positives = 0;
+    if (expected_size == 0 || !(false_positive_rate > 0)
+        || !(false_positive_rate < 1))
+      {
+        counters.clear ();
+        blocks = 0;
+        hashes = 0;
+        return;
+      }
+    double ln2 = std::log (2.0);
+    double cell_rate = false_positive_rate / FILTER_QUERY_CELLS;
+    double per_item = -std::log (cell_rate) / (ln2 * ln2);
+    double size = std::ceil (per_item * expected_size);
+    blocks = (size_t) std::ceil (size / FILTER_BLOCK_SIZE);
+    hashes = (int) std::lround (per_item * ln2);
+    hashes = std::max (FILTER_MIN_HASHES, std::min (hashes,
+                                                    FILTER_MAX_HASHES));
+    counters.assign (blocks * FILTER_BLOCK_SIZE, 0);
+  }
+
+  /**
+   * @return true if the filter is in use
+   */
+  bool enabled () const
+  {
+    return blocks > 0;
+  }
+
+  /**
+   * Adds an apartment to the filter
+   * @param apartment apartment to add
+   */
+  void add (const Apartment &apartment)
+  {
+    update (apartment, 1);
+  }
+
+  /**
+   * Removes an apartment that was added before
+   * @param apartment apartment to remove
+   */
+  void remove (const Apartment &apartment)
+  {
+    update (apartment, -1);
+  }
+
+  /**
+   * Tests an apartment and counts a pass or a reject. A disabled filter
+   * lets every query pass without counting.
+   * @param apartment apartment to test
+   * @return false if no apartment equal to apartment is in the set, true if
+   * one may be
+   */
+  bool may_contain (const Apartment &apartment)
+  {
+    if (!enabled ())
+      {
+        return true;
+      }
+    double x = apartment.get_x (), y = apartment.get_y ();
+    int64_t cell_x = cell (x), cell_y = cell (y);
+    int64_t near_x = (x - cell_x * FILTER_CELL < FILTER_CELL / 2)
+                     ? cell_x - 1 : cell_x + 1;
+    int64_t near_y = (y - cell_y * FILTER_CELL < FILTER_CELL / 2)
+                     ? cell_y - 1 : cell_y + 1;
+    if (cell_may_contain (cell_x, cell_y)
+        || cell_may_contain (near_x, cell_y)
+        || cell_may_contain (cell_x, near_y)
+        || cell_may_contain (near_x, near_y))
+      {
+        passes++;
+        return true;
+      }
+    rejects++;
+    return false;
+  }
+
+  /**
+   * Drops the content of the filter, keeping its size
+   */
+  void clear ()
+  {
+    counters.assign (counters.size (), 0);
+  }
+
+  /**
+   * @return number of bytes of the counters
+   */
+  size_t bytes () const
+  {
+    return counters.size ();
+  }
+};
+
+#endif //_APARTMENTFILTER_H_
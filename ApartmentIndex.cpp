@@ -0,0 +1,286 @@
+#include "ApartmentIndex.h"
+#include <cmath>
+#include <stdexcept>
+#define EMPTY_INDEX_MSG_ERROR "Error: the set is empty. illegal operation"
+
+/**
+ * Constructor. Constructs an empty set ordered by the distance from
+ * feelbox
+ */
+ApartmentIndex::ApartmentIndex ()
+    : _buckets (INDEX_MIN_BUCKETS, nullptr), _oldest (nullptr),
+      _newest (nullptr)
+{}
+
+/**
+ * Constructor. Constructs an empty set ordered by the distance from the
+ * reference point of context
+ * @param context reference point of the distance order
+ */
+ApartmentIndex::ApartmentIndex (const OrderingContext &context)
+    : ApartmentIndex ()
+{
+  _tree = AVL (context);
+}
+
+/**
+ * A constructor that receives a vector of pairs, and inserts them as
+ * apartments in arrival order
+ * @param coordinates vector of pairs
+ */
+ApartmentIndex::ApartmentIndex (
+    const std::vector<std::pair<double, double>> &coordinates)
+    : ApartmentIndex ()
+{
+  _records.reserve (coordinates.size ());
+  for (const auto &x : coordinates)
+    {
+      insert (Apartment (x));
+    }
+}
+
+/**
+ * @param value coordinate
+ * @return the hash cell of the coordinate
+ */
+int64_t ApartmentIndex::cell (double value)
+{
+  return (int64_t) std::floor (value / INDEX_CELL);
+}
+
+/**
+ * @param cell_x cell of the x coordinate
+ * @param cell_y cell of the y coordinate
+ * @return index of the bucket of the cell
+ */
+size_t ApartmentIndex::bucket (int64_t cell_x, int64_t cell_y) const
+{
+  uint64_t hash = (uint64_t) cell_x * INDEX_HASH_X
+                  ^ (uint64_t) cell_y * INDEX_HASH_Y;
+  size_t mask = _buckets.size () - 1;
+  return (size_t) (hash ^ (hash >> INDEX_HASH_SHIFT)) & mask;
+}
+
+/**
+ * @param apartment apartment to look for
+ * @return the record of an apartment equal to apartment, or nullptr
+ */
+ApartmentIndex::record *
+ApartmentIndex::lookup (const Apartment &apartment) const
+{
+  double x = apartment.get_x (), y = apartment.get_y ();
+  int64_t cell_x = cell (x), cell_y = cell (y);
+  // an equal apartment is at most EPSILON (half a cell) away, so it is in
+  // this cell or in the neighbour on the closer side, on each axis
+  int64_t near_x = (x - cell_x * INDEX_CELL < INDEX_CELL / 2)
+                   ? cell_x - 1 : cell_x + 1;
+  int64_t near_y = (y - cell_y * INDEX_CELL < INDEX_CELL / 2)
+                   ? cell_y - 1 : cell_y + 1;
+  const int64_t cells[][2] = {{cell_x, cell_y}, {near_x, cell_y},
+                              {cell_x, near_y}, {near_x, near_y}};
+  for (const auto &curr_cell : cells)
+    {
+      for (record *curr = _buckets[bucket (curr_cell[0], curr_cell[1])];
+           curr != nullptr; curr = curr->bucket_next)
+        {
+          if (curr->get_data () == apartment)
+            {
+              return curr;
+            }
+        }
+    }
+  return nullptr;
+}
+
+/**
+ * adds a record to the bucket of its cell
+ * @param curr_record record to add
+ */
+void ApartmentIndex::hash_link (record *curr_record)
+{
+  const Apartment &data = curr_record->get_data ();
+  record *&head = _buckets[bucket (cell (data.get_x ()),
+                                   cell (data.get_y ()))];
+  curr_record->bucket_next = head;
+  head = curr_record;
+}
+
+/**
+ * removes a record from the bucket of its cell
+ * @param curr_record record to remove
+ */
+void ApartmentIndex::hash_unlink (record *curr_record)
+{
+  const Apartment &data = curr_record->get_data ();
+  record **link = &_buckets[bucket (cell (data.get_x ()),
+                                    cell (data.get_y ()))];
+  while (*link != curr_record)
+    {
+      link = &(*link)->bucket_next;
+    }
+  *link = curr_record->bucket_next;
+}
+
+/**
+ * doubles the number of buckets and rehashes all the records
+ */
+void ApartmentIndex::grow ()
+{
+  _buckets.assign (_buckets.size () * 2, nullptr);
+  for (record *curr = _oldest; curr != nullptr; curr = curr->newer)
+    {
+      hash_link (curr);
+    }
+}
+
+/**
+ * Inserts the apartment into all the indexes, as the newest arrival
+ * @param apartment Apartment object to add
+ * @return true if it was inserted, false if an equal apartment is already
+ * in the set
+ */
+bool ApartmentIndex::insert (const Apartment &apartment)
+{
+  if (lookup (apartment) != nullptr)
+    {
+      return false;
+    }
+  record *new_record = _records.create (apartment);
+  _tree.insert_node (&new_record->hook);
+  new_record->older = _newest;
+  if (_newest != nullptr)
+    {
+      _newest->newer = new_record;
+    }
+  else
+    {
+      _oldest = new_record;
+    }
+  _newest = new_record;
+
+  if (_records.size () > _buckets.size ())
+    {
+      grow ();
+    }
+  else
+    {
+      hash_link (new_record);
+    }
+  return true;
+}
+
+/**
+ * Erases the apartment from all the indexes (if it is in the set)
+ * @param apartment Apartment object to erase
+ * @return true if it was erased
+ */
+bool ApartmentIndex::erase (const Apartment &apartment)
+{
+  record *found = lookup (apartment);
+  if (found == nullptr)
+    {
+      return false;
+    }
+  _tree.erase_node (&found->hook);
+  hash_unlink (found);
+  if (found->older != nullptr)
+    {
+      found->older->newer = found->newer;
+    }
+  else
+    {
+      _oldest = found->newer;
+    }
+  if (found->newer != nullptr)
+    {
+      found->newer->older = found->older;
+    }
+  else
+    {
+      _newest = found->older;
+    }
+  _records.destroy (found);
+  return true;
+}
+
+/**
+ * Looks up an apartment by equality, in O(1) expected time
+ * @param apartment apartment to search
+ * @return pointer to the stored apartment equal to apartment, or nullptr
+ */
+const Apartment *ApartmentIndex::find (const Apartment &apartment) const
+{
+  record *found = lookup (apartment);
+  return (found != nullptr) ? &found->get_data () : nullptr;
+}
+
+/**
+ * @param apartment apartment to search
+ * @return true if an equal apartment is in the set
+ */
+bool ApartmentIndex::contains (const Apartment &apartment) const
+{
+  return lookup (apartment) != nullptr;
+}
+
+/**
+ * @return number of apartments in the set
+ */
+size_t ApartmentIndex::size () const
+{
+  return _records.size ();
+}
+
+/**
+ * @return true if the set is empty
+ */
+bool ApartmentIndex::empty () const
+{
+  return size () == 0;
+}
+
+/**
+ * The distance index. It can be searched and iterated like any AVL, but
+ * only the index may change it.
+ * @return the AVL tree of the apartments
+ */
+const AVL &ApartmentIndex::by_distance () const
+{
+  return _tree;
+}
+
+/**
+ * The apartment that arrived first. Calling this method with an empty set
+ * will throw an out of range exception.
+ * @return reference to the oldest apartment
+ */
+const Apartment &ApartmentIndex::oldest () const
+{
+  if (empty ())
+    {
+      throw std::out_of_range (EMPTY_INDEX_MSG_ERROR);
+    }
+  return _oldest->get_data ();
+}
+
+/**
+ * The apartment that arrived last. Calling this method with an empty set
+ * will throw an out of range exception.
+ * @return reference to the newest apartment
+ */
+const Apartment &ApartmentIndex::newest () const
+{
+  if (empty ())
+    {
+      throw std::out_of_range (EMPTY_INDEX_MSG_ERROR);
+    }
+  return _newest->get_data ();
+}
+
+/**
+ * @return number of bytes allocated for the records and the hash table
+ */
+size_t ApartmentIndex::bytes () const
+{
+  return _records.bytes () + _buckets.capacity () * sizeof (record *);
+}
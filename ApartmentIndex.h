@@ -0,0 +1,220 @@
+#ifndef _APARTMENTINDEX_H_
+#define _APARTMENTINDEX_H_
+#include <vector>
+#include "AVL.h"
+#include "Pool.h"
+
+#define INDEX_CELL (2 * EPSILON)
+#define INDEX_HASH_X 0x9E3779B97F4A7C15ULL
+#define INDEX_HASH_Y 0xC2B2AE3D27D4EB4FULL
+#define INDEX_HASH_SHIFT 29
+#define INDEX_MIN_BUCKETS 16
+
+/**
+ * this class represents a set of apartments with three indexes over one
+ * copy of every apartment: distance order (an AVL tree), equality (a hash
+ * table) and arrival order (a list). Every apartment lives in one record
+ * from a pool, and the record embeds the AVL node and the links of the
+ * other two indexes, so insert () and erase () update all of them together
+ * and nothing is copied between structures.
+ * The hash table is keyed by cells of 2 * EPSILON. An apartment is stored
+ * under its own cell, and a lookup checks the cell of the query and the
+ * three neighbours on the side it is closest to, which covers every
+ * apartment equal to the query up to EPSILON.
+ */
+class ApartmentIndex {
+  /**
+   * An apartment and its links in the three indexes. The AVL node holds the
+   * apartment itself.
+   */
+  struct record {
+      AVL::node hook;
+      record *older, *newer;
+      record *bucket_next;
+
+      /**
+       * Constructor. Constructs an unlinked record
+       * @param apartment the apartment of the record
+       */
+      record (const Apartment &apartment)
+          : hook (apartment), older (nullptr),
+            newer (nullptr), bucket_next (nullptr)
+      {}
+
+      /**
+       * @return the apartment of the record
+       */
+      const Apartment &get_data () const
+      {
+        return hook.get_data ();
+      }
+  };
+
+  Pool<record> _records;
+  AVL _tree;
+  std::vector<record *> _buckets;
+  record *_oldest, *_newest;
+
+  /**
+   * @param value coordinate
+   * @return the hash cell of the coordinate
+   */
+  static int64_t cell (double value);
+
+  /**
+   * @param cell_x cell of the x coordinate
+   * @param cell_y cell of the y coordinate
+   * @return index of the bucket of the cell
+   */
+  size_t bucket (int64_t cell_x, int64_t cell_y) const;
+
+  /**
+   * @param apartment apartment to look for
+   * @return the record of an apartment equal to apartment, or nullptr
+   */
+  record *lookup (const Apartment &apartment) const;
+
+  /**
+   * adds a record to the bucket of its cell
+   * @param curr_record record to add
+   */
+  void hash_link (record *curr_record);
+
+  /**
+   * removes a record from the bucket of its cell
+   * @param curr_record record to remove
+   */
+  void hash_unlink (record *curr_record);
+
+  /**
+   * doubles the number of buckets and rehashes all the records
+   */
+  void grow ();
+
+ public:
+  /**
+   * Constructor. Constructs an empty set ordered by the distance from
+   * feelbox
+   */
+  ApartmentIndex ();
+
+  /**
+   * Constructor. Constructs an empty set ordered by the distance from the
+   * reference point of context
+   * @param context reference point of the distance order
+   */
+  explicit ApartmentIndex (const OrderingContext &context);
+
+  /**
+   * A constructor that receives a vector of pairs, and inserts them as
+   * apartments in arrival order
+   * @param coordinates vector of pairs
+   */
+  ApartmentIndex (const std::vector<std::pair<double, double>> &coordinates);
+
+  ApartmentIndex (const ApartmentIndex &other) = delete;
+  ApartmentIndex &operator= (const ApartmentIndex &rhs) = delete;
+
+  /**
+   * Inserts the apartment into all the indexes, as the newest arrival
+   * @param apartment Apartment object to add
+   * @return true if it was inserted, false if an equal apartment is already
+   * in the set
+   */
+  bool insert (const Apartment &apartment);
+
+  /**
+   * Erases the apartment from all the indexes (if it is in the set)
+   * @param apartment Apartment object to erase
+   * @return true if it was erased
+   */
+  bool erase (const Apartment &apartment);
+
+  /**
+   * Looks up an apartment by equality, in O(1) expected time
+   * @param apartment apartment to search
+   * @return pointer to the stored apartment equal to apartment, or nullptr
+   */
+  const Apartment *find (const Apartment &apartment) const;
+
+  /**
+   * @param apartment apartment to search
+   * @return true if an equal apartment is in the set
+   */
+  bool contains (const Apartment &apartment) const;
+
+  /**
+   * @return number of apartments in the set
+   */
+  size_t size () const;
+
+  /**
+   * @return true if the set is empty
+   */
+  bool empty () const;
+
+  /**
+   * The distance index. It can be searched and iterated like any AVL, but
+   * only the index may change it.
+   * @return the AVL tree of the apartments
+   */
+  const AVL &by_distance () const;
+
+  /**
+   * The apartment that arrived first. Calling this method with an empty set
+   * will throw an out of range exception.
+   * @return reference to the oldest apartment
+   */
+  const Apartment &oldest () const;
+
+  /**
+   * The apartment that arrived last. Calling this method with an empty set
+   * will throw an out of range exception.
+   * @return reference to the newest apartment
+   */
+  const Apartment &newest () const;
+
+  /**
+   * Calls f on every apartment in arrival order, oldest first
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_by_arrival (Function f) const;
+
+  /**
+   * Calls f on every apartment in distance order, closest first
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_by_distance (Function f) const;
+
+  /**
+   * @return number of bytes allocated for the records and the hash table
+   */
+  size_t bytes () const;
+};
+
+/**
+ * Calls f on every apartment in arrival order, oldest first
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void ApartmentIndex::for_each_by_arrival (Function f) const
+{
+  for (const record *curr = _oldest; curr != nullptr; curr = curr->newer)
+    {
+      f (curr->get_data ());
+    }
+}
+
+/**
+ * Calls f on every apartment in distance order, closest first
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void ApartmentIndex::for_each_by_distance (Function f) const
+{
+  _tree.for_each_in_order (f);
+}
+
+#endif //_APARTMENTINDEX_H_
@@ -0,0 +1,1562 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "Apartment.h"
+#include "AVL.h"
+#include "ApartmentBTree.h"
+#include "BufferedAVL.h"
+#include "CompactAVL.h"
+#include "DurableAVL.h"
+#include "ApartmentIndex.h"
+#include "ConcurrentStack.h"
+#include "ShardedAVL.h"
+#include "Stack.h"
+#include "TopK.h"
+#include "WorkStealingPool.h"
+
+#define DEFAULT_BENCH_SIZE 1000000
+#define BENCH_SEED 2021
+#define CLUSTERS 64
+#define CLUSTER_SPREAD 0.01
+#define AREA_SPREAD 0.15
+#define SIZE_STEPS 3
+#define HOT_APARTMENTS 2000
+#define HOT_PERCENT 90
+#define CACHE_CAPACITY 8192
+#define EXPIRED_PART 2
+#define MAX_TOMBSTONE_RATIO 0.25
+#define SIZE_STEP_FACTOR 10
+#define SHARD_COUNT 8
+#define MAX_WRITERS 8
+#define MAX_STACK_THREADS 32
+#define STACK_CHUNK 1024
+#define PERCENT_SCALE 1000
+#define TOPK_MIN_K 10
+#define TOPK_MAX_K 1000
+#define TOPK_K_STEP 10
+#define MISS_PERCENT 70
+#define FILTER_RATES {0.1, 0.01}
+#define BUFFER_CAPACITIES {0, 4096, 65536, 262144}
+#define LOOKUP_PART 10
+#define COMMIT_GROUPS {1, 16, 256, 4096}
+#define SYNCED_UPDATES 4096
+#define DURABLE_PATH "Benchmark.durable"
+#define CHURN_PART 1000
+#define PARALLEL_THREADS {1, 2, 4, 8}
+#define HISTOGRAM_SIDE 64
+#define HISTOGRAM_SPAN 1.0
+#define VIEWPORT_SIDES {0.005, 0.02, 0.1}
+#define VIEWPORT_QUERIES 200
+#define VIEWPORT_SCANS 10
+#define USAGE_MSG "Usage: Benchmark <compact|btree|cache|expiry|finger|sharded|stack|push|ingest|topk|index|intrusive|keyed|filter|buffered|durable|parallel|rect|morton|fixed|indexed|all> [number of apartments]"
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**
+ * Creates coordinates of apartments around feelbox. Like real listings, the
+ * apartments are clustered in neighbourhoods.
+ * @param n number of coordinates
+ * @param seed seed of the random generator
+ * @return vector of n pairs
+ */
+std::vector<std::pair<double, double>> random_coordinates (size_t n,
+                                                           unsigned seed)
+{
+  std::mt19937_64 gen (seed);
+  std::normal_distribution<double> area (0, AREA_SPREAD);
+  std::normal_distribution<double> cluster (0, CLUSTER_SPREAD);
+
+  std::vector<std::pair<double, double>> centers;
+  for (int i = 0; i < CLUSTERS; i++)
+    {
+      centers.emplace_back (X_FEEL_BOX + area (gen), Y_FEEL_BOX + area (gen));
+    }
+
+  std::vector<std::pair<double, double>> coordinates;
+  coordinates.reserve (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      const auto &center = centers[gen () % CLUSTERS];
+      coordinates.emplace_back (center.first + cluster (gen),
+                                center.second + cluster (gen));
+    }
+  return coordinates;
+}
+
+/**
+ * @param start time point to measure from
+ * @return nanoseconds passed since start
+ */
+double ns_since (bench_clock::time_point start)
+{
+  return (double) std::chrono::duration_cast<std::chrono::nanoseconds> (
+      bench_clock::now () - start).count ();
+}
+
+/**
+ * Looks up every apartment of queries in the container
+ * @param container AVL or ApartmentBTree to search
+ * @param queries apartments to look up
+ * @return average nanoseconds per lookup
+ */
+template<class Container>
+double time_lookups (const Container &container,
+                     const std::vector<Apartment> &queries)
+{
+  size_t found = 0;
+  auto start = bench_clock::now ();
+  for (const Apartment &query : queries)
+    {
+      found += (container.find (query) != container.end ());
+    }
+  double ns = ns_since (start);
+  if (found != queries.size ())
+    {
+      std::cerr << "lookup benchmark lost apartments" << std::endl;
+    }
+  return ns / queries.size ();
+}
+
+/**
+ * Compares lookups in a tree built from shuffled input before and after
+ * AVL::compact ()
+ * @param n number of apartments
+ */
+void bench_compact (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  AVL avl (coordinates);
+
+  std::vector<Apartment> queries (coordinates.begin (), coordinates.end ());
+  std::shuffle (queries.begin (), queries.end (), std::mt19937 (BENCH_SEED));
+
+  double before = time_lookups (avl, queries);
+  auto start = bench_clock::now ();
+  avl.compact ();
+  double compact_ns = ns_since (start);
+  double after = time_lookups (avl, queries);
+
+  std::cout << "compact n=" << n << std::endl
+            << "  find before compact (ns/op) = " << before << std::endl
+            << "  compact (ms) = " << compact_ns / 1e6 << std::endl
+            << "  find after compact (ns/op) = " << after << std::endl;
+}
+
+/**
+ * Inserts, looks up and erases the apartments in a container
+ * @param name name of the container to print
+ * @param apartments apartments to use, in insertion order
+ * @param queries the same apartments in lookup order
+ */
+template<class Container>
+void bench_container (const std::string &name,
+                      const std::vector<Apartment> &apartments,
+                      const std::vector<Apartment> &queries)
+{
+  Container container;
+  auto start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      container.insert (apartment);
+    }
+  double insert_ns = ns_since (start) / apartments.size ();
+  double find_ns = time_lookups (container, queries);
+  start = bench_clock::now ();
+  for (const Apartment &query : queries)
+    {
+      container.erase (query);
+    }
+  double erase_ns = ns_since (start) / queries.size ();
+
+  std::cout << "  " << name << ": insert " << insert_ns << " find "
+            << find_ns << " erase " << erase_ns << " (ns/op)" << std::endl;
+}
+
+/**
+ * Compares AVL and ApartmentBTree at n / 100, n / 10 and n apartments
+ * @param n largest number of apartments
+ */
+void bench_btree (size_t n)
+{
+  size_t size = n;
+  for (int i = 1; i < SIZE_STEPS; i++)
+    {
+      size /= SIZE_STEP_FACTOR;
+    }
+  for (int i = 0; i < SIZE_STEPS; i++, size *= SIZE_STEP_FACTOR)
+    {
+      auto coordinates = random_coordinates (size, BENCH_SEED);
+      std::vector<Apartment> apartments (coordinates.begin (),
+                                         coordinates.end ());
+      std::vector<Apartment> queries = apartments;
+      std::shuffle (queries.begin (), queries.end (),
+                    std::mt19937 (BENCH_SEED));
+
+      std::cout << "btree n=" << size << std::endl;
+      bench_container<AVL> ("AVL", apartments, queries);
+      bench_container<ApartmentBTree> ("ApartmentBTree", apartments, queries);
+    }
+}
+
+/**
+ * Compares skewed lookups with and without the find cache. HOT_PERCENT of
+ * the lookups go to HOT_APARTMENTS popular apartments.
+ * @param n number of apartments
+ */
+void bench_cache (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  AVL avl (coordinates);
+
+  std::mt19937_64 gen (BENCH_SEED);
+  std::vector<Apartment> queries;
+  queries.reserve (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      bool hot = (gen () % 100) < HOT_PERCENT;
+      size_t index = gen () % (hot ? HOT_APARTMENTS : n);
+      queries.emplace_back (coordinates[index]);
+    }
+
+  double uncached = time_lookups (avl, queries);
+  avl.set_find_cache (CACHE_CAPACITY);
+  double cached = time_lookups (avl, queries);
+  AVL::tree_stats stats = avl.stats ();
+
+  std::cout << "cache n=" << n << std::endl
+            << "  find without cache (ns/op) = " << uncached << std::endl
+            << "  find with cache (ns/op) = " << cached << std::endl
+            << "  hits = " << stats.cache_hits << " misses = "
+            << stats.cache_misses << std::endl;
+}
+
+/**
+ * Erases a burst of n / EXPIRED_PART apartments, once with structural erase
+ * and once with lazy erase
+ * @param n number of apartments
+ */
+void bench_expiry (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> expired (coordinates.begin (),
+                                  coordinates.begin () + n / EXPIRED_PART);
+  std::shuffle (expired.begin (), expired.end (), std::mt19937 (BENCH_SEED));
+
+  std::cout << "expiry n=" << n << " expired=" << expired.size ()
+            << std::endl;
+  for (double ratio : {0.0, MAX_TOMBSTONE_RATIO})
+    {
+      AVL avl (coordinates);
+      avl.set_lazy_erase (ratio);
+      auto start = bench_clock::now ();
+      for (const Apartment &apartment : expired)
+        {
+          avl.erase (apartment);
+        }
+      double erase_ns = ns_since (start) / expired.size ();
+      std::cout << "  " << (ratio > 0 ? "lazy" : "structural")
+                << " erase (ns/op) = " << erase_ns << std::endl;
+    }
+
+  // the expiry job looks every listing up before it erases it
+  for (bool by_iterator : {false, true})
+    {
+      AVL avl (coordinates);
+      auto start = bench_clock::now ();
+      for (const Apartment &apartment : expired)
+        {
+          AVL::iterator found = avl.find (apartment);
+          if (by_iterator)
+            {
+              avl.erase (found);
+            }
+          else if (found != avl.end ())
+            {
+              avl.erase (*found);
+            }
+        }
+      double erase_ns = ns_since (start) / expired.size ();
+      std::cout << "  find + erase ("
+                << (by_iterator ? "iterator" : "apartment")
+                << ") (ns/op) = " << erase_ns << std::endl;
+    }
+}
+
+/**
+ * Compares plain and hinted operations on apartments sorted by distance,
+ * like paging through rings around feelbox
+ * @param n number of apartments
+ */
+void bench_finger (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> sorted (coordinates.begin (), coordinates.end ());
+  std::sort (sorted.begin (), sorted.end ());
+
+  AVL plain;
+  auto start = bench_clock::now ();
+  for (const Apartment &apartment : sorted)
+    {
+      plain.insert (apartment);
+    }
+  double insert_ns = ns_since (start) / n;
+
+  AVL hinted;
+  AVL::iterator hint = hinted.end ();
+  start = bench_clock::now ();
+  for (const Apartment &apartment : sorted)
+    {
+      hint = hinted.insert (hint, apartment);
+    }
+  double hinted_insert_ns = ns_since (start) / n;
+
+  double find_ns = time_lookups (plain, sorted);
+  size_t found = 0;
+  hint = plain.end ();
+  start = bench_clock::now ();
+  for (const Apartment &apartment : sorted)
+    {
+      AVL::iterator itr = plain.find_from (hint, apartment);
+      if (itr != plain.end ())
+        {
+          hint = itr;
+          found++;
+        }
+    }
+  double find_from_ns = ns_since (start) / n;
+  if (found != n)
+    {
+      std::cerr << "finger benchmark lost apartments" << std::endl;
+    }
+
+  std::cout << "finger n=" << n << " (sorted by distance)" << std::endl
+            << "  insert (ns/op) = " << insert_ns << std::endl
+            << "  hinted insert (ns/op) = " << hinted_insert_ns << std::endl
+            << "  find (ns/op) = " << find_ns << std::endl
+            << "  find_from (ns/op) = " << find_from_ns << std::endl;
+}
+
+/**
+ * Splits apartments between writer threads and inserts them concurrently
+ * @param apartments apartments to insert
+ * @param writers number of threads
+ * @param insert function that inserts one apartment
+ * @return nanoseconds passed until all the writers finished
+ */
+template<class Insert>
+double time_writers (const std::vector<Apartment> &apartments, size_t writers,
+                     Insert insert)
+{
+  std::vector<std::thread> threads;
+  auto start = bench_clock::now ();
+  for (size_t w = 0; w < writers; w++)
+    {
+      threads.emplace_back ([&apartments, writers, w, &insert] ()
+      {
+        for (size_t i = w; i < apartments.size (); i += writers)
+          {
+            insert (apartments[i]);
+          }
+      });
+    }
+  for (std::thread &thread : threads)
+    {
+      thread.join ();
+    }
+  return ns_since (start);
+}
+
+/**
+ * Compares the insert throughput of one AVL behind a mutex with ShardedAVL
+ * for a growing number of writer threads
+ * @param n number of apartments
+ */
+void bench_sharded (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+
+  std::cout << "sharded n=" << n << " shards=" << SHARD_COUNT
+            << " (hardware threads " << std::thread::hardware_concurrency ()
+            << ")" << std::endl;
+  for (size_t writers = 1; writers <= MAX_WRITERS; writers *= 2)
+    {
+      AVL single;
+      std::mutex lock;
+      double single_ns = time_writers (
+          apartments, writers, [&single, &lock] (const Apartment &a)
+          {
+            std::lock_guard<std::mutex> guard (lock);
+            single.insert (a);
+          });
+
+      // starts with no boundaries, they are learned by the online rebalance
+      ShardedAVL sharded (SHARD_COUNT);
+      double sharded_ns = time_writers (
+          apartments, writers, [&sharded] (const Apartment &a)
+          { sharded.insert (a); });
+      if (sharded.size () != n)
+        {
+          std::cerr << "sharded benchmark lost apartments" << std::endl;
+        }
+
+      std::cout << "  writers=" << writers
+                << "  mutex AVL (Minserts/s) = " << n * 1e3 / single_ns
+                << "  sharded (Minserts/s) = " << n * 1e3 / sharded_ns
+                << std::endl;
+    }
+}
+
+/**
+ * Runs threads that each push and pop their share of apartments
+ * @param apartments apartments to push
+ * @param threads number of threads
+ * @param push_pop function that pushes one apartment and pops one
+ * @return million push and pop pairs per second
+ */
+template<class PushPop>
+double time_push_pop (const std::vector<Apartment> &apartments,
+                      size_t threads, PushPop push_pop)
+{
+  std::vector<std::thread> workers;
+  auto start = bench_clock::now ();
+  for (size_t t = 0; t < threads; t++)
+    {
+      workers.emplace_back ([&apartments, threads, t, &push_pop] ()
+      {
+        for (size_t i = t; i < apartments.size (); i += threads)
+          {
+            push_pop (apartments[i]);
+          }
+      });
+    }
+  for (std::thread &worker : workers)
+    {
+      worker.join ();
+    }
+  return apartments.size () * 1e3 / ns_since (start);
+}
+
+/**
+ * Compares a Stack behind a mutex with ConcurrentStack, for 1 to
+ * MAX_STACK_THREADS threads that push and pop, and measures pop_all batches
+ * @param n number of apartments
+ */
+void bench_stack (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+
+  std::cout << "stack n=" << n << " (hardware threads "
+            << std::thread::hardware_concurrency () << ")" << std::endl;
+  for (size_t threads = 1; threads <= MAX_STACK_THREADS; threads *= 2)
+    {
+      Stack locked;
+      std::mutex lock;
+      double locked_ops = time_push_pop (
+          apartments, threads, [&locked, &lock] (const Apartment &a)
+          {
+            std::lock_guard<std::mutex> guard (lock);
+            locked.push (a);
+            locked.pop ();
+          });
+
+      ConcurrentStack concurrent;
+      double concurrent_ops = time_push_pop (
+          apartments, threads, [&concurrent] (const Apartment &a)
+          {
+            Apartment popped = a;
+            concurrent.push (a);
+            concurrent.try_pop (popped);
+          });
+
+      std::cout << "  threads=" << threads
+                << "  mutex Stack (Mops/s) = " << locked_ops
+                << "  ConcurrentStack (Mops/s) = " << concurrent_ops
+                << std::endl;
+    }
+
+  ConcurrentStack batch;
+  for (const Apartment &apartment : apartments)
+    {
+      batch.push (apartment);
+    }
+  auto start = bench_clock::now ();
+  size_t taken = batch.pop_all ().size ();
+  std::cout << "  pop_all (ns/apartment) = " << ns_since (start) / n
+            << std::endl;
+  if (taken != n)
+    {
+      std::cerr << "stack benchmark lost apartments" << std::endl;
+    }
+}
+
+/**
+ * Pushes every apartment to a stack and prints percentiles of the time of
+ * a push
+ * @param label name of the stack to print
+ * @param stack stack to push to
+ * @param apartments apartments to push
+ */
+void report_push_latency (const std::string &label, Stack &stack,
+                          const std::vector<Apartment> &apartments)
+{
+  std::vector<double> latencies;
+  latencies.reserve (apartments.size ());
+  for (const Apartment &apartment : apartments)
+    {
+      auto start = bench_clock::now ();
+      stack.push (apartment);
+      latencies.push_back (ns_since (start));
+    }
+  std::sort (latencies.begin (), latencies.end ());
+  size_t n = latencies.size ();
+  std::cout << "  " << label << " (ns) p50 = " << latencies[n / 2]
+            << "  p99 = " << latencies[n * 990 / PERCENT_SCALE]
+            << "  p99.9 = " << latencies[n * 999 / PERCENT_SCALE]
+            << "  max = " << latencies.back () << std::endl;
+}
+
+/**
+ * Compares the push latency of contiguous and chunked stacks, where the
+ * tail is made of the pushes that reallocate
+ * @param n number of apartments
+ */
+void bench_push (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+
+  std::cout << "push n=" << n << std::endl;
+  Stack contiguous;
+  report_push_latency ("contiguous", contiguous, apartments);
+  Stack reserved;
+  reserved.reserve (n);
+  report_push_latency ("contiguous + reserve", reserved, apartments);
+  Stack chunked (STACK_CHUNK);
+  report_push_latency ("chunked", chunked, apartments);
+}
+
+/**
+ * Compares building containers one apartment at a time with the emplace
+ * and range APIs
+ * @param n number of apartments
+ */
+void bench_ingest (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+
+  Stack stack;
+  auto start = bench_clock::now ();
+  for (const auto &x : coordinates)
+    {
+      Apartment a (x);
+      stack.push (a);
+    }
+  double push_ns = ns_since (start) / n;
+
+  Stack ranged;
+  start = bench_clock::now ();
+  ranged.push_range (coordinates);
+  double push_range_ns = ns_since (start) / n;
+
+  AVL tree;
+  start = bench_clock::now ();
+  for (const auto &x : coordinates)
+    {
+      Apartment a (x);
+      tree.insert (a);
+    }
+  double insert_ns = ns_since (start) / n;
+
+  AVL emplaced;
+  start = bench_clock::now ();
+  for (const auto &x : coordinates)
+    {
+      emplaced.emplace (x.first, x.second);
+    }
+  double emplace_ns = ns_since (start) / n;
+
+  AVL ranged_tree;
+  start = bench_clock::now ();
+  ranged_tree.insert_range (coordinates);
+  double insert_range_ns = ns_since (start) / n;
+
+  std::cout << "ingest n=" << n << std::endl
+            << "  Stack push (ns/op) = " << push_ns << std::endl
+            << "  Stack push_range (ns/op) = " << push_range_ns << std::endl
+            << "  AVL insert (ns/op) = " << insert_ns << std::endl
+            << "  AVL emplace (ns/op) = " << emplace_ns << std::endl
+            << "  AVL insert_range (ns/op) = " << insert_range_ns
+            << std::endl;
+}
+
+/**
+ * Streams n synthetic listings, uniform in a square around feelbox, through
+ * a TopK container (or through nothing when k is 0, to time the stream)
+ * @param n number of listings
+ * @param k number of apartments to keep, 0 for no container
+ * @param kept set to the number of listings that were kept
+ * @return nanoseconds per listing
+ */
+double time_stream (size_t n, size_t k, size_t &kept)
+{
+  std::mt19937_64 gen (BENCH_SEED);
+  std::uniform_real_distribution<double> offset (-AREA_SPREAD, AREA_SPREAD);
+  TopK top (k);
+  double checksum = 0;
+  kept = 0;
+  auto start = bench_clock::now ();
+  for (size_t i = 0; i < n; i++)
+    {
+      Apartment apartment (std::make_pair (X_FEEL_BOX + offset (gen),
+                                           Y_FEEL_BOX + offset (gen)));
+      if (k == 0)
+        {
+          checksum += apartment.get_x ();
+        }
+      else
+        {
+          kept += top.push (apartment);
+        }
+    }
+  double ns = ns_since (start) / n;
+  if (checksum < 0)
+    {
+      std::cerr << "impossible checksum" << std::endl;
+    }
+  return ns;
+}
+
+/**
+ * Measures the throughput of TopK over a stream of n listings for several k
+ * @param n number of listings in the stream
+ */
+void bench_topk (size_t n)
+{
+  size_t kept = 0;
+  std::cout << "topk events=" << n << std::endl
+            << "  stream only (ns/event) = " << time_stream (n, 0, kept)
+            << std::endl;
+  for (size_t k = TOPK_MIN_K; k <= TOPK_MAX_K; k *= TOPK_K_STEP)
+    {
+      double ns = time_stream (n, k, kept);
+      std::cout << "  k=" << k << " (ns/event) = " << ns
+                << "  (Mevents/s) = " << 1e3 / ns
+                << "  kept = " << kept << std::endl;
+    }
+}
+
+/**
+ * Hash of the exact coordinates of an apartment, for the unordered_set that
+ * the separate structures are compared with
+ */
+struct apartment_hash {
+    size_t operator() (const Apartment &apartment) const
+    {
+      return std::hash<double> () (apartment.get_x ())
+             ^ (std::hash<double> () (apartment.get_y ()) << 1);
+    }
+};
+
+/**
+ * Compares keeping apartments in an AVL, a Stack and an unordered_set side
+ * by side with keeping them once in an ApartmentIndex
+ * @param n number of apartments
+ */
+void bench_index (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+
+  AVL tree;
+  Stack arrivals;
+  std::unordered_set<Apartment, apartment_hash> set;
+  auto start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      tree.insert (apartment);
+      arrivals.push (apartment);
+      set.insert (apartment);
+    }
+  double separate_insert_ns = ns_since (start) / n;
+  // the set nodes hold the apartment, the next pointer and the cached hash
+  size_t separate_bytes = tree.stats ().node_bytes
+                          + arrivals.capacity () * sizeof (Apartment)
+                          + set.bucket_count () * sizeof (void *)
+                          + set.size () * (sizeof (Apartment)
+                                           + 2 * sizeof (void *));
+  size_t found = 0;
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      found += set.count (apartment);
+    }
+  double separate_find_ns = ns_since (start) / n;
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      tree.erase (apartment);
+      set.erase (apartment);
+    }
+  double separate_erase_ns = ns_since (start) / n;
+
+  ApartmentIndex index;
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      index.insert (apartment);
+    }
+  double index_insert_ns = ns_since (start) / n;
+  size_t index_bytes = index.bytes ();
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      found += index.contains (apartment);
+    }
+  double index_find_ns = ns_since (start) / n;
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      index.erase (apartment);
+    }
+  double index_erase_ns = ns_since (start) / n;
+  if (found < n)
+    {
+      std::cerr << "index benchmark lost apartments" << std::endl;
+    }
+
+  std::cout << "index n=" << n << std::endl
+            << "  AVL + Stack + unordered_set: insert (ns/op) = "
+            << separate_insert_ns << "  find (ns/op) = " << separate_find_ns
+            << "  erase (ns/op) = " << separate_erase_ns
+            << "  bytes/apartment = " << (double) separate_bytes / n
+            << std::endl
+            << "  ApartmentIndex: insert (ns/op) = " << index_insert_ns
+            << "  find (ns/op) = " << index_find_ns
+            << "  erase (ns/op) = " << index_erase_ns
+            << "  bytes/apartment = " << (double) index_bytes / n
+            << std::endl;
+}
+
+/**
+ * A record from the caller's own slab, with the AVL hook embedded in it
+ */
+struct listing {
+    AVL::node hook;
+    size_t id;
+
+    /**
+     * Constructor. Constructs an unlinked listing
+     * @param apartment the apartment of the listing
+     * @param id id of the listing
+     */
+    listing (const Apartment &apartment, size_t id) : hook (apartment), id (id)
+    {}
+};
+
+/**
+ * Compares inserting and erasing apartments by copy, into the nodes of the
+ * tree, with linking and unlinking nodes embedded in records of the caller
+ * @param n number of apartments
+ */
+void bench_intrusive (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+
+  AVL tree;
+  auto start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      tree.insert (apartment);
+    }
+  double copy_insert_ns = ns_since (start) / n;
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      tree.erase (apartment);
+    }
+  double copy_erase_ns = ns_since (start) / n;
+
+  std::vector<listing> slab;
+  slab.reserve (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      slab.emplace_back (apartments[i], i);
+    }
+  AVL intrusive;
+  start = bench_clock::now ();
+  for (listing &curr : slab)
+    {
+      intrusive.insert_node (&curr.hook);
+    }
+  double link_ns = ns_since (start) / n;
+  if (!intrusive.validate ())
+    {
+      std::cerr << "intrusive tree is not a legal AVL tree" << std::endl;
+    }
+  start = bench_clock::now ();
+  for (listing &curr : slab)
+    {
+      intrusive.erase_node (&curr.hook);
+    }
+  double unlink_ns = ns_since (start) / n;
+
+  std::cout << "intrusive n=" << n << std::endl
+            << "  insert / erase by copy (ns/op) = " << copy_insert_ns
+            << " / " << copy_erase_ns << std::endl
+            << "  insert_node / erase_node (ns/op) = " << link_ns << " / "
+            << unlink_ns << std::endl;
+}
+
+/**
+ * Compares looking apartments up by an Apartment, by raw coordinates and by
+ * precomputed sort keys
+ * @param n number of apartments
+ */
+void bench_keyed (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  AVL avl (coordinates);
+  std::shuffle (coordinates.begin (), coordinates.end (),
+                std::mt19937 (BENCH_SEED));
+  std::vector<Apartment> queries (coordinates.begin (), coordinates.end ());
+  std::vector<double> keys;
+  keys.reserve (n);
+  for (const Apartment &query : queries)
+    {
+      keys.push_back (avl.get_context ().key (query));
+    }
+
+  double apartment_ns = time_lookups (avl, queries);
+  size_t found = 0;
+  auto start = bench_clock::now ();
+  for (const auto &pair : coordinates)
+    {
+      found += avl.contains (pair.first, pair.second);
+    }
+  double coordinates_ns = ns_since (start) / n;
+  start = bench_clock::now ();
+  for (double key : keys)
+    {
+      found += avl.contains_key (key);
+    }
+  double key_ns = ns_since (start) / n;
+  if (found != 2 * n)
+    {
+      std::cerr << "keyed benchmark lost apartments" << std::endl;
+    }
+
+  std::cout << "keyed n=" << n << std::endl
+            << "  find (apartment) (ns/op) = " << apartment_ns << std::endl
+            << "  contains (x, y) (ns/op) = " << coordinates_ns << std::endl
+            << "  contains_key (ns/op) = " << key_ns << std::endl;
+}
+
+/**
+ * Looks up scraped listings of which MISS_PERCENT are new, without a
+ * membership filter and with filters of a few false positive rates
+ * @param avl tree of the known listings, its filter is replaced
+ * @param queries scraped listings
+ * @param label name of the query set
+ */
+void time_filter (AVL &avl, const std::vector<Apartment> &queries,
+                  const std::string &label)
+{
+  size_t n = queries.size ();
+  for (double rate : std::vector<double> FILTER_RATES)
+    {
+      avl.set_filter (0, 0);
+      size_t found = 0;
+      auto start = bench_clock::now ();
+      for (const Apartment &query : queries)
+        {
+          found += (avl.find (query) != avl.end ());
+        }
+      double plain_ns = ns_since (start) / n;
+
+      avl.set_filter (n, rate);
+      size_t filtered_found = 0;
+      start = bench_clock::now ();
+      for (const Apartment &query : queries)
+        {
+          filtered_found += (avl.find (query) != avl.end ());
+        }
+      double filter_ns = ns_since (start) / n;
+      if (found != filtered_found)
+        {
+          std::cerr << "the filter lost apartments" << std::endl;
+        }
+
+      AVL::tree_stats stats = avl.stats ();
+      std::cout << "  " << label << ", rate " << rate << ": find (ns/op) = "
+                << plain_ns << " -> " << filter_ns << "  rejected = "
+                << 100.0 * stats.filter_rejects / n
+                << "%  false positives = "
+                << 100.0 * stats.filter_false_positives / (n - found)
+                << "% of absent  bytes/apartment = "
+                << (double) stats.filter_bytes / n << std::endl;
+    }
+}
+
+/**
+ * Checks scraped listings for new ones with and without a membership
+ * filter. The new listings come either from the neighbourhoods of the
+ * known ones, where they are packed closer than the cells of the filter, or
+ * from other neighbourhoods.
+ * @param n number of apartments
+ */
+void bench_filter (size_t n)
+{
+  auto coordinates = random_coordinates (2 * n, BENCH_SEED);
+  auto elsewhere = random_coordinates (n, BENCH_SEED + 1);
+  AVL avl (std::vector<std::pair<double, double>> (coordinates.begin (),
+                                                   coordinates.begin () + n));
+  std::vector<Apartment> nearby, remote;
+  nearby.reserve (n);
+  remote.reserve (n);
+  std::mt19937 gen (BENCH_SEED);
+  for (size_t i = 0; i < n; i++)
+    {
+      if (gen () % 100 < MISS_PERCENT)
+        {
+          nearby.emplace_back (coordinates[n + i]);
+          remote.emplace_back (elsewhere[i]);
+        }
+      else
+        {
+          size_t known = gen () % n;
+          nearby.emplace_back (coordinates[known]);
+          remote.emplace_back (coordinates[known]);
+        }
+    }
+
+  std::cout << "filter n=" << n << " new=" << MISS_PERCENT << "%"
+            << std::endl;
+  time_filter (avl, nearby, "same neighbourhoods");
+  time_filter (avl, remote, "other neighbourhoods");
+}
+
+/**
+ * Ingests a burst of apartments through write buffers of a few capacities
+ * (0 is a plain AVL insert), and then looks some of them up while the
+ * buffer is partly full
+ * @param n number of apartments
+ */
+void bench_buffered (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+  std::vector<Apartment> queries (apartments.begin (),
+                                  apartments.begin () + n / LOOKUP_PART);
+  std::shuffle (queries.begin (), queries.end (), std::mt19937 (BENCH_SEED));
+
+  std::cout << "buffered n=" << n << std::endl;
+  for (size_t capacity : std::vector<size_t> BUFFER_CAPACITIES)
+    {
+      BufferedAVL buffered (capacity);
+      auto start = bench_clock::now ();
+      for (const Apartment &apartment : apartments)
+        {
+          buffered.insert (apartment);
+        }
+      double ingest_ns = ns_since (start) / n;
+
+      size_t found = 0;
+      start = bench_clock::now ();
+      for (const Apartment &query : queries)
+        {
+          found += buffered.contains (query);
+        }
+      double lookup_ns = ns_since (start) / queries.size ();
+      if (found != queries.size ())
+        {
+          std::cerr << "buffered benchmark lost apartments" << std::endl;
+        }
+      std::cout << "  capacity " << capacity << ": insert (ns/op) = "
+                << ingest_ns << "  lookup (ns/op) = " << lookup_ns
+                << "  buffered = " << buffered.buffered () << std::endl;
+    }
+}
+
+/**
+ * Compares inserts into a plain AVL with logged inserts into a DurableAVL
+ * for a few commit group sizes, and times replaying the log, a full
+ * checkpoint, a delta checkpoint after moving n / CHURN_PART apartments
+ * and loading both. Syncing every update is measured on at most
+ * SYNCED_UPDATES apartments.
+ * @param n number of apartments
+ */
+void bench_durable (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+
+  AVL plain;
+  auto start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      plain.insert (apartment);
+    }
+  std::cout << "durable n=" << n << std::endl;
+  std::cout << "  unlogged: insert (ns/op) = " << ns_since (start) / n
+            << std::endl;
+
+  for (size_t group : std::vector<size_t> COMMIT_GROUPS)
+    {
+      size_t updates = (group == 1) ? std::min (n, (size_t) SYNCED_UPDATES)
+                                    : n;
+      DurableAVL::remove_files (DURABLE_PATH);
+      DurableAVL durable (DURABLE_PATH, group);
+      start = bench_clock::now ();
+      for (size_t i = 0; i < updates; i++)
+        {
+          durable.insert (apartments[i]);
+        }
+      durable.commit ();
+      std::cout << "  group " << group << ": insert (ns/op) = "
+                << ns_since (start) / updates << "  on " << updates
+                << std::endl;
+    }
+
+  double replay_ms, full_ms, delta_ms;
+  size_t churn = std::max (n / CHURN_PART, (size_t) 1);
+  auto moved = random_coordinates (churn, BENCH_SEED + 1);
+  {
+    start = bench_clock::now ();
+    DurableAVL replayed (DURABLE_PATH);
+    replay_ms = ns_since (start) / 1e6;
+    start = bench_clock::now ();
+    replayed.checkpoint ();
+    full_ms = ns_since (start) / 1e6;
+    for (size_t i = 0; i < churn; i++)
+      {
+        replayed.erase (apartments[i]);
+        replayed.insert (Apartment (moved[i]));
+      }
+    start = bench_clock::now ();
+    replayed.checkpoint ();
+    delta_ms = ns_since (start) / 1e6;
+  }
+  start = bench_clock::now ();
+  DurableAVL loaded (DURABLE_PATH);
+  double load_ms = ns_since (start) / 1e6;
+  if (!loaded.contains (apartments.back ())
+      || !loaded.contains (Apartment (moved.back ())))
+    {
+      std::cerr << "durable benchmark lost apartments" << std::endl;
+    }
+  std::cout << "  replay log (ms) = " << replay_ms
+            << "  full checkpoint (ms) = " << full_ms << std::endl;
+  std::cout << "  delta checkpoint after " << churn << " moves (ms) = "
+            << delta_ms << "  load base and delta (ms) = " << load_ms
+            << std::endl;
+  DurableAVL::remove_files (DURABLE_PATH);
+}
+
+/**
+ * Bounding box of apartments, the value of the parallel reduction
+ */
+struct bounding_box {
+    double min_x, min_y, max_x, max_y;
+
+    /**
+     * @param other box to add
+     * @return the smallest box that holds this box and other
+     */
+    bounding_box operator+ (const bounding_box &other) const
+    {
+      return {std::min (min_x, other.min_x), std::min (min_y, other.min_y),
+              std::max (max_x, other.max_x), std::max (max_y, other.max_y)};
+    }
+
+    /**
+     * @param other box to compare with
+     * @return true if the boxes are the same
+     */
+    bool operator== (const bounding_box &other) const
+    {
+      return min_x == other.min_x && min_y == other.min_y
+             && max_x == other.max_x && max_y == other.max_y;
+    }
+};
+
+/**
+ * @param apartment apartment to count
+ * @return index of the density histogram cell of the apartment, in a grid
+ * of HISTOGRAM_SIDE cells per side over HISTOGRAM_SPAN around feelbox
+ */
+size_t histogram_cell (const Apartment &apartment)
+{
+  double cell = HISTOGRAM_SPAN / HISTOGRAM_SIDE;
+  double x = (apartment.get_x () - X_FEEL_BOX) / cell + HISTOGRAM_SIDE / 2;
+  double y = (apartment.get_y () - Y_FEEL_BOX) / cell + HISTOGRAM_SIDE / 2;
+  size_t column = (size_t) std::min (std::max (x, 0.0),
+                                     HISTOGRAM_SIDE - 1.0);
+  size_t row = (size_t) std::min (std::max (y, 0.0), HISTOGRAM_SIDE - 1.0);
+  return row * HISTOGRAM_SIDE + column;
+}
+
+/**
+ * Times a bounding box (parallel_reduce) and a density histogram
+ * (parallel_for_each) over the tree for pools of 1 to 8 threads, next to
+ * the single threaded for_each_in_order
+ * @param n number of apartments
+ */
+void bench_parallel (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  AVL avl (coordinates);
+  const bounding_box empty_box = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+  auto box_of = [] (const Apartment &apartment)
+  {
+    return bounding_box {apartment.get_x (), apartment.get_y (),
+                         apartment.get_x (), apartment.get_y ()};
+  };
+  auto add = [] (const bounding_box &lhs, const bounding_box &rhs)
+  { return lhs + rhs; };
+
+  bounding_box expected = empty_box;
+  std::vector<size_t> expected_histogram (HISTOGRAM_SIDE * HISTOGRAM_SIDE);
+  auto start = bench_clock::now ();
+  avl.for_each_in_order ([&] (const Apartment &apartment)
+                         {
+                           expected = expected + box_of (apartment);
+                           expected_histogram[histogram_cell (apartment)]++;
+                         });
+  std::cout << "parallel n=" << n << " hardware threads="
+            << std::thread::hardware_concurrency () << std::endl;
+  std::cout << "  for_each_in_order: box and histogram (ms) = "
+            << ns_since (start) / 1e6 << std::endl;
+
+  for (size_t threads : std::vector<size_t> PARALLEL_THREADS)
+    {
+      WorkStealingPool pool (threads - 1);
+      start = bench_clock::now ();
+      bounding_box box = avl.parallel_reduce (pool, empty_box, box_of, add);
+      double reduce_ms = ns_since (start) / 1e6;
+
+      std::vector<std::atomic<size_t>> histogram (HISTOGRAM_SIDE
+                                                  * HISTOGRAM_SIDE);
+      start = bench_clock::now ();
+      avl.parallel_for_each (pool, [&histogram] (const Apartment &apartment)
+      {
+        histogram[histogram_cell (apartment)].fetch_add (
+            1, std::memory_order_relaxed);
+      });
+      double histogram_ms = ns_since (start) / 1e6;
+
+      bool same = (box == expected);
+      for (size_t i = 0; i < histogram.size (); i++)
+        {
+          same = same && histogram[i] == expected_histogram[i];
+        }
+      if (!same)
+        {
+          std::cerr << "parallel benchmark got a different result"
+                    << std::endl;
+        }
+      std::cout << "  threads=" << threads << ": box (ms) = " << reduce_ms
+                << "  histogram (ms) = " << histogram_ms << std::endl;
+    }
+}
+
+/**
+ * Compares map viewport queries (AVL::query_rect) on square viewports
+ * centred on random apartments with a scan of the whole tree. The pruning
+ * by bounding boxes is only there when built with AVL_BOUNDING_BOXES.
+ * @param n number of apartments
+ */
+void bench_rect (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  AVL avl (coordinates);
+#ifdef AVL_BOUNDING_BOXES
+  const char *boxes = "on";
+#else
+  const char *boxes = "off";
+#endif
+  std::cout << "rect n=" << n << " bounding boxes " << boxes
+            << " node bytes=" << sizeof (AVL::node) << std::endl;
+
+  std::mt19937_64 gen (BENCH_SEED);
+  for (double side : std::vector<double> VIEWPORT_SIDES)
+    {
+      std::vector<std::pair<double, double>> centers;
+      for (size_t i = 0; i < VIEWPORT_QUERIES; i++)
+        {
+          centers.push_back (coordinates[gen () % n]);
+        }
+
+      size_t scanned = 0;
+      auto start = bench_clock::now ();
+      for (size_t i = 0; i < VIEWPORT_SCANS; i++)
+        {
+          double x = centers[i].first, y = centers[i].second;
+          avl.for_each_in_order ([&] (const Apartment &apartment)
+                                 {
+                                   scanned += std::abs (apartment.get_x () - x)
+                                              <= side / 2
+                                              && std::abs (apartment.get_y ()
+                                                           - y) <= side / 2;
+                                 });
+        }
+      double scan_us = ns_since (start) / 1e3 / VIEWPORT_SCANS;
+
+      size_t found = 0, checked = 0;
+      start = bench_clock::now ();
+      for (size_t i = 0; i < VIEWPORT_QUERIES; i++)
+        {
+          double x = centers[i].first, y = centers[i].second;
+          avl.query_rect (x - side / 2, y - side / 2, x + side / 2,
+                          y + side / 2, [&found] (const Apartment &)
+                          { found++; });
+          if (i + 1 == VIEWPORT_SCANS)
+            {
+              checked = found;
+            }
+        }
+      double query_us = ns_since (start) / 1e3 / VIEWPORT_QUERIES;
+      if (checked != scanned)
+        {
+          std::cerr << "rect benchmark found different apartments"
+                    << std::endl;
+        }
+      std::cout << "  side=" << side << " apartments/query="
+                << found / VIEWPORT_QUERIES << ": scan (us) = " << scan_us
+                << "  query_rect (us) = " << query_us << std::endl;
+    }
+}
+
+/**
+ * Times the viewport queries of bench_rect on one tree
+ * @param avl tree to query
+ * @param centers centres of the viewports
+ * @param side side of the viewports
+ * @param found number of apartments found, added to
+ * @return average microseconds per query
+ */
+double time_viewports (const AVL &avl,
+                       const std::vector<std::pair<double, double>> &centers,
+                       double side, size_t &found)
+{
+  auto start = bench_clock::now ();
+  for (const auto &center : centers)
+    {
+      avl.query_rect (center.first - side / 2, center.second - side / 2,
+                      center.first + side / 2, center.second + side / 2,
+                      [&found] (const Apartment &)
+                      { found++; });
+    }
+  return ns_since (start) / 1e3 / centers.size ();
+}
+
+/**
+ * Compares a tree in Z order (OrderingContext::morton ()) with the tree in
+ * the distance order: inserts, lookups and viewport queries, the queries
+ * before and after compact ()
+ * @param n number of apartments
+ */
+void bench_morton (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+  std::vector<Apartment> queries = apartments;
+  std::shuffle (queries.begin (), queries.end (), std::mt19937 (BENCH_SEED));
+  std::mt19937_64 gen (BENCH_SEED);
+  std::vector<std::pair<double, double>> centers;
+  for (size_t i = 0; i < VIEWPORT_QUERIES; i++)
+    {
+      centers.push_back (coordinates[gen () % n]);
+    }
+
+  std::cout << "morton n=" << n << std::endl;
+  for (bool morton : {false, true})
+    {
+      AVL avl (morton ? OrderingContext::morton () : OrderingContext ());
+      auto start = bench_clock::now ();
+      for (const Apartment &apartment : apartments)
+        {
+          avl.insert (apartment);
+        }
+      double insert_ns = ns_since (start) / n;
+      double find_ns = time_lookups (avl, queries);
+      std::cout << "  " << (morton ? "z order" : "distance") << ": insert "
+                << insert_ns << " find " << find_ns << " (ns/op)"
+                << std::endl;
+
+      std::vector<double> sides VIEWPORT_SIDES;
+      std::vector<double> before_us;
+      std::vector<size_t> found (sides.size ());
+      for (size_t i = 0; i < sides.size (); i++)
+        {
+          before_us.push_back (time_viewports (avl, centers, sides[i],
+                                               found[i]));
+        }
+      avl.compact ();
+      for (size_t i = 0; i < sides.size (); i++)
+        {
+          double after_us = time_viewports (avl, centers, sides[i], found[i]);
+          std::cout << "    side=" << sides[i] << " apartments/query="
+                    << found[i] / (2 * VIEWPORT_QUERIES)
+                    << ": query_rect (us) = " << before_us[i]
+                    << "  after compact (us) = " << after_us << std::endl;
+        }
+    }
+}
+
+/**
+ * Times the Apartment operations that APARTMENT_FIXED_POINT changes:
+ * sorting with operator<, equality scans and an AVL built from the
+ * apartments. Build once with and once without the flag to compare.
+ * @param n number of apartments
+ */
+void bench_fixed (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+  std::vector<Apartment> queries = apartments;
+  std::shuffle (queries.begin (), queries.end (), std::mt19937 (BENCH_SEED));
+#ifdef APARTMENT_FIXED_POINT
+  const char *mode = "fixed point";
+#else
+  const char *mode = "double";
+#endif
+  std::cout << "fixed n=" << n << " " << mode << " apartment bytes="
+            << sizeof (Apartment) << " node bytes=" << sizeof (AVL::node)
+            << std::endl;
+
+  std::vector<Apartment> sorted = queries;
+  auto start = bench_clock::now ();
+  std::sort (sorted.begin (), sorted.end ());
+  double sort_ms = ns_since (start) / 1e6;
+
+  size_t equal = 0;
+  start = bench_clock::now ();
+  for (size_t i = 0; i < LOOKUP_PART; i++)
+    {
+      const Apartment &query = queries[i];
+      for (const Apartment &apartment : apartments)
+        {
+          equal += (apartment == query);
+        }
+    }
+  double scan_ns = ns_since (start) / (LOOKUP_PART * n);
+
+  AVL avl;
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      avl.insert (apartment);
+    }
+  double insert_ns = ns_since (start) / n;
+  double find_ns = time_lookups (avl, queries);
+  if (equal < LOOKUP_PART)
+    {
+      std::cerr << "fixed benchmark lost apartments" << std::endl;
+    }
+  std::cout << "  sort (ms) = " << sort_ms << "  operator== (ns/op) = "
+            << scan_ns << std::endl
+            << "  AVL insert " << insert_ns << " find " << find_ns
+            << " (ns/op)" << std::endl;
+}
+
+/**
+ * Compares AVL with CompactAVL, whose nodes link by 32 bit indices and keep
+ * a balance factor instead of the height: node size, bytes per apartment
+ * and the time of insert, find and erase
+ * @param n number of apartments
+ */
+void bench_indexed (size_t n)
+{
+  auto coordinates = random_coordinates (n, BENCH_SEED);
+  std::vector<Apartment> apartments (coordinates.begin (), coordinates.end ());
+  std::vector<Apartment> queries = apartments;
+  std::shuffle (queries.begin (), queries.end (), std::mt19937 (BENCH_SEED));
+
+  AVL avl;
+  auto start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      avl.insert (apartment);
+    }
+  double avl_insert_ns = ns_since (start) / n;
+  double avl_find_ns = time_lookups (avl, queries);
+  size_t avl_bytes = avl.stats ().node_bytes;
+
+  CompactAVL compact;
+  start = bench_clock::now ();
+  for (const Apartment &apartment : apartments)
+    {
+      compact.insert (apartment);
+    }
+  double compact_insert_ns = ns_since (start) / n;
+  size_t found = 0;
+  start = bench_clock::now ();
+  for (const Apartment &query : queries)
+    {
+      found += compact.contains (query);
+    }
+  double compact_find_ns = ns_since (start) / n;
+  size_t compact_bytes = compact.bytes ();
+  if (found != n)
+    {
+      std::cerr << "indexed benchmark lost apartments" << std::endl;
+    }
+
+  start = bench_clock::now ();
+  for (const Apartment &query : queries)
+    {
+      avl.erase (query);
+    }
+  double avl_erase_ns = ns_since (start) / n;
+  start = bench_clock::now ();
+  for (const Apartment &query : queries)
+    {
+      compact.erase (query);
+    }
+  double compact_erase_ns = ns_since (start) / n;
+
+  std::cout << "indexed n=" << n << std::endl
+            << "  AVL: node bytes=" << sizeof (AVL::node)
+            << " bytes/apartment=" << (double) avl_bytes / n << " insert "
+            << avl_insert_ns << " find " << avl_find_ns << " erase "
+            << avl_erase_ns << " (ns/op)" << std::endl
+            << "  CompactAVL: node bytes=" << sizeof (CompactAVL::node)
+            << " bytes/apartment=" << (double) compact_bytes / n
+            << " insert " << compact_insert_ns << " find "
+            << compact_find_ns << " erase " << compact_erase_ns
+            << " (ns/op)" << std::endl;
+}
+
+/**
+ * Runs the benchmark named in argv[1] on argv[2] apartments
+ */
+int main (int argc, char *argv[])
+{
+  std::string name = (argc > 1) ? argv[1] : "all";
+  size_t n = (argc > 2) ? std::stoul (argv[2]) : DEFAULT_BENCH_SIZE;
+
+  bool all = (name == "all");
+  bool known = false;
+  if (all || name == "compact")
+    {
+      bench_compact (n);
+      known = true;
+    }
+  if (all || name == "btree")
+    {
+      bench_btree (n);
+      known = true;
+    }
+  if (all || name == "cache")
+    {
+      bench_cache (n);
+      known = true;
+    }
+  if (all || name == "expiry")
+    {
+      bench_expiry (n);
+      known = true;
+    }
+  if (all || name == "finger")
+    {
+      bench_finger (n);
+      known = true;
+    }
+  if (all || name == "sharded")
+    {
+      bench_sharded (n);
+      known = true;
+    }
+  if (all || name == "stack")
+    {
+      bench_stack (n);
+      known = true;
+    }
+  if (all || name == "push")
+    {
+      bench_push (n);
+      known = true;
+    }
+  if (all || name == "ingest")
+    {
+      bench_ingest (n);
+      known = true;
+    }
+  if (all || name == "topk")
+    {
+      bench_topk (n);
+      known = true;
+    }
+  if (all || name == "index")
+    {
+      bench_index (n);
+      known = true;
+    }
+  if (all || name == "intrusive")
+    {
+      bench_intrusive (n);
+      known = true;
+    }
+  if (all || name == "keyed")
+    {
+      bench_keyed (n);
+      known = true;
+    }
+  if (all || name == "filter")
+    {
+      bench_filter (n);
+      known = true;
+    }
+  if (all || name == "buffered")
+    {
+      bench_buffered (n);
+      known = true;
+    }
+  if (all || name == "durable")
+    {
+      bench_durable (n);
+      known = true;
+    }
+  if (all || name == "parallel")
+    {
+      bench_parallel (n);
+      known = true;
+    }
+  if (all || name == "rect")
+    {
+      bench_rect (n);
+      known = true;
+    }
+  if (all || name == "morton")
+    {
+      bench_morton (n);
+      known = true;
+    }
+  if (all || name == "fixed")
+    {
+      bench_fixed (n);
+      known = true;
+    }
+  if (all || name == "indexed")
+    {
+      bench_indexed (n);
+      known = true;
+    }
+
+  if (!known)
+    {
+      std::cerr << USAGE_MSG << std::endl;
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
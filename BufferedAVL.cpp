@@ -0,0 +1,265 @@
+#include "BufferedAVL.h"
+#include <cmath>
+
+/**
+ * Constructor. Constructs an empty tree ordered by the distance from
+ * feelbox, with a buffer of BUFFER_DEFAULT_CAPACITY apartments
+ */
+BufferedAVL::BufferedAVL () : BufferedAVL (BUFFER_DEFAULT_CAPACITY)
+{}
+
+/**
+ * Constructor. Constructs an empty tree ordered by the distance from
+ * feelbox
+ * @param capacity number of apartments the buffer holds before it is
+ * merged into the tree, 0 inserts straight into the tree
+ */
+BufferedAVL::BufferedAVL (size_t capacity) : _capacity (capacity)
+{
+  _buffer.reserve (capacity);
+  _next.reserve (capacity);
+  // at least two buckets per entry, and a power of 2
+  size_t buckets = 1;
+  while (buckets < 2 * capacity)
+    {
+      buckets <<= 1;
+    }
+  _buckets.assign (buckets, BUFFER_NO_ENTRY);
+}
+
+/**
+ * Constructor. Constructs an empty tree ordered by the distance from the
+ * reference point of context
+ * @param context reference point of the tree
+ * @param capacity number of apartments the buffer holds before it is
+ * merged into the tree, 0 inserts straight into the tree
+ */
+BufferedAVL::BufferedAVL (const OrderingContext &context, size_t capacity)
+    : BufferedAVL (capacity)
+{
+  _tree = AVL (context);
+}
+
+/**
+ * @param value coordinate
+ * @return the hash cell of the coordinate
+ */
+int64_t BufferedAVL::cell (double value)
+{
+  return (int64_t) std::floor (value / BUFFER_CELL);
+}
+
+/**
+ * @param cell_x cell of the x coordinate
+ * @param cell_y cell of the y coordinate
+ * @return index of the bucket of the cell
+ */
+size_t BufferedAVL::bucket (int64_t cell_x, int64_t cell_y) const
+{
+  uint64_t hash = (uint64_t) cell_x * BUFFER_HASH_X
+                  ^ (uint64_t) cell_y * BUFFER_HASH_Y;
+  size_t mask = _buckets.size () - 1;
+  return (size_t) (hash ^ (hash >> BUFFER_HASH_SHIFT)) & mask;
+}
+
+/**
+ * @param apartment apartment of the buffer
+ * @return the link to the first entry of the bucket of its cell
+ */
+uint32_t &BufferedAVL::head (const Apartment &apartment)
+{
+  return _buckets[bucket (cell (apartment.get_x ()),
+                          cell (apartment.get_y ()))];
+}
+
+/**
+ * removes an entry of the buffer from the chain of its bucket
+ * @param i index of the entry
+ */
+void BufferedAVL::unlink (uint32_t i)
+{
+  uint32_t *link = &head (_buffer[i]);
+  while (*link != i)
+    {
+      link = &_next[*link];
+    }
+  *link = _next[i];
+}
+
+/**
+ * @param apartment apartment to look for
+ * @return index of an apartment equal to apartment in the buffer, or the
+ * size of the buffer if there is none
+ */
+size_t BufferedAVL::find_in_buffer (const Apartment &apartment) const
+{
+  if (_buffer.empty ())
+    {
+      return 0;
+    }
+  double x = apartment.get_x (), y = apartment.get_y ();
+  int64_t cell_x = cell (x), cell_y = cell (y);
+  // an equal apartment is at most EPSILON (half a cell) away, so it is in
+  // this cell or in the neighbour on the closer side, on each axis
+  int64_t near_x = (x - cell_x * BUFFER_CELL < BUFFER_CELL / 2)
+                   ? cell_x - 1 : cell_x + 1;
+  int64_t near_y = (y - cell_y * BUFFER_CELL < BUFFER_CELL / 2)
+                   ? cell_y - 1 : cell_y + 1;
+  const int64_t cells[][2] = {{cell_x, cell_y}, {near_x, cell_y},
+                              {cell_x, near_y}, {near_x, near_y}};
+  for (const auto &curr_cell : cells)
+    {
+      for (uint32_t i = _buckets[bucket (curr_cell[0], curr_cell[1])];
+           i != BUFFER_NO_ENTRY; i = _next[i])
+        {
+          if (_buffer[i] == apartment)
+            {
+              return i;
+            }
+        }
+    }
+  return _buffer.size ();
+}
+
+/**
+ * @param apartment apartment to look for
+ * @return index of an apartment with exactly the coordinates of apartment
+ * in the buffer, or the size of the buffer if there is none
+ */
+size_t BufferedAVL::find_exact_in_buffer (const Apartment &apartment) const
+{
+  if (_buffer.empty ())
+    {
+      return 0;
+    }
+  // the same coordinates are always in the same cell
+  for (uint32_t i = _buckets[bucket (cell (apartment.get_x ()),
+                                     cell (apartment.get_y ()))];
+       i != BUFFER_NO_ENTRY; i = _next[i])
+    {
+      if (OrderingContext::same_coordinates (_buffer[i], apartment))
+        {
+          return i;
+        }
+    }
+  return _buffer.size ();
+}
+
+/**
+ * Inserts the apartment into the buffer, and merges the buffer into the
+ * tree if it is full
+ * @param apartment Apartment object to add
+ */
+void BufferedAVL::insert (const Apartment &apartment)
+{
+  if (_capacity == 0)
+    {
+      _tree.insert (apartment);
+      return;
+    }
+  uint32_t &first = head (apartment);
+  _next.push_back (first);
+  first = (uint32_t) _buffer.size ();
+  _buffer.push_back (apartment);
+  if (_buffer.size () >= _capacity)
+    {
+      flush ();
+    }
+}
+
+/**
+ * Erases the apartment (if it is in the buffer or in the tree)
+ * @param apartment Apartment object to erase
+ */
+void BufferedAVL::erase (const Apartment &apartment)
+{
+  // like AVL::erase, only the apartment itself, not a neighbour within
+  // EPSILON
+  size_t i = find_exact_in_buffer (apartment);
+  if (i == _buffer.size ())
+    {
+      _tree.erase (apartment);
+      return;
+    }
+  // the buffer is not ordered, fill the hole with the last apartment
+  uint32_t last = (uint32_t) _buffer.size () - 1;
+  unlink ((uint32_t) i);
+  if (i != last)
+    {
+      unlink (last);
+      _buffer[i] = _buffer[last];
+      uint32_t &first = head (_buffer[i]);
+      _next[i] = first;
+      first = (uint32_t) i;
+    }
+  _buffer.pop_back ();
+  _next.pop_back ();
+}
+
+/**
+ * Looks up an apartment in the tree and in the buffer
+ * @param apartment apartment to search
+ * @return pointer to the stored apartment equal to apartment, or nullptr.
+ * The pointer is valid until the next insert or erase.
+ */
+const Apartment *BufferedAVL::find (const Apartment &apartment) const
+{
+  AVL::const_iterator found = _tree.find (apartment);
+  if (found != _tree.end ())
+    {
+      return &*found;
+    }
+  size_t i = find_in_buffer (apartment);
+  return (i < _buffer.size ()) ? &_buffer[i] : nullptr;
+}
+
+/**
+ * @param apartment apartment to search
+ * @return true if the apartment is in the buffer or in the tree
+ */
+bool BufferedAVL::contains (const Apartment &apartment) const
+{
+  return find (apartment) != nullptr;
+}
+
+/**
+ * Merges the buffer into the tree
+ */
+void BufferedAVL::flush ()
+{
+  if (_buffer.empty ())
+    {
+      return;
+    }
+  _tree.insert_batch (_buffer);
+  _buffer.clear ();
+  _next.clear ();
+  _buckets.assign (_buckets.size (), BUFFER_NO_ENTRY);
+}
+
+/**
+ * @return number of apartments waiting in the buffer
+ */
+size_t BufferedAVL::buffered () const
+{
+  return _buffer.size ();
+}
+
+/**
+ * @return number of apartments the buffer holds before it is merged
+ */
+size_t BufferedAVL::capacity () const
+{
+  return _capacity;
+}
+
+/**
+ * Flushes the buffer and gives the tree of all the apartments. The tree
+ * can be searched and iterated like any AVL.
+ * @return the AVL tree of the apartments
+ */
+const AVL &BufferedAVL::by_distance ()
+{
+  flush ();
+  return _tree;
+}
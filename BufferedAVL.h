@@ -0,0 +1,192 @@
+#ifndef _BUFFEREDAVL_H_
+#define _BUFFEREDAVL_H_
+#include <cstdint>
+#include <vector>
+#include "AVL.h"
+
+#define BUFFER_DEFAULT_CAPACITY 65536
+#define BUFFER_CELL (2 * EPSILON)
+#define BUFFER_HASH_X 0x9E3779B97F4A7C15ULL
+#define BUFFER_HASH_Y 0xC2B2AE3D27D4EB4FULL
+#define BUFFER_HASH_SHIFT 29
+#define BUFFER_NO_ENTRY UINT32_MAX
+
+/**
+ * this class represents an AVL tree with a write buffer in front of it, for
+ * bursts of inserts like feed imports. An insert only appends the apartment
+ * to the buffer; when the buffer is full it is merged into the tree at once
+ * with AVL::insert_batch, so the tree is restructured once per batch and in
+ * order instead of once per apartment. The buffer is hashed by cells of
+ * 2 * EPSILON like ApartmentIndex, so a lookup searches the tree and then
+ * the four cells around the query in the buffer, in O(log n) expected time
+ * however large the buffer is.
+ * Erases are not buffered: an apartment that is still in the buffer is
+ * dropped from it, any other is erased from the tree right away. Whole
+ * tree operations (the traversals and by_distance ()) flush the buffer
+ * first.
+ */
+class BufferedAVL {
+  AVL _tree;
+  std::vector<Apartment> _buffer;
+  std::vector<uint32_t> _next;
+  std::vector<uint32_t> _buckets;
+  size_t _capacity;
+
+  /**
+   * @param value coordinate
+   * @return the hash cell of the coordinate
+   */
+  static int64_t cell (double value);
+
+  /**
+   * @param cell_x cell of the x coordinate
+   * @param cell_y cell of the y coordinate
+   * @return index of the bucket of the cell
+   */
+  size_t bucket (int64_t cell_x, int64_t cell_y) const;
+
+  /**
+   * @param apartment apartment of the buffer
+   * @return the link to the first entry of the bucket of its cell
+   */
+  uint32_t &head (const Apartment &apartment);
+
+  /**
+   * removes an entry of the buffer from the chain of its bucket
+   * @param i index of the entry
+   */
+  void unlink (uint32_t i);
+
+  /**
+   * @param apartment apartment to look for
+   * @return index of an apartment equal to apartment in the buffer, or the
+   * size of the buffer if there is none
+   */
+  size_t find_in_buffer (const Apartment &apartment) const;
+
+  /**
+   * @param apartment apartment to look for
+   * @return index of an apartment with exactly the coordinates of apartment
+   * in the buffer, or the size of the buffer if there is none
+   */
+  size_t find_exact_in_buffer (const Apartment &apartment) const;
+
+ public:
+  /**
+   * Constructor. Constructs an empty tree ordered by the distance from
+   * feelbox, with a buffer of BUFFER_DEFAULT_CAPACITY apartments
+   */
+  BufferedAVL ();
+
+  /**
+   * Constructor. Constructs an empty tree ordered by the distance from
+   * feelbox
+   * @param capacity number of apartments the buffer holds before it is
+   * merged into the tree, 0 inserts straight into the tree
+   */
+  explicit BufferedAVL (size_t capacity);
+
+  /**
+   * Constructor. Constructs an empty tree ordered by the distance from the
+   * reference point of context
+   * @param context reference point of the tree
+   * @param capacity number of apartments the buffer holds before it is
+   * merged into the tree, 0 inserts straight into the tree
+   */
+  BufferedAVL (const OrderingContext &context, size_t capacity);
+
+  /**
+   * Inserts the apartment into the buffer, and merges the buffer into the
+   * tree if it is full
+   * @param apartment Apartment object to add
+   */
+  void insert (const Apartment &apartment);
+
+  /**
+   * Erases the apartment (if it is in the buffer or in the tree)
+   * @param apartment Apartment object to erase
+   */
+  void erase (const Apartment &apartment);
+
+  /**
+   * Looks up an apartment in the tree and in the buffer
+   * @param apartment apartment to search
+   * @return pointer to the stored apartment equal to apartment, or nullptr.
+   * The pointer is valid until the next insert or erase.
+   */
+  const Apartment *find (const Apartment &apartment) const;
+
+  /**
+   * @param apartment apartment to search
+   * @return true if the apartment is in the buffer or in the tree
+   */
+  bool contains (const Apartment &apartment) const;
+
+  /**
+   * Merges the buffer into the tree
+   */
+  void flush ();
+
+  /**
+   * @return number of apartments waiting in the buffer
+   */
+  size_t buffered () const;
+
+  /**
+   * @return number of apartments the buffer holds before it is merged
+   */
+  size_t capacity () const;
+
+  /**
+   * Flushes the buffer and gives the tree of all the apartments. The tree
+   * can be searched and iterated like any AVL.
+   * @return the AVL tree of the apartments
+   */
+  const AVL &by_distance ();
+
+  /**
+   * Flushes the buffer and calls f on every apartment in order, closest
+   * first
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_in_order (Function f);
+
+  /**
+   * Flushes the buffer and calls f in order on every apartment whose
+   * distance from the reference point is in [low, high]
+   * @param low smallest distance to visit
+   * @param high largest distance to visit
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_in_range (double low, double high, Function f);
+};
+
+/**
+ * Flushes the buffer and calls f on every apartment in order, closest
+ * first
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void BufferedAVL::for_each_in_order (Function f)
+{
+  flush ();
+  _tree.for_each_in_order (f);
+}
+
+/**
+ * Flushes the buffer and calls f in order on every apartment whose
+ * distance from the reference point is in [low, high]
+ * @param low smallest distance to visit
+ * @param high largest distance to visit
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void BufferedAVL::for_each_in_range (double low, double high, Function f)
+{
+  flush ();
+  _tree.for_each_in_range (low, high, f);
+}
+
+#endif //_BUFFEREDAVL_H_
@@ -0,0 +1,510 @@
+#include "CompactAVL.h"
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * Constructor. Constructs an empty tree ordered by the distance from
+ * feelbox
+ */
+CompactAVL::CompactAVL () : CompactAVL (OrderingContext ())
+{}
+
+/**
+ * Constructor. Constructs an empty tree ordered in the given context
+ * @param context reference point or Z order of the tree
+ */
+CompactAVL::CompactAVL (const OrderingContext &context)
+    : _context (context), _root (COMPACT_NIL), _free (COMPACT_NIL), _size (0)
+{}
+
+/**
+ * A constructor that receives a vector of pairs. Each such pair is an
+ * apartment that will inserted to the tree.
+ * @param coordinates vector of pairs
+ */
+CompactAVL::CompactAVL (
+    const std::vector<std::pair<double, double>> &coordinates)
+    : CompactAVL ()
+{
+  reserve (coordinates.size ());
+  for (const auto &point : coordinates)
+    {
+      insert (Apartment (point));
+    }
+}
+
+/**
+ * takes a node from the free list, or appends one
+ * @param apartment apartment of the node
+ * @param key float sort key of apartment
+ * @return index of the new node
+ */
+uint32_t CompactAVL::allocate (const Apartment &apartment, float key)
+{
+  if (_free != COMPACT_NIL)
+    {
+      uint32_t i = _free;
+      _free = _nodes[i].get_left ();
+      _nodes[i] = node (apartment, key);
+      return i;
+    }
+  if (_nodes.size () >= COMPACT_NIL)
+    {
+      throw std::length_error (COMPACT_FULL_MSG_ERROR);
+    }
+  _nodes.emplace_back (apartment, key);
+  return (uint32_t) (_nodes.size () - 1);
+}
+
+/**
+ * puts a node on the free list
+ * @param i index of the node
+ */
+void CompactAVL::release (uint32_t i)
+{
+  _nodes[i].left_ = _free;
+  _free = i;
+}
+
+/**
+ * @param data apartment to compare
+ * @param key exact sort key of data
+ * @param i index of a node
+ * @return true if data comes before the apartment of node i
+ */
+bool CompactAVL::before (const Apartment &data, double key, uint32_t i) const
+{
+  const node &curr = _nodes[i];
+  float float_key = (float) key;
+  if (float_key != curr.key)
+    {
+      return float_key < curr.key;
+    }
+  double node_key = _context.key (curr.data);
+  return key < node_key
+         || (key == node_key
+             && OrderingContext::coordinates_less (data, curr.data));
+}
+
+/**
+ * @param i root of a sub tree whose right child is the new root
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::rotate_left (uint32_t i)
+{
+  uint32_t right = _nodes[i].get_right ();
+  _nodes[i].set_right (_nodes[right].get_left ());
+  _nodes[right].set_left (i);
+  return right;
+}
+
+/**
+ * @param i root of a sub tree whose left child is the new root
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::rotate_right (uint32_t i)
+{
+  uint32_t left = _nodes[i].get_left ();
+  _nodes[i].set_left (_nodes[left].get_right ());
+  _nodes[left].set_right (i);
+  return left;
+}
+
+/**
+ * rebalances a sub tree whose left side is taller by 2
+ * @param i root of the sub tree
+ * @param same_height set to true if the sub tree keeps its height
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::fix_left (uint32_t i, bool &same_height)
+{
+  uint32_t left = _nodes[i].get_left ();
+  int left_balance = _nodes[left].get_balance ();
+  same_height = (left_balance == 0); // only after an erase
+  if (left_balance <= 0)
+    {
+      _nodes[i].set_balance (same_height ? -1 : 0);
+      _nodes[left].set_balance (same_height ? 1 : 0);
+      return rotate_right (i);
+    }
+  // the left child leans right, rotate its right child up twice
+  uint32_t middle = _nodes[left].get_right ();
+  int middle_balance = _nodes[middle].get_balance ();
+  _nodes[i].set_balance (middle_balance < 0 ? 1 : 0);
+  _nodes[left].set_balance (middle_balance > 0 ? -1 : 0);
+  _nodes[middle].set_balance (0);
+  _nodes[i].set_left (rotate_left (left));
+  return rotate_right (i);
+}
+
+/**
+ * rebalances a sub tree whose right side is taller by 2
+ * @param i root of the sub tree
+ * @param same_height set to true if the sub tree keeps its height
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::fix_right (uint32_t i, bool &same_height)
+{
+  uint32_t right = _nodes[i].get_right ();
+  int right_balance = _nodes[right].get_balance ();
+  same_height = (right_balance == 0); // only after an erase
+  if (right_balance >= 0)
+    {
+      _nodes[i].set_balance (same_height ? 1 : 0);
+      _nodes[right].set_balance (same_height ? -1 : 0);
+      return rotate_left (i);
+    }
+  // the right child leans left, rotate its left child up twice
+  uint32_t middle = _nodes[right].get_left ();
+  int middle_balance = _nodes[middle].get_balance ();
+  _nodes[i].set_balance (middle_balance > 0 ? -1 : 0);
+  _nodes[right].set_balance (middle_balance < 0 ? 1 : 0);
+  _nodes[middle].set_balance (0);
+  _nodes[i].set_right (rotate_right (right));
+  return rotate_left (i);
+}
+
+/**
+ * updates a node after its left sub tree grew by one
+ * @param i index of the node
+ * @param grew set to true if the sub tree of the node grew too
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::grow_left (uint32_t i, bool &grew)
+{
+  int balance = _nodes[i].get_balance ();
+  if (balance >= 0)
+    {
+      _nodes[i].set_balance (balance - 1);
+      grew = (balance == 0);
+      return i;
+    }
+  // after an insert the rotation gives back the old height
+  bool same_height;
+  grew = false;
+  return fix_left (i, same_height);
+}
+
+/**
+ * updates a node after its right sub tree grew by one
+ * @param i index of the node
+ * @param grew set to true if the sub tree of the node grew too
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::grow_right (uint32_t i, bool &grew)
+{
+  int balance = _nodes[i].get_balance ();
+  if (balance <= 0)
+    {
+      _nodes[i].set_balance (balance + 1);
+      grew = (balance == 0);
+      return i;
+    }
+  bool same_height;
+  grew = false;
+  return fix_right (i, same_height);
+}
+
+/**
+ * updates a node after its left sub tree shrank by one
+ * @param i index of the node
+ * @param shrank set to true if the sub tree of the node shrank too
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::shrink_left (uint32_t i, bool &shrank)
+{
+  int balance = _nodes[i].get_balance ();
+  if (balance <= 0)
+    {
+      _nodes[i].set_balance (balance + 1);
+      shrank = (balance < 0);
+      return i;
+    }
+  bool same_height;
+  uint32_t root = fix_right (i, same_height);
+  shrank = !same_height;
+  return root;
+}
+
+/**
+ * updates a node after its right sub tree shrank by one
+ * @param i index of the node
+ * @param shrank set to true if the sub tree of the node shrank too
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::shrink_right (uint32_t i, bool &shrank)
+{
+  int balance = _nodes[i].get_balance ();
+  if (balance >= 0)
+    {
+      _nodes[i].set_balance (balance - 1);
+      shrank = (balance > 0);
+      return i;
+    }
+  bool same_height;
+  uint32_t root = fix_left (i, same_height);
+  shrank = !same_height;
+  return root;
+}
+
+/**
+ * recursive func for insertion
+ * @param i root of the sub tree
+ * @param apartment apartment to add
+ * @param key exact sort key of apartment
+ * @param grew set to true if the sub tree grew
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::helper_insert (uint32_t i, const Apartment &apartment,
+                                    double key, bool &grew)
+{
+  if (i == COMPACT_NIL) // base case
+    {
+      grew = true;
+      return allocate (apartment, (float) key);
+    }
+  // the vector may grow below, so the node is indexed again afterwards
+  if (before (apartment, key, i))
+    {
+      uint32_t child = helper_insert (_nodes[i].get_left (), apartment, key,
+                                      grew);
+      _nodes[i].set_left (child);
+      return grew ? grow_left (i, grew) : i;
+    }
+  uint32_t child = helper_insert (_nodes[i].get_right (), apartment, key,
+                                  grew);
+  _nodes[i].set_right (child);
+  return grew ? grow_right (i, grew) : i;
+}
+
+/**
+ * unlinks the first node of a sub tree
+ * @param i root of the sub tree
+ * @param smallest set to the index of the unlinked node
+ * @param shrank set to true if the sub tree shrank
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::remove_smallest (uint32_t i, uint32_t &smallest,
+                                      bool &shrank)
+{
+  if (_nodes[i].get_left () == COMPACT_NIL) // base case
+    {
+      smallest = i;
+      shrank = true;
+      return _nodes[i].get_right ();
+    }
+  _nodes[i].set_left (remove_smallest (_nodes[i].get_left (), smallest,
+                                       shrank));
+  return shrank ? shrink_left (i, shrank) : i;
+}
+
+/**
+ * recursive func for erasing
+ * @param i root of the sub tree
+ * @param apartment apartment to erase
+ * @param key exact sort key of apartment
+ * @param shrank set to true if the sub tree shrank
+ * @param erased set to true if the apartment was found
+ * @return the new root of the sub tree
+ */
+uint32_t CompactAVL::helper_erase (uint32_t i, const Apartment &apartment,
+                                   double key, bool &shrank, bool &erased)
+{
+  if (i == COMPACT_NIL) // base case
+    {
+      shrank = false;
+      return i;
+    }
+  uint32_t left = _nodes[i].get_left ();
+  uint32_t right = _nodes[i].get_right ();
+  if (OrderingContext::same_coordinates (_nodes[i].data, apartment))
+    {
+      int balance = _nodes[i].get_balance ();
+      erased = true;
+      release (i);
+      if (left == COMPACT_NIL || right == COMPACT_NIL)
+        {
+          shrank = true;
+          return (left == COMPACT_NIL) ? right : left;
+        }
+      // the successor takes the place and the balance of the node
+      uint32_t successor;
+      uint32_t new_right = remove_smallest (right, successor, shrank);
+      _nodes[successor].set_left (left);
+      _nodes[successor].set_right (new_right);
+      _nodes[successor].set_balance (balance);
+      return shrank ? shrink_right (successor, shrank) : successor;
+    }
+  if (before (apartment, key, i))
+    {
+      _nodes[i].set_left (helper_erase (left, apartment, key, shrank,
+                                        erased));
+      return shrank ? shrink_left (i, shrank) : i;
+    }
+  _nodes[i].set_right (helper_erase (right, apartment, key, shrank, erased));
+  return shrank ? shrink_right (i, shrank) : i;
+}
+
+/**
+ * Inserts the apartment into the tree. Throws a length error if the tree
+ * already holds COMPACT_NIL apartments.
+ * @param apartment Apartment object to add to tree
+ */
+void CompactAVL::insert (const Apartment &apartment)
+{
+  bool grew;
+  _root = helper_insert (_root, apartment, _context.key (apartment), grew);
+  _size++;
+}
+
+/**
+ * Deletes the apartment with exactly the coordinates of apartment from
+ * the tree (if it is in that tree)
+ * @param apartment Apartment object to erase from the tree
+ */
+void CompactAVL::erase (const Apartment &apartment)
+{
+  bool shrank, erased = false;
+  _root = helper_erase (_root, apartment, _context.key (apartment), shrank,
+                        erased);
+  if (erased)
+    {
+      _size--;
+    }
+}
+
+/**
+ * @param data apartment to search
+ * @return pointer to a stored apartment equal to data, or nullptr. The
+ * pointer is valid until the next insert or erase.
+ */
+const Apartment *CompactAVL::find (const Apartment &data) const
+{
+  double key = _context.key (data);
+  uint32_t curr = _root;
+  while (curr != COMPACT_NIL)
+    {
+      if (_nodes[curr].data == data)
+        {
+          return &_nodes[curr].data;
+        }
+      curr = before (data, key, curr) ? _nodes[curr].get_left ()
+                                      : _nodes[curr].get_right ();
+    }
+  return nullptr;
+}
+
+/**
+ * @param data apartment to search
+ * @return true if the apartment is in the tree
+ */
+bool CompactAVL::contains (const Apartment &data) const
+{
+  return find (data) != nullptr;
+}
+
+/**
+ * @return number of apartments in the tree
+ */
+size_t CompactAVL::size () const
+{
+  return _size;
+}
+
+/**
+ * @return true if the tree is empty
+ */
+bool CompactAVL::empty () const
+{
+  return _size == 0;
+}
+
+/**
+ * Makes room for n apartments, so that inserting them does not move the
+ * nodes
+ * @param n number of apartments
+ */
+void CompactAVL::reserve (size_t n)
+{
+  _nodes.reserve (n);
+}
+
+/**
+ * Drops all the apartments
+ */
+void CompactAVL::clear ()
+{
+  _nodes.clear ();
+  _root = COMPACT_NIL;
+  _free = COMPACT_NIL;
+  _size = 0;
+}
+
+/**
+ * @return number of bytes allocated for the nodes
+ */
+size_t CompactAVL::bytes () const
+{
+  return _nodes.capacity () * sizeof (node);
+}
+
+/**
+ * recursive func that checks a sub tree (see validate)
+ * @param i root of the sub tree
+ * @param count incremented for every node
+ * @return the height of the sub tree, or -1 if it is not valid
+ */
+int CompactAVL::helper_validate (uint32_t i, size_t &count) const
+{
+  if (i == COMPACT_NIL) // base case
+    {
+      return 0;
+    }
+  count++;
+  const node &curr = _nodes[i];
+  if (curr.key != (float) _context.key (curr.data))
+    {
+      return -1;
+    }
+  uint32_t left = curr.get_left (), right = curr.get_right ();
+  if ((left != COMPACT_NIL && _context.less (curr.data, _nodes[left].data))
+      || (right != COMPACT_NIL
+          && _context.less (_nodes[right].data, curr.data)))
+    {
+      return -1;
+    }
+  int left_height = helper_validate (left, count);
+  int right_height = helper_validate (right, count);
+  if (left_height < 0 || right_height < 0
+      || right_height - left_height != curr.get_balance ())
+    {
+      return -1;
+    }
+  return 1 + std::max (left_height, right_height);
+}
+
+/**
+ * Checks the order of the apartments and the balance factors
+ * @return true if the tree is a valid AVL tree of size () apartments
+ */
+bool CompactAVL::validate () const
+{
+  size_t count = 0;
+  if (helper_validate (_root, count) < 0 || count != _size)
+    {
+      return false;
+    }
+  // the children checks above are local, check the whole order too
+  bool ordered = true;
+  const Apartment *previous = nullptr;
+  for_each_in_order ([this, &ordered, &previous] (const Apartment &curr)
+                     {
+                       if (previous != nullptr
+                           && _context.less (curr, *previous))
+                         {
+                           ordered = false;
+                         }
+                       previous = &curr;
+                     });
+  return ordered;
+}
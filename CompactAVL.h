@@ -0,0 +1,349 @@
+#ifndef _COMPACTAVL_H_
+#define _COMPACTAVL_H_
+#include <cstdint>
+#include <vector>
+#include "Apartment.h"
+#include "OrderingContext.h"
+
+#define COMPACT_NIL 0x7FFFFFFFU
+#define COMPACT_INDEX_MASK 0x7FFFFFFFU
+#define COMPACT_TALLER_BIT 0x80000000U
+#define COMPACT_FULL_MSG_ERROR "Error: the compact tree can not hold more \
+apartments"
+
+/**
+ * this class represents an AVL tree of apartments with a compact node
+ * layout, for sets that are too large for the 48 byte nodes of AVL. The
+ * nodes live in one vector and address each other by 31 bit indices
+ * instead of pointers, and a node keeps only the balance factor of its
+ * sub tree instead of the height: the top bit of each link tells whether
+ * the sub tree on that side is the taller one. With the cached float sort
+ * key a node is 32 bytes, and 20 bytes with the 8 byte apartments of
+ * APARTMENT_FIXED_POINT. Vector slots have no allocator header, and the
+ * tree holds up to COMPACT_NIL apartments.
+ * The order is the order of AVL in the same ordering context: the float
+ * key first, then the exact key, then the coordinates. find () returns an
+ * apartment equal to the query up to EPSILON like AVL::find, and erase ()
+ * removes only an apartment with exactly the coordinates of its argument,
+ * like AVL::erase. The nodes have no parent links, so there are no
+ * iterators; use for_each_in_order (). Copies are a copy of the vector.
+ */
+class CompactAVL {
+
+ public:
+  /**
+   * A node of the tree. left_ and right_ are indices of the children in
+   * the vector of nodes (COMPACT_NIL for none), and their top bits hold the
+   * balance factor. A free node links the next free node with left_.
+   */
+  struct node {
+      Apartment data;
+      float key;
+      uint32_t left_, right_;
+
+      /**
+       * Constructor. Constructs a leaf
+       * @param apartment apartment of the node
+       * @param apartment_key float sort key of apartment
+       */
+      node (const Apartment &apartment, float apartment_key)
+          : data (apartment), key (apartment_key), left_ (COMPACT_NIL),
+            right_ (COMPACT_NIL)
+      {}
+
+      /**
+       * @return index of the left child
+       */
+      uint32_t get_left () const
+      {
+        return left_ & COMPACT_INDEX_MASK;
+      }
+
+      /**
+       * @return index of the right child
+       */
+      uint32_t get_right () const
+      {
+        return right_ & COMPACT_INDEX_MASK;
+      }
+
+      /**
+       * set the left child, keeping the balance factor
+       * @param child index of the new left child
+       */
+      void set_left (uint32_t child)
+      {
+        left_ = (left_ & COMPACT_TALLER_BIT) | child;
+      }
+
+      /**
+       * set the right child, keeping the balance factor
+       * @param child index of the new right child
+       */
+      void set_right (uint32_t child)
+      {
+        right_ = (right_ & COMPACT_TALLER_BIT) | child;
+      }
+
+      /**
+       * @return the height of the right sub tree minus the height of the
+       * left one: -1, 0 or 1
+       */
+      int get_balance () const
+      {
+        return (int) (right_ >> 31) - (int) (left_ >> 31);
+      }
+
+      /**
+       * @param balance the height of the right sub tree minus the height of
+       * the left one: -1, 0 or 1
+       */
+      void set_balance (int balance)
+      {
+        left_ = (left_ & COMPACT_INDEX_MASK)
+                | ((balance < 0) ? COMPACT_TALLER_BIT : 0);
+        right_ = (right_ & COMPACT_INDEX_MASK)
+                 | ((balance > 0) ? COMPACT_TALLER_BIT : 0);
+      }
+  };
+
+  /**
+   * Constructor. Constructs an empty tree ordered by the distance from
+   * feelbox
+   */
+  CompactAVL ();
+
+  /**
+   * Constructor. Constructs an empty tree ordered in the given context
+   * @param context reference point or Z order of the tree
+   */
+  CompactAVL (const OrderingContext &context);
+
+  /**
+   * A constructor that receives a vector of pairs. Each such pair is an
+   * apartment that will inserted to the tree.
+   * @param coordinates vector of pairs
+   */
+  CompactAVL (const std::vector<std::pair<double, double>> &coordinates);
+
+  /**
+   * Inserts the apartment into the tree. Throws a length error if the tree
+   * already holds COMPACT_NIL apartments.
+   * @param apartment Apartment object to add to tree
+   */
+  void insert (const Apartment &apartment);
+
+  /**
+   * Deletes the apartment with exactly the coordinates of apartment from
+   * the tree (if it is in that tree)
+   * @param apartment Apartment object to erase from the tree
+   */
+  void erase (const Apartment &apartment);
+
+  /**
+   * @param data apartment to search
+   * @return pointer to a stored apartment equal to data, or nullptr. The
+   * pointer is valid until the next insert or erase.
+   */
+  const Apartment *find (const Apartment &data) const;
+
+  /**
+   * @param data apartment to search
+   * @return true if the apartment is in the tree
+   */
+  bool contains (const Apartment &data) const;
+
+  /**
+   * @return number of apartments in the tree
+   */
+  size_t size () const;
+
+  /**
+   * @return true if the tree is empty
+   */
+  bool empty () const;
+
+  /**
+   * Makes room for n apartments, so that inserting them does not move the
+   * nodes
+   * @param n number of apartments
+   */
+  void reserve (size_t n);
+
+  /**
+   * Drops all the apartments
+   */
+  void clear ();
+
+  /**
+   * @return number of bytes allocated for the nodes
+   */
+  size_t bytes () const;
+
+  /**
+   * Checks the order of the apartments and the balance factors
+   * @return true if the tree is a valid AVL tree of size () apartments
+   */
+  bool validate () const;
+
+  /**
+   * Calls f on every apartment in order, closest first
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_in_order (Function f) const;
+
+ private:
+  OrderingContext _context;
+  std::vector<node> _nodes;
+  uint32_t _root, _free;
+  size_t _size;
+
+  /**
+   * takes a node from the free list, or appends one
+   * @param apartment apartment of the node
+   * @param key float sort key of apartment
+   * @return index of the new node
+   */
+  uint32_t allocate (const Apartment &apartment, float key);
+
+  /**
+   * puts a node on the free list
+   * @param i index of the node
+   */
+  void release (uint32_t i);
+
+  /**
+   * @param data apartment to compare
+   * @param key exact sort key of data
+   * @param i index of a node
+   * @return true if data comes before the apartment of node i
+   */
+  bool before (const Apartment &data, double key, uint32_t i) const;
+
+  /**
+   * @param i root of a sub tree whose right child is the new root
+   * @return the new root of the sub tree
+   */
+  uint32_t rotate_left (uint32_t i);
+
+  /**
+   * @param i root of a sub tree whose left child is the new root
+   * @return the new root of the sub tree
+   */
+  uint32_t rotate_right (uint32_t i);
+
+  /**
+   * rebalances a sub tree whose left side is taller by 2
+   * @param i root of the sub tree
+   * @param same_height set to true if the sub tree keeps its height
+   * @return the new root of the sub tree
+   */
+  uint32_t fix_left (uint32_t i, bool &same_height);
+
+  /**
+   * rebalances a sub tree whose right side is taller by 2
+   * @param i root of the sub tree
+   * @param same_height set to true if the sub tree keeps its height
+   * @return the new root of the sub tree
+   */
+  uint32_t fix_right (uint32_t i, bool &same_height);
+
+  /**
+   * updates a node after its left sub tree grew by one
+   * @param i index of the node
+   * @param grew set to true if the sub tree of the node grew too
+   * @return the new root of the sub tree
+   */
+  uint32_t grow_left (uint32_t i, bool &grew);
+
+  /**
+   * updates a node after its right sub tree grew by one
+   * @param i index of the node
+   * @param grew set to true if the sub tree of the node grew too
+   * @return the new root of the sub tree
+   */
+  uint32_t grow_right (uint32_t i, bool &grew);
+
+  /**
+   * updates a node after its left sub tree shrank by one
+   * @param i index of the node
+   * @param shrank set to true if the sub tree of the node shrank too
+   * @return the new root of the sub tree
+   */
+  uint32_t shrink_left (uint32_t i, bool &shrank);
+
+  /**
+   * updates a node after its right sub tree shrank by one
+   * @param i index of the node
+   * @param shrank set to true if the sub tree of the node shrank too
+   * @return the new root of the sub tree
+   */
+  uint32_t shrink_right (uint32_t i, bool &shrank);
+
+  /**
+   * recursive func for insertion
+   * @param i root of the sub tree
+   * @param apartment apartment to add
+   * @param key exact sort key of apartment
+   * @param grew set to true if the sub tree grew
+   * @return the new root of the sub tree
+   */
+  uint32_t helper_insert (uint32_t i, const Apartment &apartment, double key,
+                          bool &grew);
+
+  /**
+   * recursive func for erasing
+   * @param i root of the sub tree
+   * @param apartment apartment to erase
+   * @param key exact sort key of apartment
+   * @param shrank set to true if the sub tree shrank
+   * @param erased set to true if the apartment was found
+   * @return the new root of the sub tree
+   */
+  uint32_t helper_erase (uint32_t i, const Apartment &apartment, double key,
+                         bool &shrank, bool &erased);
+
+  /**
+   * unlinks the first node of a sub tree
+   * @param i root of the sub tree
+   * @param smallest set to the index of the unlinked node
+   * @param shrank set to true if the sub tree shrank
+   * @return the new root of the sub tree
+   */
+  uint32_t remove_smallest (uint32_t i, uint32_t &smallest, bool &shrank);
+
+  /**
+   * recursive func that checks a sub tree (see validate)
+   * @param i root of the sub tree
+   * @param count incremented for every node
+   * @return the height of the sub tree, or -1 if it is not valid
+   */
+  int helper_validate (uint32_t i, size_t &count) const;
+};
+
+/**
+ * Calls f on every apartment in order, closest first
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void CompactAVL::for_each_in_order (Function f) const
+{
+  std::vector<uint32_t> path;
+  uint32_t curr = _root;
+  while (curr != COMPACT_NIL || !path.empty ())
+    {
+      if (curr != COMPACT_NIL)
+        {
+          path.push_back (curr);
+          curr = _nodes[curr].get_left ();
+          continue;
+        }
+      curr = path.back ();
+      path.pop_back ();
+      f (_nodes[curr].data);
+      curr = _nodes[curr].get_right ();
+    }
+}
+
+#endif //_COMPACTAVL_H_
@@ -0,0 +1,258 @@
+#include "ConcurrentStack.h"
+#include <new>
+#include <stdexcept>
+#define EMPTY_STACK_MSG_ERROR "Error: the stack is empty. illegal operation"
+#define TAG_SHIFT 32
+
+/**
+ * @param index index of the top node
+ * @param tag version of the top
+ * @return the top packed in one word
+ */
+static uint64_t pack (uint32_t index, uint32_t tag)
+{
+  return ((uint64_t) tag << TAG_SHIFT) | index;
+}
+
+/**
+ * @param top packed top
+ * @return index of the top node
+ */
+static uint32_t index_of (uint64_t top)
+{
+  return (uint32_t) top;
+}
+
+/**
+ * @param top packed top
+ * @return version of the top
+ */
+static uint32_t tag_of (uint64_t top)
+{
+  return (uint32_t) (top >> TAG_SHIFT);
+}
+
+/**
+ * Default constructor, constructs an empty stack
+ */
+ConcurrentStack::ConcurrentStack ()
+    : _head (pack (CSTACK_NIL, 0)), _free (pack (CSTACK_NIL, 0)), _fresh (0),
+      _size (0)
+{
+  for (auto &chunk : _chunks)
+    {
+      chunk.store (nullptr, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Constructor that gets vector of pairs, and pushes them as apartments to
+ * the stack, when the first pair is pushed first.
+ * @param coordinates vector of pairs
+ */
+ConcurrentStack::ConcurrentStack (
+    const std::vector<std::pair<double, double>> &coordinates)
+    : ConcurrentStack ()
+{
+  for (const auto &x : coordinates)
+    {
+      push (Apartment (x));
+    }
+}
+
+/**
+ * destructor, releases the chunks of nodes
+ */
+ConcurrentStack::~ConcurrentStack ()
+{
+  for (auto &chunk : _chunks)
+    {
+      delete[] chunk.load (std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @param index index of a node
+ * @return reference to the node
+ */
+ConcurrentStack::node &ConcurrentStack::at (uint32_t index) const
+{
+  node *chunk = _chunks[index >> CSTACK_CHUNK_SHIFT].load (
+      std::memory_order_acquire);
+  return chunk[index & (CSTACK_CHUNK_SIZE - 1)];
+}
+
+/**
+ * @return index of an unused node, from the free list or a fresh one
+ */
+uint32_t ConcurrentStack::allocate ()
+{
+  uint32_t index = pop_node (_free);
+  if (index != CSTACK_NIL)
+    {
+      return index;
+    }
+
+  index = _fresh.fetch_add (1, std::memory_order_relaxed);
+  size_t chunk_index = index >> CSTACK_CHUNK_SHIFT;
+  if (chunk_index >= CSTACK_MAX_CHUNKS)
+    {
+      throw std::bad_alloc ();
+    }
+  if (_chunks[chunk_index].load (std::memory_order_acquire) == nullptr)
+    {
+      // several threads may race to allocate the chunk, only one wins
+      node *chunk = new node[CSTACK_CHUNK_SIZE];
+      node *expected = nullptr;
+      if (!_chunks[chunk_index].compare_exchange_strong (
+          expected, chunk, std::memory_order_acq_rel))
+        {
+          delete[] chunk;
+        }
+    }
+  return index;
+}
+
+/**
+ * links the chain first .. last on top of a tagged stack
+ * @param top top of the stack to push to
+ * @param first index of the node that becomes the top
+ * @param last index of the bottom node of the chain
+ */
+void ConcurrentStack::push_chain (std::atomic<uint64_t> &top, uint32_t first,
+                                  uint32_t last)
+{
+  node &bottom = at (last);
+  uint64_t curr = top.load (std::memory_order_relaxed);
+  do
+    {
+      bottom.next.store (index_of (curr), std::memory_order_relaxed);
+    }
+  while (!top.compare_exchange_weak (curr, pack (first, tag_of (curr) + 1),
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed));
+}
+
+/**
+ * unlinks the top node of a tagged stack
+ * @param top top of the stack to pop from
+ * @return index of the popped node, or CSTACK_NIL if the stack is empty
+ */
+uint32_t ConcurrentStack::pop_node (std::atomic<uint64_t> &top)
+{
+  uint64_t curr = top.load (std::memory_order_acquire);
+  while (index_of (curr) != CSTACK_NIL)
+    {
+      // the node may be popped and reused by another thread meanwhile, then
+      // next is stale but the tag makes the exchange below fail
+      uint32_t next = at (index_of (curr)).next.load (
+          std::memory_order_relaxed);
+      if (top.compare_exchange_weak (curr, pack (next, tag_of (curr) + 1),
+                                     std::memory_order_acquire,
+                                     std::memory_order_acquire))
+        {
+          return index_of (curr);
+        }
+    }
+  return CSTACK_NIL;
+}
+
+/**
+ * Pushes an apartment to the top of the stack. Safe to call from several
+ * threads.
+ * @param apartment Apartment obj to push the stack
+ */
+void ConcurrentStack::push (const Apartment &apartment)
+{
+  uint32_t index = allocate ();
+  new (at (index).storage) Apartment (apartment);
+  // counted before it is visible, so size () never drops below zero
+  _size.fetch_add (1, std::memory_order_relaxed);
+  push_chain (_head, index, index);
+}
+
+/**
+ * Removes the item from the top of the stack if there is one. Safe to call
+ * from several threads.
+ * @param apartment set to the removed item
+ * @return true if an item was removed, false if the stack was empty
+ */
+bool ConcurrentStack::try_pop (Apartment &apartment)
+{
+  uint32_t index = pop_node (_head);
+  if (index == CSTACK_NIL)
+    {
+      return false;
+    }
+  apartment = at (index).value ();
+  _size.fetch_sub (1, std::memory_order_relaxed);
+  push_chain (_free, index, index);
+  return true;
+}
+
+/**
+ * Removes the item from the top of the stack. Calling this method with an
+ * empty stack will throw an out of range exception.
+ * @return the removed item
+ */
+Apartment ConcurrentStack::pop ()
+{
+  uint32_t index = pop_node (_head);
+  if (index == CSTACK_NIL)
+    {
+      throw std::out_of_range (EMPTY_STACK_MSG_ERROR);
+    }
+  Apartment apartment = at (index).value ();
+  _size.fetch_sub (1, std::memory_order_relaxed);
+  push_chain (_free, index, index);
+  return apartment;
+}
+
+/**
+ * Removes all the items of the stack in one operation, so a consumer can
+ * take a whole batch at once.
+ * @return the removed items, top most first
+ */
+std::vector<Apartment> ConcurrentStack::pop_all ()
+{
+  uint64_t curr = _head.load (std::memory_order_relaxed);
+  while (!_head.compare_exchange_weak (curr,
+                                       pack (CSTACK_NIL, tag_of (curr) + 1),
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed))
+    {}
+
+  // the detached chain belongs to this thread only
+  std::vector<Apartment> apartments;
+  uint32_t first = index_of (curr), last = CSTACK_NIL;
+  for (uint32_t index = first; index != CSTACK_NIL;
+       index = at (index).next.load (std::memory_order_relaxed))
+    {
+      apartments.push_back (at (index).value ());
+      last = index;
+    }
+  if (first != CSTACK_NIL)
+    {
+      _size.fetch_sub (apartments.size (), std::memory_order_relaxed);
+      push_chain (_free, first, last);
+    }
+  return apartments;
+}
+
+/**
+ * A method that returns true if the stack is empty and otherwise false.
+ * While other threads push or pop the answer may be stale.
+ */
+bool ConcurrentStack::empty () const
+{
+  return index_of (_head.load (std::memory_order_acquire)) == CSTACK_NIL;
+}
+
+/**
+ * A method that returns how many items are inside the stack.
+ * While other threads push or pop the answer may be stale.
+ */
+size_t ConcurrentStack::size () const
+{
+  return _size.load (std::memory_order_relaxed);
+}
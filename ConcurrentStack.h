@@ -0,0 +1,139 @@
+#ifndef _CONCURRENTSTACK_H_
+#define _CONCURRENTSTACK_H_
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "Apartment.h"
+
+#define CSTACK_CHUNK_SHIFT 14
+#define CSTACK_CHUNK_SIZE (1u << CSTACK_CHUNK_SHIFT)
+#define CSTACK_MAX_CHUNKS 4096
+#define CSTACK_NIL UINT32_MAX
+
+/**
+ * this class represents a stack of apartments that many threads may push to
+ * and pop from at the same time without a lock (a Treiber stack).
+ * The nodes live in chunks that are never freed while the stack exists, and
+ * are named by a 32 bit index. The top of the stack is one 64 bit word
+ * holding the index of the top node and a tag that grows on every change,
+ * so a compare and swap can not succeed on a top that was popped and pushed
+ * back in between (the ABA problem). Popped nodes go to a free list that is
+ * a Treiber stack of the same kind.
+ * Only pushing to a new chunk allocates memory.
+ */
+class ConcurrentStack {
+  /**
+   * A node of the stack. The apartment is written by the pushing thread
+   * before the node is published, and read only by the thread that popped
+   * it.
+   */
+  struct node {
+      alignas (Apartment) unsigned char storage[sizeof (Apartment)];
+      std::atomic<uint32_t> next;
+
+      /**
+       * @return reference to the apartment of the node
+       */
+      Apartment &value ()
+      {
+        return *reinterpret_cast<Apartment *> (storage);
+      }
+  };
+
+  std::atomic<uint64_t> _head;
+  std::atomic<uint64_t> _free;
+  std::atomic<uint32_t> _fresh;
+  std::atomic<size_t> _size;
+  std::atomic<node *> _chunks[CSTACK_MAX_CHUNKS];
+
+  /**
+   * @param index index of a node
+   * @return reference to the node
+   */
+  node &at (uint32_t index) const;
+
+  /**
+   * @return index of an unused node, from the free list or a fresh one
+   */
+  uint32_t allocate ();
+
+  /**
+   * links the chain first .. last on top of a tagged stack
+   * @param top top of the stack to push to
+   * @param first index of the node that becomes the top
+   * @param last index of the bottom node of the chain
+   */
+  void push_chain (std::atomic<uint64_t> &top, uint32_t first,
+                   uint32_t last);
+
+  /**
+   * unlinks the top node of a tagged stack
+   * @param top top of the stack to pop from
+   * @return index of the popped node, or CSTACK_NIL if the stack is empty
+   */
+  uint32_t pop_node (std::atomic<uint64_t> &top);
+
+ public:
+  /**
+   * Default constructor, constructs an empty stack
+   */
+  ConcurrentStack ();
+
+  /**
+   * Constructor that gets vector of pairs, and pushes them as apartments to
+   * the stack, when the first pair is pushed first.
+   * @param coordinates vector of pairs
+   */
+  ConcurrentStack (const std::vector<std::pair<double, double>> &coordinates);
+
+  /**
+   * destructor, releases the chunks of nodes
+   */
+  ~ConcurrentStack ();
+
+  ConcurrentStack (const ConcurrentStack &other) = delete;
+  ConcurrentStack &operator= (const ConcurrentStack &rhs) = delete;
+
+  /**
+   * Pushes an apartment to the top of the stack. Safe to call from several
+   * threads.
+   * @param apartment Apartment obj to push the stack
+   */
+  void push (const Apartment &apartment);
+
+  /**
+   * Removes the item from the top of the stack if there is one. Safe to call
+   * from several threads.
+   * @param apartment set to the removed item
+   * @return true if an item was removed, false if the stack was empty
+   */
+  bool try_pop (Apartment &apartment);
+
+  /**
+   * Removes the item from the top of the stack. Calling this method with an
+   * empty stack will throw an out of range exception.
+   * @return the removed item
+   */
+  Apartment pop ();
+
+  /**
+   * Removes all the items of the stack in one operation, so a consumer can
+   * take a whole batch at once.
+   * @return the removed items, top most first
+   */
+  std::vector<Apartment> pop_all ();
+
+  /**
+   * A method that returns true if the stack is empty and otherwise false.
+   * While other threads push or pop the answer may be stale.
+   */
+  bool empty () const;
+
+  /**
+   * A method that returns how many items are inside the stack.
+   * While other threads push or pop the answer may be stale.
+   */
+  size_t size () const;
+};
+
+#endif //_CONCURRENTSTACK_H_
@@ -0,0 +1,745 @@
+#include "DurableAVL.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#define WAL_OPEN_MSG_ERROR "Error: can not open the log of the tree"
+#define WAL_WRITE_MSG_ERROR "Error: can not write the log of the tree"
+#define WAL_SNAPSHOT_MSG_ERROR "Error: can not write the checkpoint of the \
+tree"
+#define WAL_CORRUPT_MSG_ERROR "Error: the checkpoint or the log of the tree \
+is corrupt"
+#define WAL_FILE_MODE 0644
+
+/**
+ * writes a whole buffer to a file, retrying short writes
+ * @param fd file descriptor to write to
+ * @param data bytes to write
+ * @param size number of bytes
+ * @return true if all the bytes were written
+ */
+static bool write_all (int fd, const char *data, size_t size)
+{
+  while (size > 0)
+    {
+      ssize_t written = ::write (fd, data, size);
+      if (written < 0)
+        {
+          return false;
+        }
+      data += written;
+      size -= (size_t) written;
+    }
+  return true;
+}
+
+/**
+ * @param path path of a file
+ * @return the content of the file, empty if it does not exist
+ */
+static std::vector<char> read_file (const std::string &path)
+{
+  std::ifstream in (path, std::ios::binary);
+  return std::vector<char> (std::istreambuf_iterator<char> (in),
+                            std::istreambuf_iterator<char> ());
+}
+
+/**
+ * @param magic magic number of the file
+ * @param generation generation of the file
+ * @return the header of a log or snapshot file
+ */
+static std::vector<char> make_header (uint32_t magic, uint64_t generation)
+{
+  std::vector<char> header (WAL_HEADER_SIZE);
+  std::memcpy (header.data (), &magic, sizeof (magic));
+  std::memcpy (header.data () + sizeof (magic), &generation,
+               sizeof (generation));
+  return header;
+}
+
+/**
+ * reads the header of a log or snapshot file
+ * @param content content of the file
+ * @param magic expected magic number
+ * @param generation set to the generation of the file
+ * @return true if the file starts with a header with the magic number
+ */
+static bool read_header (const std::vector<char> &content, uint32_t magic,
+                         uint64_t &generation)
+{
+  uint32_t file_magic;
+  if (content.size () < WAL_HEADER_SIZE)
+    {
+      return false;
+    }
+  std::memcpy (&file_magic, content.data (), sizeof (file_magic));
+  std::memcpy (&generation, content.data () + sizeof (file_magic),
+               sizeof (generation));
+  return file_magic == magic;
+}
+
+/**
+ * syncs the directory of a file, so a file renamed into it survives a
+ * crash
+ * @param path path of the file
+ * @return true if the directory was synced
+ */
+static bool sync_directory (const std::string &path)
+{
+  size_t slash = path.rfind ('/');
+  std::string directory = (slash == std::string::npos)
+                          ? "." : path.substr (0, slash + 1);
+  int fd = ::open (directory.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+  bool synced = (::fsync (fd) == 0);
+  ::close (fd);
+  return synced;
+}
+
+/**
+ * replaces a file with new content, so that a crash leaves either the old
+ * or the new file: the content is written to a temporary file and synced,
+ * and the temporary file is renamed over the file
+ * @param path path of the file
+ * @param content new content of the file
+ * @return true if the file was replaced
+ */
+static bool replace_file (const std::string &path,
+                          const std::vector<char> &content)
+{
+  std::string temp = path + WAL_TEMP_SUFFIX;
+  int fd = ::open (temp.c_str (), O_WRONLY | O_CREAT | O_TRUNC,
+                   WAL_FILE_MODE);
+  bool written = fd >= 0
+                 && write_all (fd, content.data (), content.size ())
+                 && ::fsync (fd) == 0;
+  if (fd >= 0)
+    {
+      written = (::close (fd) == 0) && written;
+    }
+  if (!written || std::rename (temp.c_str (), path.c_str ()) != 0
+      || !sync_directory (path))
+    {
+      std::remove (temp.c_str ());
+      return false;
+    }
+  return true;
+}
+
+/**
+ * appends the coordinates of an apartment to a file content
+ * @param content content to append to
+ * @param apartment apartment to append
+ */
+static void append_apartment (std::vector<char> &content,
+                              const Apartment &apartment)
+{
+  double coordinates[] = {apartment.get_x (), apartment.get_y ()};
+  const char *bytes = (const char *) coordinates;
+  content.insert (content.end (), bytes, bytes + sizeof (coordinates));
+}
+
+/**
+ * appends a number of apartments to a file content
+ * @param content content to append to
+ * @param count number to append
+ */
+static void append_count (std::vector<char> &content, uint64_t count)
+{
+  const char *bytes = (const char *) &count;
+  content.insert (content.end (), bytes, bytes + sizeof (count));
+}
+
+/**
+ * @param bytes coordinates of an apartment, as written by append_apartment
+ * @return the apartment
+ */
+static Apartment read_apartment (const char *bytes)
+{
+  std::pair<double, double> point;
+  std::memcpy (&point.first, bytes, sizeof (double));
+  std::memcpy (&point.second, bytes + sizeof (double), sizeof (double));
+  return Apartment (point);
+}
+
+/**
+ * finds an unchanged run of a delta in the apartments of the previous
+ * checkpoint. Identical apartments are next to each other in the order of
+ * the tree, so the run starts with the last first_copies copies of first
+ * from the group of first, and ends with the first last_copies copies of
+ * last from the group of last. A run of copies of one apartment may take
+ * any of them.
+ * @param run apartments in order
+ * @param from index of the first apartment that no earlier run took
+ * @param first first apartment of the run
+ * @param first_copies number of copies of first at the start of the run
+ * @param last last apartment of the run
+ * @param last_copies number of copies of last at the end of the run
+ * @param context ordering context of the tree
+ * @return the index of the first apartment of the run and the index after
+ * its last one. Throws a runtime error if the run is not there
+ */
+static std::pair<size_t, size_t> locate (const std::vector<Apartment> &run,
+                                         size_t from, const Apartment &first,
+                                         uint64_t first_copies,
+                                         const Apartment &last,
+                                         uint64_t last_copies,
+                                         const OrderingContext &context)
+{
+  auto less = [&context] (const Apartment &lhs, const Apartment &rhs)
+  { return context.less (lhs, rhs); };
+  auto first_group = std::equal_range (run.begin () + from, run.end (),
+                                       first, less);
+  if (first_copies == 0
+      || first_copies > (uint64_t) (first_group.second - first_group.first))
+    {
+      throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+    }
+  if (OrderingContext::same_coordinates (first, last))
+    {
+      size_t begin = first_group.first - run.begin ();
+      return std::make_pair (begin, begin + first_copies);
+    }
+  auto begin = first_group.second - first_copies;
+  auto last_group = std::equal_range (first_group.second, run.end (), last,
+                                      less);
+  if (last_copies == 0
+      || last_copies > (uint64_t) (last_group.second - last_group.first))
+    {
+      throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+    }
+  return std::make_pair (begin - run.begin (),
+                         last_group.first + last_copies - run.begin ());
+}
+
+/**
+ * applies a delta to the apartments of the previous checkpoint
+ * @param previous apartments of the previous checkpoint, in order
+ * @param content content of the delta file
+ * @param generation expected generation of the delta
+ * @param context ordering context of the tree
+ * @return the apartments of the checkpoint of the delta, in order
+ */
+static std::vector<Apartment> apply_delta (
+    const std::vector<Apartment> &previous, const std::vector<char> &content,
+    uint64_t generation, const OrderingContext &context)
+{
+  uint64_t file_generation;
+  if (!read_header (content, WAL_DELTA_MAGIC, file_generation)
+      || file_generation != generation)
+    {
+      throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+    }
+  std::vector<Apartment> next;
+  next.reserve (previous.size ());
+  size_t from = 0;
+  size_t curr = WAL_HEADER_SIZE;
+  while (curr < content.size ())
+    {
+      if (content[curr] == WAL_APARTMENT
+          && curr + WAL_RECORD_SIZE <= content.size ())
+        {
+          next.push_back (read_apartment (&content[curr + 1]));
+          curr += WAL_RECORD_SIZE;
+        }
+      else if (content[curr] == WAL_UNCHANGED
+               && curr + WAL_RANGE_SIZE <= content.size ())
+        {
+          const char *range = &content[curr + 1];
+          uint64_t first_copies, last_copies;
+          std::memcpy (&first_copies, range + 2 * sizeof (double),
+                       sizeof (first_copies));
+          std::memcpy (&last_copies, range + 4 * sizeof (double)
+                                     + sizeof (first_copies),
+                       sizeof (last_copies));
+          std::pair<size_t, size_t> found = locate (
+              previous, from, read_apartment (range), first_copies,
+              read_apartment (range + 2 * sizeof (double)
+                              + sizeof (first_copies)),
+              last_copies, context);
+          next.insert (next.end (), previous.begin () + found.first,
+                       previous.begin () + found.second);
+          from = found.second;
+          curr += WAL_RANGE_SIZE;
+        }
+      else
+        {
+          throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+        }
+    }
+  return next;
+}
+
+/**
+ * Constructor. Opens the tree stored at path, ordered by the distance
+ * from feelbox, committing every WAL_DEFAULT_GROUP updates
+ * @param path path of the tree, its files are path with WAL_LOG_SUFFIX,
+ * WAL_MANIFEST_SUFFIX, and WAL_SNAPSHOT_SUFFIX or WAL_DELTA_SUFFIX and a
+ * generation
+ */
+DurableAVL::DurableAVL (const std::string &path)
+    : DurableAVL (OrderingContext (), path, WAL_DEFAULT_GROUP)
+{}
+
+/**
+ * Constructor. Opens the tree stored at path, ordered by the distance
+ * from feelbox
+ * @param path path of the tree (see DurableAVL (const std::string &))
+ * @param group_size number of updates that are committed together when
+ * no one calls commit () earlier, 1 syncs every update
+ */
+DurableAVL::DurableAVL (const std::string &path, size_t group_size)
+    : DurableAVL (OrderingContext (), path, group_size)
+{}
+
+/**
+ * Constructor. Opens the tree stored at path, ordered by the distance
+ * from the reference point of context. A tree must be opened with the
+ * context it was created with.
+ * @param context reference point of the tree
+ * @param path path of the tree (see DurableAVL (const std::string &))
+ * @param group_size number of updates that are committed together when
+ * no one calls commit () earlier, 1 syncs every update
+ */
+DurableAVL::DurableAVL (const OrderingContext &context,
+                        const std::string &path, size_t group_size)
+    : _tree (context), _path (path), _log (-1), _generation (0), _base (0),
+      _full_next (true), _group_size ((group_size > 0) ? group_size : 1),
+      _logged (0), _durable (0), _syncing (false)
+{
+  load_checkpoint ();
+  replay_log ();
+}
+
+/**
+ * Destructor. Commits the pending updates and closes the log
+ */
+DurableAVL::~DurableAVL ()
+{
+  try
+    {
+      commit ();
+    }
+  catch (const std::runtime_error &)
+    {
+      // a destructor can not report the error, the updates since the last
+      // commit are lost as if the process crashed
+    }
+  ::close (_log);
+}
+
+/**
+ * @param suffix WAL_SNAPSHOT_SUFFIX or WAL_DELTA_SUFFIX
+ * @param generation generation of the file
+ * @return path of the snapshot or the delta of a generation
+ */
+std::string DurableAVL::file_of (const char *suffix,
+                                 uint64_t generation) const
+{
+  return _path + suffix + std::to_string (generation);
+}
+
+/**
+ * loads the base and the deltas named by the manifest of the path into
+ * the tree, if there is a manifest
+ */
+void DurableAVL::load_checkpoint ()
+{
+  std::vector<char> manifest = read_file (_path + WAL_MANIFEST_SUFFIX);
+  if (manifest.empty ())
+    {
+      return;
+    }
+  if (!read_header (manifest, WAL_MANIFEST_MAGIC, _generation)
+      || manifest.size () != WAL_HEADER_SIZE + sizeof (_base))
+    {
+      throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+    }
+  std::memcpy (&_base, manifest.data () + WAL_HEADER_SIZE, sizeof (_base));
+
+  std::vector<char> content = read_file (file_of (WAL_SNAPSHOT_SUFFIX,
+                                                  _base));
+  uint64_t generation, count;
+  if (!read_header (content, WAL_SNAPSHOT_MAGIC, generation)
+      || generation != _base
+      || content.size () < WAL_HEADER_SIZE + sizeof (count))
+    {
+      throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+    }
+  std::memcpy (&count, content.data () + WAL_HEADER_SIZE, sizeof (count));
+  const char *coordinates = content.data () + WAL_HEADER_SIZE
+                            + sizeof (count);
+  if (content.size () != WAL_HEADER_SIZE + sizeof (count)
+                         + count * 2 * sizeof (double))
+    {
+      throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+    }
+  std::vector<Apartment> apartments;
+  apartments.reserve (count);
+  for (uint64_t i = 0; i < count; i++)
+    {
+      apartments.push_back (read_apartment (coordinates));
+      coordinates += 2 * sizeof (double);
+    }
+
+  for (uint64_t delta = _base + 1; delta <= _generation; delta++)
+    {
+      apartments = apply_delta (apartments,
+                                read_file (file_of (WAL_DELTA_SUFFIX, delta)),
+                                delta, _tree.get_context ());
+    }
+  // the checkpoint is in order, so the batch builds a balanced tree at
+  // once. the tree is now the checkpoint, the next delta starts from it
+  _tree.insert_batch (apartments);
+  _tree.mark_unchanged ();
+  _full_next = false;
+}
+
+/**
+ * applies the log of the path to the tree, drops a torn record at its
+ * end, and opens the log for appending. A log of an older generation than
+ * the checkpoint is already in the checkpoint and is emptied.
+ */
+void DurableAVL::replay_log ()
+{
+  std::vector<char> content = read_file (_path + WAL_LOG_SUFFIX);
+  _log = ::open ((_path + WAL_LOG_SUFFIX).c_str (), O_WRONLY | O_CREAT,
+                 WAL_FILE_MODE);
+  if (_log < 0)
+    {
+      throw std::runtime_error (WAL_OPEN_MSG_ERROR);
+    }
+  uint64_t generation;
+  if (!read_header (content, WAL_LOG_MAGIC, generation)
+      || generation < _generation)
+    {
+      reset_log ();
+      return;
+    }
+  if (generation > _generation)
+    {
+      // the checkpoint that the log continues is missing
+      throw std::runtime_error (WAL_CORRUPT_MSG_ERROR);
+    }
+
+  size_t end = WAL_HEADER_SIZE;
+  while (end + WAL_RECORD_SIZE <= content.size ())
+    {
+      char operation = content[end];
+      std::pair<double, double> point;
+      std::memcpy (&point.first, &content[end + 1], sizeof (double));
+      std::memcpy (&point.second, &content[end + 1 + sizeof (double)],
+                   sizeof (double));
+      if (operation == WAL_INSERT)
+        {
+          _tree.insert (Apartment (point));
+        }
+      else if (operation == WAL_ERASE)
+        {
+          _tree.erase (Apartment (point));
+        }
+      else
+        {
+          break;
+        }
+      end += WAL_RECORD_SIZE;
+    }
+  // new records go right after the last whole one
+  if ((end != content.size () && ::ftruncate (_log, (off_t) end) != 0)
+      || ::lseek (_log, (off_t) end, SEEK_SET) < 0)
+    {
+      throw std::runtime_error (WAL_OPEN_MSG_ERROR);
+    }
+}
+
+/**
+ * empties the log and starts it with the header of the current
+ * generation
+ */
+void DurableAVL::reset_log ()
+{
+  std::vector<char> header = make_header (WAL_LOG_MAGIC, _generation);
+  if (::ftruncate (_log, 0) != 0 || ::lseek (_log, 0, SEEK_SET) < 0
+      || !write_all (_log, header.data (), header.size ())
+      || ::fsync (_log) != 0)
+    {
+      throw std::runtime_error (WAL_WRITE_MSG_ERROR);
+    }
+}
+
+/**
+ * appends a record to the pending group and commits the group if it is
+ * full. The caller holds the lock.
+ * @param lock the lock of the tree, held by the caller
+ * @param operation WAL_INSERT or WAL_ERASE
+ * @param apartment apartment of the operation
+ */
+void DurableAVL::log (std::unique_lock<std::mutex> &lock, char operation,
+                      const Apartment &apartment)
+{
+  char record[WAL_RECORD_SIZE];
+  double x = apartment.get_x (), y = apartment.get_y ();
+  record[0] = operation;
+  std::memcpy (record + 1, &x, sizeof (x));
+  std::memcpy (record + 1 + sizeof (x), &y, sizeof (y));
+  _pending.insert (_pending.end (), record, record + WAL_RECORD_SIZE);
+  _logged++;
+  // a group that is being written covers the records before it, this one
+  // waits for the next group
+  if (!_syncing && _pending.size () >= _group_size * WAL_RECORD_SIZE)
+    {
+      sync (lock);
+    }
+}
+
+/**
+ * writes and syncs the pending records until every record logged so far
+ * is durable. one thread writes a group while the others wait for it and
+ * then find their records already durable.
+ * @param lock the lock of the tree, held by the caller
+ */
+void DurableAVL::sync (std::unique_lock<std::mutex> &lock)
+{
+  uint64_t target = _logged;
+  while (_durable < target)
+    {
+      if (_syncing)
+        {
+          _synced.wait (lock);
+          continue;
+        }
+      // take the whole pending group, the other threads keep logging into
+      // the (empty) other buffer while it is written
+      _writing.clear ();
+      _writing.swap (_pending);
+      uint64_t end = _logged;
+      _syncing = true;
+      lock.unlock ();
+      bool written = write_all (_log, _writing.data (), _writing.size ())
+                     && ::fsync (_log) == 0;
+      lock.lock ();
+      _syncing = false;
+      _synced.notify_all ();
+      if (!written)
+        {
+          throw std::runtime_error (WAL_WRITE_MSG_ERROR);
+        }
+      _durable = end;
+    }
+}
+
+/**
+ * Inserts the apartment into the tree and logs it. The insert is durable
+ * after the next commit ().
+ * @param apartment Apartment object to add
+ */
+void DurableAVL::insert (const Apartment &apartment)
+{
+  std::unique_lock<std::mutex> lock (_lock);
+  _tree.insert (apartment);
+  log (lock, WAL_INSERT, apartment);
+}
+
+/**
+ * Erases the apartment from the tree (if it is in it) and logs it. The
+ * erase is durable after the next commit ().
+ * @param apartment Apartment object to erase
+ */
+void DurableAVL::erase (const Apartment &apartment)
+{
+  std::unique_lock<std::mutex> lock (_lock);
+  _tree.erase (apartment);
+  log (lock, WAL_ERASE, apartment);
+}
+
+/**
+ * @param apartment apartment to search
+ * @return true if the apartment is in the tree
+ */
+bool DurableAVL::contains (const Apartment &apartment) const
+{
+  std::lock_guard<std::mutex> lock (_lock);
+  return _tree.contains (apartment);
+}
+
+/**
+ * Makes every update made so far durable. Calling this method after an
+ * update and before acknowledging it gives group commit: concurrent
+ * callers share one fsync. Throws a runtime error if the log can not be
+ * written.
+ */
+void DurableAVL::commit ()
+{
+  std::unique_lock<std::mutex> lock (_lock);
+  sync (lock);
+}
+
+/**
+ * @return the content of a full snapshot of the tree
+ */
+std::vector<char> DurableAVL::full_snapshot () const
+{
+  std::vector<char> content = make_header (WAL_SNAPSHOT_MAGIC,
+                                           _generation + 1);
+  content.resize (WAL_HEADER_SIZE + sizeof (uint64_t));
+  uint64_t count = 0;
+  _tree.for_each_in_order ([&content, &count] (const Apartment &apartment)
+                           {
+                             append_apartment (content, apartment);
+                             count++;
+                           });
+  std::memcpy (content.data () + WAL_HEADER_SIZE, &count, sizeof (count));
+  return content;
+}
+
+/**
+ * @return the content of a delta of the tree since the last checkpoint.
+ * marks the tree unchanged.
+ */
+std::vector<char> DurableAVL::delta ()
+{
+  std::vector<char> content = make_header (WAL_DELTA_MAGIC,
+                                           _generation + 1);
+  _tree.collect_changes (
+      [&content] (const Apartment &apartment)
+      {
+        content.push_back (WAL_APARTMENT);
+        append_apartment (content, apartment);
+      },
+      [&content] (const Apartment &first, size_t first_copies,
+                  const Apartment &last, size_t last_copies)
+      {
+        content.push_back (WAL_UNCHANGED);
+        append_apartment (content, first);
+        append_count (content, first_copies);
+        append_apartment (content, last);
+        append_count (content, last_copies);
+      });
+  return content;
+}
+
+/**
+ * Saves the tree, as a delta or as a full snapshot, and empties the log,
+ * so the next open does not replay the updates made so far. Throws a
+ * runtime error if the checkpoint can not be written; the log is kept in
+ * that case, and the next checkpoint is a full snapshot.
+ */
+void DurableAVL::checkpoint ()
+{
+  std::unique_lock<std::mutex> lock (_lock);
+  // the log can not be emptied under a group that is being written
+  while (_syncing)
+    {
+      _synced.wait (lock);
+    }
+
+  uint64_t generation = _generation + 1;
+  bool full = _full_next || generation - _base > WAL_MAX_DELTAS;
+  // collecting a delta forgets the changes, if it is not written the next
+  // checkpoint has to be full
+  _full_next = true;
+  bool written = full
+                 ? replace_file (file_of (WAL_SNAPSHOT_SUFFIX, generation),
+                                 full_snapshot ())
+                 : replace_file (file_of (WAL_DELTA_SUFFIX, generation),
+                                 delta ());
+  uint64_t base = full ? generation : _base;
+  std::vector<char> manifest = make_header (WAL_MANIFEST_MAGIC, generation);
+  manifest.resize (WAL_HEADER_SIZE + sizeof (base));
+  std::memcpy (manifest.data () + WAL_HEADER_SIZE, &base, sizeof (base));
+  if (!written || !replace_file (_path + WAL_MANIFEST_SUFFIX, manifest))
+    {
+      throw std::runtime_error (WAL_SNAPSHOT_MSG_ERROR);
+    }
+
+  // from here on the checkpoint holds every update, a crash before the log
+  // is reset leaves a log of the old generation, which is ignored
+  if (full)
+    {
+      _tree.mark_unchanged ();
+      for (uint64_t old = _base; old < generation; old++)
+        {
+          std::remove (file_of ((old == _base) ? WAL_SNAPSHOT_SUFFIX
+                                               : WAL_DELTA_SUFFIX,
+                                old).c_str ());
+        }
+    }
+  _full_next = false;
+  _generation = generation;
+  _base = base;
+  _pending.clear ();
+  _durable = _logged;
+  reset_log ();
+}
+
+/**
+ * @return number of deltas on top of the base, that the next open
+ * applies
+ */
+uint64_t DurableAVL::deltas () const
+{
+  std::lock_guard<std::mutex> lock (_lock);
+  return _generation - _base;
+}
+
+/**
+ * Removes every file of the tree stored at path. The tree must not be
+ * open.
+ * @param path path of the tree (see DurableAVL (const std::string &))
+ */
+void DurableAVL::remove_files (const std::string &path)
+{
+  std::vector<char> manifest = read_file (path + WAL_MANIFEST_SUFFIX);
+  uint64_t generation, base;
+  if (read_header (manifest, WAL_MANIFEST_MAGIC, generation)
+      && manifest.size () == WAL_HEADER_SIZE + sizeof (base))
+    {
+      std::memcpy (&base, manifest.data () + WAL_HEADER_SIZE, sizeof (base));
+      std::remove ((path + WAL_SNAPSHOT_SUFFIX
+                    + std::to_string (base)).c_str ());
+      for (uint64_t delta = base + 1; delta <= generation; delta++)
+        {
+          std::remove ((path + WAL_DELTA_SUFFIX
+                        + std::to_string (delta)).c_str ());
+        }
+    }
+  std::remove ((path + WAL_MANIFEST_SUFFIX).c_str ());
+  std::remove ((path + WAL_LOG_SUFFIX).c_str ());
+}
+
+/**
+ * @return number of updates logged since the tree was opened
+ */
+uint64_t DurableAVL::logged () const
+{
+  std::lock_guard<std::mutex> lock (_lock);
+  return _logged;
+}
+
+/**
+ * @return number of updates logged since the tree was opened that are
+ * durable
+ */
+uint64_t DurableAVL::durable () const
+{
+  std::lock_guard<std::mutex> lock (_lock);
+  return _durable;
+}
+
+/**
+ * The tree of the apartments. It can be searched and iterated like any
+ * AVL, but not while other threads update the DurableAVL.
+ * @return the AVL tree of the apartments
+ */
+const AVL &DurableAVL::by_distance () const
+{
+  return _tree;
+}
@@ -0,0 +1,230 @@
+#ifndef _DURABLEAVL_H_
+#define _DURABLEAVL_H_
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AVL.h"
+
+#define WAL_DEFAULT_GROUP 1024
+#define WAL_MAX_DELTAS 16
+#define WAL_LOG_SUFFIX ".log"
+#define WAL_MANIFEST_SUFFIX ".manifest"
+#define WAL_SNAPSHOT_SUFFIX ".snapshot."
+#define WAL_DELTA_SUFFIX ".delta."
+#define WAL_TEMP_SUFFIX ".tmp"
+#define WAL_LOG_MAGIC 0x4C415741U
+#define WAL_MANIFEST_MAGIC 0x464E414DU
+#define WAL_SNAPSHOT_MAGIC 0x50414E53U
+#define WAL_DELTA_MAGIC 0x544C4544U
+#define WAL_INSERT 'I'
+#define WAL_ERASE 'E'
+#define WAL_APARTMENT 'A'
+#define WAL_UNCHANGED 'U'
+#define WAL_RECORD_SIZE (1 + 2 * sizeof (double))
+#define WAL_RANGE_SIZE (1 + 4 * sizeof (double) + 2 * sizeof (uint64_t))
+#define WAL_HEADER_SIZE (sizeof (uint32_t) + sizeof (uint64_t))
+
+/**
+ * this class represents an AVL tree whose updates survive a crash. Every
+ * insert and erase is applied to the tree and appended to a write ahead
+ * log of 17 byte records (the operation and the two coordinates). The log
+ * is written and synced to disk by groups of operations (group commit): an
+ * update is durable once commit () returns, and one fsync covers all the
+ * updates made since the previous one, by any number of threads.
+ * checkpoint () saves the tree and empties the log. Usually it writes only
+ * a delta: the nodes that changed since the previous checkpoint (see
+ * AVL::collect_changes), with every unchanged sub tree written as the
+ * first and the last of its apartments and their numbers of copies at the
+ * ends of the run, so a checkpoint costs O(c log n) for c changes instead
+ * of O(n). Every WAL_MAX_DELTAS checkpoints, and the
+ * first time, a full snapshot is written instead. A manifest names the
+ * generation of the last snapshot (the base) and of the last delta.
+ * Opening the same path again loads the base, applies the deltas in order,
+ * where every unchanged run is copied from the previous state, and
+ * replays the log on top. Every file carries a generation number and
+ * becomes current only when the manifest is replaced, so a crash in the
+ * middle of a checkpoint never replays a log over the state that already
+ * contains it, and a torn record at the end of the log (an update that was
+ * never committed) is dropped.
+ * All the methods lock the tree, so threads may share one DurableAVL. After
+ * a write error the log no longer matches the tree, and the tree should be
+ * opened again.
+ */
+class DurableAVL {
+  AVL _tree;
+  std::string _path;
+  int _log;
+  uint64_t _generation, _base;
+  bool _full_next;
+  std::vector<char> _pending, _writing;
+  size_t _group_size;
+  uint64_t _logged, _durable;
+  bool _syncing;
+  mutable std::mutex _lock;
+  std::condition_variable _synced;
+
+  /**
+   * @param suffix WAL_SNAPSHOT_SUFFIX or WAL_DELTA_SUFFIX
+   * @param generation generation of the file
+   * @return path of the snapshot or the delta of a generation
+   */
+  std::string file_of (const char *suffix, uint64_t generation) const;
+
+  /**
+   * loads the base and the deltas named by the manifest of the path into
+   * the tree, if there is a manifest
+   */
+  void load_checkpoint ();
+
+  /**
+   * @return the content of a full snapshot of the tree
+   */
+  std::vector<char> full_snapshot () const;
+
+  /**
+   * @return the content of a delta of the tree since the last checkpoint.
+   * marks the tree unchanged.
+   */
+  std::vector<char> delta ();
+
+  /**
+   * applies the log of the path to the tree, drops a torn record at its
+   * end, and opens the log for appending. A log of an older generation than
+   * the checkpoint is already in the checkpoint and is emptied.
+   */
+  void replay_log ();
+
+  /**
+   * empties the log and starts it with the header of the current
+   * generation
+   */
+  void reset_log ();
+
+  /**
+   * appends a record to the pending group and commits the group if it is
+   * full. The caller holds the lock.
+   * @param lock the lock of the tree, held by the caller
+   * @param operation WAL_INSERT or WAL_ERASE
+   * @param apartment apartment of the operation
+   */
+  void log (std::unique_lock<std::mutex> &lock, char operation,
+            const Apartment &apartment);
+
+  /**
+   * writes and syncs the pending records until every record logged so far
+   * is durable. one thread writes a group while the others wait for it and
+   * then find their records already durable.
+   * @param lock the lock of the tree, held by the caller
+   */
+  void sync (std::unique_lock<std::mutex> &lock);
+
+ public:
+  /**
+   * Constructor. Opens the tree stored at path, ordered by the distance
+   * from feelbox, committing every WAL_DEFAULT_GROUP updates
+   * @param path path of the tree, its files are path with WAL_LOG_SUFFIX,
+   * WAL_MANIFEST_SUFFIX, and WAL_SNAPSHOT_SUFFIX or WAL_DELTA_SUFFIX and a
+   * generation
+   */
+  explicit DurableAVL (const std::string &path);
+
+  /**
+   * Constructor. Opens the tree stored at path, ordered by the distance
+   * from feelbox
+   * @param path path of the tree (see DurableAVL (const std::string &))
+   * @param group_size number of updates that are committed together when
+   * no one calls commit () earlier, 1 syncs every update
+   */
+  DurableAVL (const std::string &path, size_t group_size);
+
+  /**
+   * Constructor. Opens the tree stored at path, ordered by the distance
+   * from the reference point of context. A tree must be opened with the
+   * context it was created with.
+   * @param context reference point of the tree
+   * @param path path of the tree (see DurableAVL (const std::string &))
+   * @param group_size number of updates that are committed together when
+   * no one calls commit () earlier, 1 syncs every update
+   */
+  DurableAVL (const OrderingContext &context, const std::string &path,
+              size_t group_size);
+
+  DurableAVL (const DurableAVL &other) = delete;
+  DurableAVL &operator= (const DurableAVL &rhs) = delete;
+
+  /**
+   * Destructor. Commits the pending updates and closes the log
+   */
+  ~DurableAVL ();
+
+  /**
+   * Inserts the apartment into the tree and logs it. The insert is durable
+   * after the next commit ().
+   * @param apartment Apartment object to add
+   */
+  void insert (const Apartment &apartment);
+
+  /**
+   * Erases the apartment from the tree (if it is in it) and logs it. The
+   * erase is durable after the next commit ().
+   * @param apartment Apartment object to erase
+   */
+  void erase (const Apartment &apartment);
+
+  /**
+   * @param apartment apartment to search
+   * @return true if the apartment is in the tree
+   */
+  bool contains (const Apartment &apartment) const;
+
+  /**
+   * Makes every update made so far durable. Calling this method after an
+   * update and before acknowledging it gives group commit: concurrent
+   * callers share one fsync. Throws a runtime error if the log can not be
+   * written.
+   */
+  void commit ();
+
+  /**
+   * Saves the tree, as a delta or as a full snapshot, and empties the log,
+   * so the next open does not replay the updates made so far. Throws a
+   * runtime error if the checkpoint can not be written; the log is kept in
+   * that case, and the next checkpoint is a full snapshot.
+   */
+  void checkpoint ();
+
+  /**
+   * @return number of deltas on top of the base, that the next open
+   * applies
+   */
+  uint64_t deltas () const;
+
+  /**
+   * Removes every file of the tree stored at path. The tree must not be
+   * open.
+   * @param path path of the tree (see DurableAVL (const std::string &))
+   */
+  static void remove_files (const std::string &path);
+
+  /**
+   * @return number of updates logged since the tree was opened
+   */
+  uint64_t logged () const;
+
+  /**
+   * @return number of updates logged since the tree was opened that are
+   * durable
+   */
+  uint64_t durable () const;
+
+  /**
+   * The tree of the apartments. It can be searched and iterated like any
+   * AVL, but not while other threads update the DurableAVL.
+   * @return the AVL tree of the apartments
+   */
+  const AVL &by_distance () const;
+};
+
+#endif //_DURABLEAVL_H_
@@ -0,0 +1,187 @@
+#ifndef _FINDCACHE_H_
+#define _FINDCACHE_H_
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "Apartment.h"
+
+#define CACHE_PROBES 4
+#define CACHE_HASH_X 0x9E3779B97F4A7C15ULL
+#define CACHE_HASH_Y 0xC2B2AE3D27D4EB4FULL
+#define CACHE_HASH_SHIFT 29
+
+/**
+ * this class represents a bounded cache of recently found nodes, keyed by
+ * the apartment coordinates quantized to EPSILON. It is an open addressing
+ * table where every key may live in one of CACHE_PROBES consecutive slots;
+ * when they are all taken the home slot is overwritten.
+ * An entry is keyed by the apartment stored in its node, and a hit is only
+ * reported if that apartment equals the query, so a stale entry can never
+ * return a wrong node. The owner must forget () a node before freeing it.
+ * @tparam Node node type, must provide get_data ()
+ */
+template<class Node>
+class FindCache {
+  /**
+   * A slot of the table. node is nullptr for an empty slot.
+   */
+  struct entry {
+      int64_t cell_x, cell_y;
+      Node *node;
+  };
+
+  std::vector<entry> table;
+  size_t mask;
+
+  /**
+   * @param value coordinate
+   * @return the EPSILON cell of the coordinate
+   */
+  static int64_t cell (double value)
+  {
+    return (int64_t) std::floor (value / EPSILON);
+  }
+
+  /**
+   * @param cell_x cell of the x coordinate
+   * @param cell_y cell of the y coordinate
+   * @return index of the home slot of the cell
+   */
+  size_t home (int64_t cell_x, int64_t cell_y) const
+  {
+    uint64_t hash = (uint64_t) cell_x * CACHE_HASH_X
+                    ^ (uint64_t) cell_y * CACHE_HASH_Y;
+    return (size_t) (hash ^ (hash >> CACHE_HASH_SHIFT)) & mask;
+  }
+
+ public:
+  size_t hits, misses;
+
+  /**
+   * Constructor. Constructs a disabled cache
+   */
+  FindCache () : mask (0), hits (0), misses (0)
+  {}
+
+  /**
+   * Resizes the cache and drops all its entries
+   * @param capacity number of slots, rounded up to a power of 2. 0 disables
+   * the cache
+   */
+  void resize (size_t capacity)
+  {
+    size_t size = 0;
+    if (capacity > 0)
+      {
+        size = 1;
+        while (size < capacity)
+          {
+            size <<= 1;
+          }
+      }
+    table.assign (size, entry {0, 0, nullptr});
+    mask = size - 1;
+  }
+
+  /**
+   * @return number of slots in the cache, 0 if it is disabled
+   */
+  size_t capacity () const
+  {
+    return table.size ();
+  }
+
+  /**
+   * @return true if the cache is in use
+   */
+  bool enabled () const
+  {
+    return !table.empty ();
+  }
+
+  /**
+   * Looks up an apartment and counts a hit or a miss
+   * @param apartment apartment to look for
+   * @return the cached node of the apartment, or nullptr
+   */
+  Node *lookup (const Apartment &apartment)
+  {
+    if (!enabled ())
+      {
+        return nullptr;
+      }
+    int64_t cell_x = cell (apartment.get_x ());
+    int64_t cell_y = cell (apartment.get_y ());
+    size_t slot = home (cell_x, cell_y);
+    for (int i = 0; i < CACHE_PROBES; i++, slot = (slot + 1) & mask)
+      {
+        const entry &curr = table[slot];
+        if (curr.node != nullptr && curr.cell_x == cell_x
+            && curr.cell_y == cell_y && curr.node->get_data () == apartment)
+          {
+            hits++;
+            return curr.node;
+          }
+      }
+    misses++;
+    return nullptr;
+  }
+
+  /**
+   * Caches a node under the cell of its apartment
+   * @param curr_node node to cache
+   */
+  void remember (Node *curr_node)
+  {
+    if (!enabled ())
+      {
+        return;
+      }
+    const Apartment &data = curr_node->get_data ();
+    int64_t cell_x = cell (data.get_x ());
+    int64_t cell_y = cell (data.get_y ());
+    size_t first = home (cell_x, cell_y);
+    size_t slot = first;
+    for (int i = 0; i < CACHE_PROBES; i++, slot = (slot + 1) & mask)
+      {
+        if (table[slot].node == nullptr || table[slot].node == curr_node)
+          {
+            table[slot] = entry {cell_x, cell_y, curr_node};
+            return;
+          }
+      }
+    table[first] = entry {cell_x, cell_y, curr_node};
+  }
+
+  /**
+   * Drops the entry of a node. Must be called before the node is freed or
+   * its apartment is replaced.
+   * @param curr_node node to forget
+   */
+  void forget (const Node *curr_node)
+  {
+    if (!enabled ())
+      {
+        return;
+      }
+    const Apartment &data = curr_node->get_data ();
+    size_t slot = home (cell (data.get_x ()), cell (data.get_y ()));
+    for (int i = 0; i < CACHE_PROBES; i++, slot = (slot + 1) & mask)
+      {
+        if (table[slot].node == curr_node)
+          {
+            table[slot].node = nullptr;
+          }
+      }
+  }
+
+  /**
+   * Drops all the entries, keeping the capacity
+   */
+  void clear ()
+  {
+    table.assign (table.size (), entry {0, 0, nullptr});
+  }
+};
+
+#endif //_FINDCACHE_H_
@@ -0,0 +1,362 @@
+#ifndef _ORDERINGCONTEXT_H_
+#define _ORDERINGCONTEXT_H_
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Apartment.h"
+
+#define MORTON_BITS 26
+#define MORTON_CELL 0.00001
+#define MORTON_MIN_X -180.0
+#define MORTON_MIN_Y -90.0
+#define MORTON_RANGE_SPLITS 16
+
+/**
+ * this class represents the reference point that a container orders its
+ * apartments by. Apartments are ordered by their squared distance from the
+ * point, which gives the same order as the distance without a square root.
+ * The default context is feelbox, so a container that is not given a
+ * context orders like Apartment::operator<. One process may hold
+ * containers with different contexts, for example one per city.
+ * The context made by morton () orders the apartments in Z order instead:
+ * x and y are quantized to cells of MORTON_CELL degrees on a grid of
+ * 2^MORTON_BITS cells per side from (MORTON_MIN_X, MORTON_MIN_Y), and the
+ * key is the Morton code of the cell, the bits of the two cells
+ * interleaved. Apartments that are close on the map then mostly get close
+ * keys, and a rectangle is covered by a few intervals of keys (see
+ * morton_intervals ()). The code has 52 bits, so the key is still an exact
+ * double, and the cells are smaller than EPSILON, so apartments that are
+ * not equal never share a key.
+ * Built with APARTMENT_FIXED_POINT, the distance keys are the exact int64
+ * squared distances in square micro-degrees (see Apartment), from the
+ * reference point rounded to micro-degrees, converted to double.
+ */
+class OrderingContext {
+  double _x, _y;
+  bool _morton;
+#ifdef APARTMENT_FIXED_POINT
+  int32_t _fixed_x, _fixed_y;
+
+  /**
+   * @param x x coordinate in micro-degrees
+   * @param y y coordinate in micro-degrees
+   * @return the squared distance of (x, y) from the reference point
+   */
+  double fixed_key (int32_t x, int32_t y) const
+  {
+    int64_t dx = (int64_t) x - _fixed_x;
+    int64_t dy = (int64_t) y - _fixed_y;
+    return (double) (dx * dx + dy * dy);
+  }
+#endif
+
+  /**
+   * A rectangle of cells of the Morton grid, inclusive
+   */
+  struct cell_rect {
+      uint32_t min_x, min_y, max_x, max_y;
+  };
+
+  /**
+   * @param value coordinate to quantize
+   * @param origin coordinate of the first cell
+   * @return the cell of the coordinate, clamped to the grid
+   */
+  static uint32_t quantize (double value, double origin)
+  {
+    double cell = (value - origin) / MORTON_CELL;
+    if (!(cell > 0))
+      {
+        return 0;
+      }
+    if (cell >= (double) (1u << MORTON_BITS))
+      {
+        return (1u << MORTON_BITS) - 1;
+      }
+    return (uint32_t) cell;
+  }
+
+  /**
+   * @param value cell coordinate
+   * @return the bits of value moved to the even bit positions
+   */
+  static uint64_t spread_bits (uint32_t value)
+  {
+    uint64_t bits = value;
+    bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFFULL;
+    bits = (bits | (bits << 8)) & 0x00FF00FF00FF00FFULL;
+    bits = (bits | (bits << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    bits = (bits | (bits << 2)) & 0x3333333333333333ULL;
+    bits = (bits | (bits << 1)) & 0x5555555555555555ULL;
+    return bits;
+  }
+
+  /**
+   * @param x cell column
+   * @param y cell row
+   * @return the Morton code of the cell, x on the even bits
+   */
+  static uint64_t morton_code (uint32_t x, uint32_t y)
+  {
+    return spread_bits (x) | (spread_bits (y) << 1);
+  }
+
+  /**
+   * recursive func that covers the part of a square of the grid inside a
+   * rectangle with intervals of Morton codes. the codes of a square are
+   * contiguous, so a square inside the rectangle, or one of the smallest
+   * level that meets it, is a single interval. the quarters are visited in
+   * Z order, so the intervals come out sorted, and touching ones are merged
+   * @param x first column of the square
+   * @param y first row of the square
+   * @param level the square is 2^level cells per side
+   * @param min_level level of the smallest squares to split into
+   * @param rect rectangle of cells to cover
+   * @param intervals vector to append the intervals to
+   */
+  static void split_square (uint32_t x, uint32_t y, int level, int min_level,
+                            const cell_rect &rect,
+                            std::vector<std::pair<double, double>> &intervals)
+  {
+    uint32_t last = (1u << level) - 1;
+    if (x > rect.max_x || x + last < rect.min_x || y > rect.max_y
+        || y + last < rect.min_y) // outside
+      {
+        return;
+      }
+    if (level <= min_level
+        || (x >= rect.min_x && x + last <= rect.max_x && y >= rect.min_y
+            && y + last <= rect.max_y))
+      {
+        double first = (double) morton_code (x, y);
+        double end = first + (double) ((1ULL << (2 * level)) - 1);
+        if (!intervals.empty () && intervals.back ().second + 1 == first)
+          {
+            intervals.back ().second = end;
+          }
+        else
+          {
+            intervals.emplace_back (first, end);
+          }
+        return;
+      }
+    uint32_t half = 1u << (level - 1);
+    split_square (x, y, level - 1, min_level, rect, intervals);
+    split_square (x + half, y, level - 1, min_level, rect, intervals);
+    split_square (x, y + half, level - 1, min_level, rect, intervals);
+    split_square (x + half, y + half, level - 1, min_level, rect, intervals);
+  }
+
+ public:
+  /**
+   * Constructor. Constructs the context of feelbox
+   */
+  OrderingContext () : OrderingContext (X_FEEL_BOX, Y_FEEL_BOX)
+  {}
+
+  /**
+   * Constructor
+   * @param x x coordinate of the reference point
+   * @param y y coordinate of the reference point
+   */
+  OrderingContext (double x, double y) : _x (x), _y (y), _morton (false)
+  {
+#ifdef APARTMENT_FIXED_POINT
+    _fixed_x = Apartment::to_fixed (x);
+    _fixed_y = Apartment::to_fixed (y);
+#endif
+  }
+
+  /**
+   * @return a context that orders the apartments in Z order (Morton codes)
+   * instead of by distance. Its reference point, for distance () and
+   * angle (), is feelbox.
+   */
+  static OrderingContext morton ()
+  {
+    OrderingContext context;
+    context._morton = true;
+    return context;
+  }
+
+  /**
+   * @return true if the context orders by Morton code, false if it orders
+   * by the distance from the reference point
+   */
+  bool is_morton () const
+  {
+    return _morton;
+  }
+
+  /**
+   * @return the x coordinate of the reference point
+   */
+  double get_x () const
+  {
+    return _x;
+  }
+
+  /**
+   * @return the y coordinate of the reference point
+   */
+  double get_y () const
+  {
+    return _y;
+  }
+
+  /**
+   * @param apartment apartment to order
+   * @return the squared distance of the apartment from the reference point,
+   * or its Morton code in Z order
+   */
+  double key (const Apartment &apartment) const
+  {
+    if (_morton)
+      {
+        uint32_t x = quantize (apartment.get_x (), MORTON_MIN_X);
+        uint32_t y = quantize (apartment.get_y (), MORTON_MIN_Y);
+        return (double) morton_code (x, y);
+      }
+#ifdef APARTMENT_FIXED_POINT
+    return fixed_key (apartment.get_fixed_x (), apartment.get_fixed_y ());
+#else
+    double x = apartment.get_x () - _x;
+    double y = apartment.get_y () - _y;
+    return x * x + y * y;
+#endif
+  }
+
+  /**
+   * @param x x coordinate of a point
+   * @param y y coordinate of a point
+   * @return the squared distance of the point from the reference point, in
+   * the units of key (): an apartment at (x, y) would get this key in the
+   * distance order
+   */
+  double key_of_point (double x, double y) const
+  {
+#ifdef APARTMENT_FIXED_POINT
+    return fixed_key (Apartment::to_fixed (x), Apartment::to_fixed (y));
+#else
+    x -= _x;
+    y -= _y;
+    return x * x + y * y;
+#endif
+  }
+
+  /**
+   * @param distance distance from the reference point
+   * @return the key of the apartments at that distance, 0 for a negative
+   * distance
+   */
+  static double key_of_distance (double distance)
+  {
+#ifdef APARTMENT_FIXED_POINT
+    distance *= FIXED_POINT_SCALE;
+#endif
+    return (distance > 0) ? distance * distance : 0;
+  }
+
+  /**
+   * @param apartment apartment to measure
+   * @return the distance of the apartment from the reference point
+   */
+  double distance (const Apartment &apartment) const
+  {
+#ifdef APARTMENT_FIXED_POINT
+    return std::sqrt (key (apartment)) / FIXED_POINT_SCALE;
+#else
+    return std::sqrt (key (apartment));
+#endif
+  }
+
+  /**
+   * @param apartment apartment to measure
+   * @return the angle of the apartment around the reference point, in
+   * radians in [-pi, pi], 0 is the direction of the x axis
+   */
+  double angle (const Apartment &apartment) const
+  {
+    return std::atan2 (apartment.get_y () - _y, apartment.get_x () - _x);
+  }
+
+  /**
+   * Covers the rectangle [min_x, max_x] x [min_y, max_y] with intervals of
+   * Morton keys, for a context in Z order. The rectangle is cut along the
+   * quad tree of the grid into squares down to about 1 / MORTON_RANGE_SPLITS
+   * of its larger side, so there are O(MORTON_RANGE_SPLITS) intervals. They
+   * hold the keys of every apartment in the rectangle, and of a few around
+   * its edges.
+   * @param min_x smallest x coordinate
+   * @param min_y smallest y coordinate
+   * @param max_x largest x coordinate
+   * @param max_y largest y coordinate
+   * @return the intervals of keys, inclusive, sorted and disjoint
+   */
+  static std::vector<std::pair<double, double>>
+  morton_intervals (double min_x, double min_y, double max_x, double max_y)
+  {
+    std::vector<std::pair<double, double>> intervals;
+    if (min_x > max_x || min_y > max_y)
+      {
+        return intervals;
+      }
+    cell_rect rect = {quantize (min_x, MORTON_MIN_X),
+                      quantize (min_y, MORTON_MIN_Y),
+                      quantize (max_x, MORTON_MIN_X),
+                      quantize (max_y, MORTON_MIN_Y)};
+    uint32_t side = std::max (rect.max_x - rect.min_x, rect.max_y - rect.min_y);
+    int min_level = 0;
+    while ((2u << min_level) <= side / MORTON_RANGE_SPLITS)
+      {
+        min_level++;
+      }
+    split_square (0, 0, MORTON_BITS, min_level, rect, intervals);
+    return intervals;
+  }
+
+  /**
+   * Orders apartments with equal keys by their coordinates, x first, so
+   * that less () is a total order. Equal keys are rare with double
+   * coordinates, but common with fixed point ones, where many points of
+   * the grid are at the same integer distance.
+   * @param lhs apartment to compare
+   * @param rhs apartment to compare
+   * @return true if the coordinates of lhs come before those of rhs
+   */
+  static bool coordinates_less (const Apartment &lhs, const Apartment &rhs)
+  {
+    return lhs.get_x () < rhs.get_x ()
+           || (lhs.get_x () == rhs.get_x () && lhs.get_y () < rhs.get_y ());
+  }
+
+  /**
+   * @param lhs apartment to compare
+   * @param rhs apartment to compare
+   * @return true if lhs and rhs have exactly the same coordinates. Unlike
+   * Apartment::operator==, apartments less than EPSILON apart differ here
+   */
+  static bool same_coordinates (const Apartment &lhs, const Apartment &rhs)
+  {
+    return lhs.get_x () == rhs.get_x () && lhs.get_y () == rhs.get_y ();
+  }
+
+  /**
+   * @param lhs apartment to compare
+   * @param rhs apartment to compare
+   * @return true if lhs is closer to the reference point than rhs, or
+   * before it in Z order. apartments with equal keys are ordered by
+   * coordinates_less ()
+   */
+  bool less (const Apartment &lhs, const Apartment &rhs) const
+  {
+    double lhs_key = key (lhs);
+    double rhs_key = key (rhs);
+    return lhs_key < rhs_key
+           || (lhs_key == rhs_key && coordinates_less (lhs, rhs));
+  }
+};
+
+#endif //_ORDERINGCONTEXT_H_
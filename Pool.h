@@ -0,0 +1,144 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define POOL_CHUNK_SIZE 1024
+
+/**
+ * this class represents a pool of objects of type T.
+ * The objects are carved out of fixed size chunks that never move, so a
+ * pointer to an object stays valid until the object is destroyed. Destroyed
+ * objects are kept in a free list and reused by the next create ().
+ * Compared to new/delete per object, the pool saves the allocator header of
+ * every object and keeps objects that were created together close in memory.
+ * T must be trivially destructible, since the memory of the objects that are
+ * still alive is released with the pool without calling their destructors.
+ */
+template<class T>
+class Pool {
+  static_assert (std::is_trivially_destructible<T>::value,
+                 "Pool objects must be trivially destructible");
+
+  /**
+   * A slot holds either an object or, while it is free, the next free slot.
+   */
+  union slot {
+      slot *next;
+      alignas (T) unsigned char storage[sizeof (T)];
+  };
+
+  std::vector<std::unique_ptr<slot[]>> chunks;
+  slot *free_list;
+  size_t live;
+
+  /**
+   * allocates a new chunk and pushes all its slots to the free list, so that
+   * the first slot of the chunk is handed out first
+   */
+  void add_chunk ()
+  {
+    chunks.emplace_back (new slot[POOL_CHUNK_SIZE]);
+    slot *chunk = chunks.back ().get ();
+    for (size_t i = POOL_CHUNK_SIZE; i > 0; --i)
+      {
+        chunk[i - 1].next = free_list;
+        free_list = &chunk[i - 1];
+      }
+  }
+
+ public:
+  /**
+   * Constructor. Constructs an empty pool, no memory is allocated
+   */
+  Pool () : free_list (nullptr), live (0)
+  {}
+
+  Pool (const Pool &other) = delete;
+  Pool &operator= (const Pool &rhs) = delete;
+
+  /**
+   * Constructs a new object in the pool
+   * @param args arguments for the constructor of T
+   * @return pointer to the new object
+   */
+  template<class... Args>
+  T *create (Args &&... args)
+  {
+    if (free_list == nullptr)
+      {
+        add_chunk ();
+      }
+    slot *curr_slot = free_list;
+    free_list = curr_slot->next;
+    live++;
+    T *obj = new (curr_slot->storage) T (std::forward<Args> (args)...);
+    return obj;
+  }
+
+  /**
+   * Returns an object to the pool. The object must have been created by this
+   * pool.
+   * @param obj pointer to the object to destroy
+   */
+  void destroy (T *obj)
+  {
+    slot *curr_slot = reinterpret_cast<slot *> (obj);
+    curr_slot->next = free_list;
+    free_list = curr_slot;
+    live--;
+  }
+
+  /**
+   * Makes sure that the next n calls to create () will not allocate memory
+   * @param n number of objects to reserve memory for
+   */
+  void reserve (size_t n)
+  {
+    while (capacity () < live + n)
+      {
+        add_chunk ();
+      }
+  }
+
+  /**
+   * Exchanges the objects of this pool with the objects of other
+   * @param other pool to swap with
+   */
+  void swap (Pool &other)
+  {
+    chunks.swap (other.chunks);
+    std::swap (free_list, other.free_list);
+    std::swap (live, other.live);
+  }
+
+  /**
+   * @return number of objects alive in the pool
+   */
+  size_t size () const
+  {
+    return live;
+  }
+
+  /**
+   * @return number of objects the allocated chunks can hold
+   */
+  size_t capacity () const
+  {
+    return chunks.size () * POOL_CHUNK_SIZE;
+  }
+
+  /**
+   * @return number of bytes allocated by the pool
+   */
+  size_t bytes () const
+  {
+    return capacity () * sizeof (slot);
+  }
+};
+
+#endif //_POOL_H_
@@ -0,0 +1,244 @@
+#include "ShardedAVL.h"
+#include <algorithm>
+#include <limits>
+
+/**
+ * Constructor. Constructs an empty set of shard_count shards. Until the
+ * first rebalance all the apartments go to the first shard.
+ * @param shard_count number of shards
+ */
+ShardedAVL::ShardedAVL (size_t shard_count)
+    : _boundaries (std::max<size_t> (shard_count, 1) - 1,
+                   std::numeric_limits<double>::infinity ())
+{
+  for (size_t i = 0; i <= _boundaries.size (); i++)
+    {
+      _shards.emplace_back (new shard ());
+    }
+}
+
+/**
+ * Constructor. Picks the boundaries from the quantiles of the distances
+ * of the given apartments, and inserts them.
+ * @param shard_count number of shards
+ * @param coordinates vector of pairs
+ */
+ShardedAVL::ShardedAVL (
+    size_t shard_count,
+    const std::vector<std::pair<double, double>> &coordinates)
+    : ShardedAVL (shard_count)
+{
+  std::vector<Apartment> sorted (coordinates.begin (), coordinates.end ());
+  std::sort (sorted.begin (), sorted.end ());
+  build (sorted);
+}
+
+/**
+ * @param distance distance from feelbox
+ * @return index of the shard of the distance
+ */
+size_t ShardedAVL::route (double distance) const
+{
+  return std::upper_bound (_boundaries.begin (), _boundaries.end (), distance)
+         - _boundaries.begin ();
+}
+
+/**
+ * builds the shards from apartments sorted by distance, with boundaries
+ * at the quantiles of their distances. The caller holds the layout lock.
+ * @param sorted apartments sorted by distance
+ */
+void ShardedAVL::build (const std::vector<Apartment> &sorted)
+{
+  size_t shard_count = _shards.size ();
+  for (size_t i = 1; i < shard_count; i++)
+    {
+      size_t quantile = i * sorted.size () / shard_count;
+      _boundaries[i - 1] = (quantile < sorted.size ())
+                           ? sorted[quantile].get_distance ()
+                           : std::numeric_limits<double>::infinity ();
+    }
+
+  std::vector<std::unique_ptr<shard>> shards;
+  std::vector<AVL::iterator> hints;
+  for (size_t i = 0; i < shard_count; i++)
+    {
+      shards.emplace_back (new shard ());
+      hints.push_back (shards.back ()->tree.end ());
+    }
+
+  // every shard gets its apartments in order, so the hinted insert links
+  // each one next to the previous
+  for (const Apartment &apartment : sorted)
+    {
+      size_t i = route (apartment.get_distance ());
+      hints[i] = shards[i]->tree.insert (hints[i], apartment);
+      shards[i]->size++;
+    }
+  _shards.swap (shards);
+}
+
+/**
+ * @return true if the largest shard is more than MAX_SHARD_SKEW times the
+ * average shard
+ */
+bool ShardedAVL::skewed () const
+{
+  size_t total = 0, largest = 0;
+  for (const auto &curr_shard : _shards)
+    {
+      size_t curr_size = curr_shard->size;
+      total += curr_size;
+      largest = std::max (largest, curr_size);
+    }
+  return total >= MIN_REBALANCE_SIZE
+         && largest > MAX_SHARD_SKEW * total / _shards.size ();
+}
+
+/**
+ * Inserts the apartment to its shard. Safe to call from several threads.
+ * Every SKEW_CHECK_INTERVAL inserts to a shard the sizes of the shards
+ * are checked, and the boundaries are recomputed if they are skewed.
+ * @param apartment Apartment object to add
+ */
+void ShardedAVL::insert (const Apartment &apartment)
+{
+  bool check = false;
+  {
+    std::shared_lock<std::shared_mutex> layout (_layout_lock);
+    shard &curr_shard = *_shards[route (apartment.get_distance ())];
+    {
+      std::lock_guard<std::mutex> guard (curr_shard.lock);
+      curr_shard.tree.insert (apartment);
+    }
+    curr_shard.size++;
+    if (++curr_shard.inserts_since_check >= SKEW_CHECK_INTERVAL)
+      {
+        curr_shard.inserts_since_check = 0;
+        check = skewed ();
+      }
+  }
+  if (check)
+    {
+      rebalance ();
+    }
+}
+
+/**
+ * Erases the apartment from its shard. Safe to call from several threads.
+ * @param apartment Apartment object to erase
+ */
+void ShardedAVL::erase (const Apartment &apartment)
+{
+  std::shared_lock<std::shared_mutex> layout (_layout_lock);
+  shard &curr_shard = *_shards[route (apartment.get_distance ())];
+  std::lock_guard<std::mutex> guard (curr_shard.lock);
+  // the shard counts only what erase really removed: the apartment itself,
+  // not a neighbour that find () would match
+  AVL::iterator found = curr_shard.tree.find_exact (apartment);
+  if (found != curr_shard.tree.end ())
+    {
+      curr_shard.tree.erase (found);
+      curr_shard.size--;
+    }
+}
+
+/**
+ * @param apartment apartment to search
+ * @return true if the apartment is in the set
+ */
+bool ShardedAVL::contains (const Apartment &apartment) const
+{
+  std::shared_lock<std::shared_mutex> layout (_layout_lock);
+  const shard &curr_shard = *_shards[route (apartment.get_distance ())];
+  std::lock_guard<std::mutex> guard (curr_shard.lock);
+  return curr_shard.tree.find (apartment) != curr_shard.tree.end ();
+}
+
+/**
+ * @return number of apartments in all the shards
+ */
+size_t ShardedAVL::size () const
+{
+  std::shared_lock<std::shared_mutex> layout (_layout_lock);
+  size_t total = 0;
+  for (const auto &curr_shard : _shards)
+    {
+      total += curr_shard->size;
+    }
+  return total;
+}
+
+/**
+ * @return number of shards
+ */
+size_t ShardedAVL::shard_count () const
+{
+  return _shards.size ();
+}
+
+/**
+ * @return the sizes of the shards, closest ring first
+ */
+std::vector<size_t> ShardedAVL::shard_sizes () const
+{
+  std::shared_lock<std::shared_mutex> layout (_layout_lock);
+  std::vector<size_t> sizes;
+  for (const auto &curr_shard : _shards)
+    {
+      sizes.push_back (curr_shard->size);
+    }
+  return sizes;
+}
+
+/**
+ * Recomputes the ring boundaries from the quantiles of the current
+ * distances and redistributes the apartments. Runs in O(n) while blocking
+ * all the other operations.
+ */
+void ShardedAVL::rebalance ()
+{
+  std::unique_lock<std::shared_mutex> layout (_layout_lock);
+  if (!skewed ()) // another thread already rebalanced
+    {
+      return;
+    }
+
+  // the rings are ordered, so visiting the shards one after the other
+  // gives all the apartments sorted by distance
+  std::vector<Apartment> sorted;
+  for (const auto &curr_shard : _shards)
+    {
+      curr_shard->tree.for_each_in_order ([&sorted] (const Apartment &a)
+                                          { sorted.push_back (a); });
+    }
+  build (sorted);
+}
+
+/**
+ * @param low smallest distance
+ * @param high largest distance
+ * @return the apartments whose distance from feelbox is in [low, high],
+ * closest first
+ */
+std::vector<Apartment> ShardedAVL::range (double low, double high) const
+{
+  std::vector<Apartment> apartments;
+  for_each_in_range (low, high, [&apartments] (const Apartment &a)
+  { apartments.push_back (a); });
+  return apartments;
+}
+
+/**
+ * Insertion operator, prints the apartments in order.
+ * Each apartment will be printed in the format: (x,y)\n
+ * @param os reference to std::ostream
+ * @param sharded set to print
+ * @return os reference to std::ostream
+ */
+std::ostream &operator<< (std::ostream &os, const ShardedAVL &sharded)
+{
+  sharded.for_each ([&os] (const Apartment &a)
+                    { os << a; });
+  return os;
+}
@@ -0,0 +1,202 @@
+#ifndef _SHARDEDAVL_H_
+#define _SHARDEDAVL_H_
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include "AVL.h"
+
+#define SKEW_CHECK_INTERVAL 4096
+#define MAX_SHARD_SKEW 2.0
+#define MIN_REBALANCE_SIZE 1024
+
+/**
+ * this class represents a set of apartments split into several AVL trees
+ * (shards) by rings of distance from feelbox, so writers to different rings
+ * do not wait for each other. Every shard has its own lock, and an apartment
+ * is routed to its shard by a binary search on the ring boundaries.
+ * The boundaries are quantiles of the distances, and are recomputed online
+ * when one shard grows much larger than the average.
+ * Since the shards are ordered by distance, visiting them one after the
+ * other visits the whole set in order.
+ */
+class ShardedAVL {
+  /**
+   * A shard is an AVL tree with its own lock
+   */
+  struct shard {
+      mutable std::mutex lock;
+      AVL tree;
+      std::atomic<size_t> size;
+      std::atomic<size_t> inserts_since_check;
+
+      /**
+       * Constructor. Constructs an empty shard
+       */
+      shard () : size (0), inserts_since_check (0)
+      {}
+  };
+
+  std::vector<double> _boundaries;
+  std::vector<std::unique_ptr<shard>> _shards;
+  mutable std::shared_mutex _layout_lock;
+
+  /**
+   * @param distance distance from feelbox
+   * @return index of the shard of the distance
+   */
+  size_t route (double distance) const;
+
+  /**
+   * builds the shards from apartments sorted by distance, with boundaries
+   * at the quantiles of their distances. The caller holds the layout lock.
+   * @param sorted apartments sorted by distance
+   */
+  void build (const std::vector<Apartment> &sorted);
+
+  /**
+   * @return true if the largest shard is more than MAX_SHARD_SKEW times the
+   * average shard
+   */
+  bool skewed () const;
+
+ public:
+  /**
+   * Constructor. Constructs an empty set of shard_count shards. Until the
+   * first rebalance all the apartments go to the first shard.
+   * @param shard_count number of shards
+   */
+  ShardedAVL (size_t shard_count);
+
+  /**
+   * Constructor. Picks the boundaries from the quantiles of the distances
+   * of the given apartments, and inserts them.
+   * @param shard_count number of shards
+   * @param coordinates vector of pairs
+   */
+  ShardedAVL (size_t shard_count,
+              const std::vector<std::pair<double, double>> &coordinates);
+
+  ShardedAVL (const ShardedAVL &other) = delete;
+  ShardedAVL &operator= (const ShardedAVL &rhs) = delete;
+
+  /**
+   * Inserts the apartment to its shard. Safe to call from several threads.
+   * Every SKEW_CHECK_INTERVAL inserts to a shard the sizes of the shards
+   * are checked, and the boundaries are recomputed if they are skewed.
+   * @param apartment Apartment object to add
+   */
+  void insert (const Apartment &apartment);
+
+  /**
+   * Erases the apartment from its shard. Safe to call from several threads.
+   * @param apartment Apartment object to erase
+   */
+  void erase (const Apartment &apartment);
+
+  /**
+   * @param apartment apartment to search
+   * @return true if the apartment is in the set
+   */
+  bool contains (const Apartment &apartment) const;
+
+  /**
+   * @return number of apartments in all the shards
+   */
+  size_t size () const;
+
+  /**
+   * @return number of shards
+   */
+  size_t shard_count () const;
+
+  /**
+   * @return the sizes of the shards, closest ring first
+   */
+  std::vector<size_t> shard_sizes () const;
+
+  /**
+   * Recomputes the ring boundaries from the quantiles of the current
+   * distances and redistributes the apartments. Runs in O(n) while blocking
+   * all the other operations.
+   */
+  void rebalance ();
+
+  /**
+   * Calls f on every apartment in order, closest first. Each shard is locked
+   * while it is visited.
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each (Function f) const;
+
+  /**
+   * Calls f in order on every apartment whose distance from feelbox is in
+   * [low, high]. Only the shards whose ring meets the range are visited.
+   * @param low smallest distance to visit
+   * @param high largest distance to visit
+   * @param f function that gets a const Apartment &
+   */
+  template<class Function>
+  void for_each_in_range (double low, double high, Function f) const;
+
+  /**
+   * @param low smallest distance
+   * @param high largest distance
+   * @return the apartments whose distance from feelbox is in [low, high],
+   * closest first
+   */
+  std::vector<Apartment> range (double low, double high) const;
+
+  /**
+   * Insertion operator, prints the apartments in order.
+   * Each apartment will be printed in the format: (x,y)\n
+   * @param os reference to std::ostream
+   * @param sharded set to print
+   * @return os reference to std::ostream
+   */
+  friend std::ostream &operator<< (std::ostream &os,
+                                   const ShardedAVL &sharded);
+};
+
+/**
+ * Calls f on every apartment in order, closest first. Each shard is locked
+ * while it is visited.
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void ShardedAVL::for_each (Function f) const
+{
+  std::shared_lock<std::shared_mutex> layout (_layout_lock);
+  for (const auto &curr_shard : _shards)
+    {
+      std::lock_guard<std::mutex> guard (curr_shard->lock);
+      curr_shard->tree.for_each_in_order (f);
+    }
+}
+
+/**
+ * Calls f in order on every apartment whose distance from feelbox is in
+ * [low, high]. Only the shards whose ring meets the range are visited.
+ * @param low smallest distance to visit
+ * @param high largest distance to visit
+ * @param f function that gets a const Apartment &
+ */
+template<class Function>
+void ShardedAVL::for_each_in_range (double low, double high,
+                                    Function f) const
+{
+  std::shared_lock<std::shared_mutex> layout (_layout_lock);
+  for (size_t i = route (low); i < _shards.size (); i++)
+    {
+      if (i > 0 && _boundaries[i - 1] > high) // the rest are farther
+        {
+          break;
+        }
+      std::lock_guard<std::mutex> guard (_shards[i]->lock);
+      _shards[i]->tree.for_each_in_range (low, high, f);
+    }
+}
+
+#endif //_SHARDEDAVL_H_
@@ -1,26 +1,82 @@
 
 #include "Stack.h"
+#include <algorithm>
+#include <stdexcept>
 #define EMPTY_STACK_MSG_ERROR "Error: the stack is empty. illegal operation"
+#define SHRINK_FACTOR_MSG_ERROR "Error: the shrink factor must be 0 or at \
+least 2"
 
 /**
  * Default constructor, constructs an empty stack
  */
-Stack::Stack () : vector ({})
+Stack::Stack ()
+    : vector ({}), _chunk_shift (0), _chunk_size (STACK_CONTIGUOUS), _size (0),
+      _shrink_factor (STACK_NEVER_SHRINK)
 {}
 
 /**
- * Constructor that gets vector of pairs, and pushes them as apartments to
- * the stack, when the first pair is pushed first.
- * @param coordinates vector of pairs
+ * Constructor, constructs an empty stack with chunked storage
+ * @param chunk_size number of apartments in a chunk, rounded up to a power
+ * of 2. STACK_CONTIGUOUS keeps the apartments in one vector
+ */
+Stack::Stack (size_t chunk_size) : Stack ()
+{
+  if (chunk_size != STACK_CONTIGUOUS)
+    {
+      _chunk_size = 1;
+      while (_chunk_size < chunk_size)
+        {
+          _chunk_size <<= 1;
+          _chunk_shift++;
+        }
+    }
+}
+
+/**
+ * Copy constructor
+ * @param other stack to copy
+ */
+Stack::Stack (const Stack &other) : Stack ()
+{
+  *this = other;
+}
+
+/**
+ * Assignment operator - copies the contents of another stack to this
+ * @param rhs stack to copy values from
+ * @return reference to this stack
  */
-Stack::Stack (std::vector<std::pair<double, double>> coordinates)
+Stack &Stack::operator= (const Stack &rhs)
 {
-  for (auto x:coordinates)
+  if (this == &rhs)
     {
-      Apartment a (x);
-      push (a);
+      return *this;
     }
+  vector = rhs.vector;
+  _chunks.clear ();
+  _chunk_shift = rhs._chunk_shift;
+  _chunk_size = rhs._chunk_size;
+  _size = 0;
+  _shrink_factor = rhs._shrink_factor;
+  if (chunked ())
+    {
+      reserve (rhs._size);
+      for (size_t i = 0; i < rhs._size; i++)
+        {
+          push (rhs.at (i));
+        }
+    }
+  return *this;
+}
 
+/**
+ * Constructor that gets vector of pairs, and pushes them as apartments to
+ * the stack, when the first pair is pushed first.
+ * @param coordinates vector of pairs
+ */
+Stack::Stack (std::vector<std::pair<double, double>> coordinates) : Stack ()
+{
+  push_range (coordinates);
 }
 
 /**
@@ -29,7 +85,29 @@ Stack::Stack (std::vector<std::pair<double, double>> coordinates)
  */
 void Stack::push (const Apartment &apartment)
 {
-  vector.push_back (apartment);
+  construct_top (apartment);
+}
+
+/**
+ * Pushes the apartment at (x, y), constructing it in place on top of the
+ * stack
+ * @param x x coordinate of the apartment
+ * @param y y coordinate of the apartment
+ */
+void Stack::emplace (double x, double y)
+{
+  construct_top (std::make_pair (x, y));
+}
+
+/**
+ * Pushes an apartment for every pair of coordinates, the first pair is
+ * pushed first
+ * @param coordinates vector of pairs
+ */
+void Stack::push_range (
+    const std::vector<std::pair<double, double>> &coordinates)
+{
+  push_range (coordinates.begin (), coordinates.end ());
 }
 
 /**
@@ -43,7 +121,15 @@ void Stack::pop ()
     {
       throw std::out_of_range (EMPTY_STACK_MSG_ERROR);
     }
-  vector.pop_back ();
+  if (chunked ())
+    {
+      _size--;
+    }
+  else
+    {
+      vector.pop_back ();
+    }
+  maybe_shrink ();
 }
 
 /**
@@ -51,7 +137,7 @@ void Stack::pop ()
  */
 bool Stack::empty () const
 {
-  return (vector.empty ());
+  return size () == 0;
 
 }
 
@@ -60,7 +146,7 @@ bool Stack::empty () const
  */
 size_t Stack::size () const
 {
-  return vector.size ();
+  return chunked () ? _size : vector.size ();
 }
 
 /**
@@ -75,7 +161,7 @@ Apartment &Stack::top ()
     {
       throw std::out_of_range (EMPTY_STACK_MSG_ERROR);
     }
-  return vector.back ();
+  return at (size () - 1);
 }
 
 /**
@@ -90,7 +176,7 @@ Apartment Stack::top () const
     {
       throw std::out_of_range (EMPTY_STACK_MSG_ERROR);
     }
-  return vector.back ();
+  return at (size () - 1);
 }
 
 /**
@@ -98,7 +184,7 @@ Apartment Stack::top () const
  */
 Stack::iterator Stack::begin ()
 {
-  return vector.rbegin ();
+  return iterator (this, size ());
 }
 
 /**
@@ -107,7 +193,7 @@ Stack::iterator Stack::begin ()
  */
 Stack::const_iterator Stack::begin () const
 {
-  return vector.rbegin ();
+  return const_iterator (this, size ());
 }
 
 /**
@@ -116,7 +202,7 @@ Stack::const_iterator Stack::begin () const
  */
 Stack::const_iterator Stack::cbegin () const
 {
-  return vector.rbegin ();
+  return begin ();
 }
 
 /**
@@ -124,7 +210,7 @@ Stack::const_iterator Stack::cbegin () const
  */
 Stack::iterator Stack::end ()
 {
-  return vector.rend ();
+  return iterator (this, 0);
 }
 
 /**
@@ -132,7 +218,7 @@ Stack::iterator Stack::end ()
  */
 Stack::const_iterator Stack::end () const
 {
-  return vector.rend ();
+  return const_iterator (this, 0);
 }
 
 /**
@@ -140,6 +226,125 @@ Stack::const_iterator Stack::end () const
  */
 Stack::const_iterator Stack::cend () const
 {
-  return vector.rend ();
+  return end ();
+}
+
+/**
+ * Makes room for at least n apartments, so the next pushes up to n do not
+ * allocate
+ * @param n number of apartments
+ */
+void Stack::reserve (size_t n)
+{
+  if (!chunked ())
+    {
+      vector.reserve (n);
+      return;
+    }
+  while (capacity () < n)
+    {
+      _chunks.emplace_back (new slot[_chunk_size]);
+    }
+}
+
+/**
+ * @return number of apartments the stack can hold without allocating
+ */
+size_t Stack::capacity () const
+{
+  return chunked () ? _chunks.size () << _chunk_shift : vector.capacity ();
+}
+
+/**
+ * Sets when pop () gives memory back. Once the size falls to
+ * capacity / factor, the capacity is cut to twice the size (whole chunks
+ * in chunked storage).
+ * @param factor at least STACK_MIN_SHRINK_FACTOR, or STACK_NEVER_SHRINK
+ */
+void Stack::set_shrink_policy (double factor)
+{
+  if (factor != STACK_NEVER_SHRINK && !(factor >= STACK_MIN_SHRINK_FACTOR))
+    {
+      throw std::invalid_argument (SHRINK_FACTOR_MSG_ERROR);
+    }
+  _shrink_factor = factor;
+}
+
+/**
+ * @return true if the apartments are kept in chunks
+ */
+bool Stack::chunked () const
+{
+  return _chunk_size != STACK_CONTIGUOUS;
+}
+
+/**
+ * @param i index of an apartment, 0 is the bottom of the stack
+ * @return reference to apartment i
+ */
+Apartment &Stack::at (size_t i)
+{
+  if (!chunked ())
+    {
+      return vector[i];
+    }
+  slot &curr = _chunks[i >> _chunk_shift][i & (_chunk_size - 1)];
+  return *reinterpret_cast<Apartment *> (curr.storage);
+}
+
+/**
+ * @param i index of an apartment, 0 is the bottom of the stack
+ * @return const reference to apartment i
+ */
+const Apartment &Stack::at (size_t i) const
+{
+  if (!chunked ())
+    {
+      return vector[i];
+    }
+  const slot &curr = _chunks[i >> _chunk_shift][i & (_chunk_size - 1)];
+  return *reinterpret_cast<const Apartment *> (curr.storage);
+}
+
+/**
+ * @return storage for the apartment above the top of a chunked stack,
+ * adding a chunk if the last one is full
+ */
+void *Stack::next_slot ()
+{
+  if (_size == capacity ())
+    {
+      _chunks.emplace_back (new slot[_chunk_size]);
+    }
+  return _chunks[_size >> _chunk_shift][_size & (_chunk_size - 1)].storage;
 }
 
+/**
+ * releases memory according to the shrink policy, called after a pop
+ */
+void Stack::maybe_shrink ()
+{
+  size_t curr_capacity = capacity ();
+  if (_shrink_factor == STACK_NEVER_SHRINK
+      || curr_capacity <= STACK_MIN_SHRINK_CAPACITY
+      || size () * _shrink_factor > curr_capacity)
+    {
+      return;
+    }
+
+  size_t keep = std::max<size_t> (2 * size (), STACK_MIN_SHRINK_CAPACITY);
+  if (chunked ())
+    {
+      // whole chunks only, the apartments in the kept chunks do not move
+      size_t chunks = (keep + _chunk_size - 1) >> _chunk_shift;
+      if (chunks < _chunks.size ())
+        {
+          _chunks.resize (chunks);
+        }
+      return;
+    }
+  std::vector<Apartment> smaller;
+  smaller.reserve (keep);
+  smaller.insert (smaller.end (), vector.begin (), vector.end ());
+  vector.swap (smaller);
+}
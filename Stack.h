@@ -2,13 +2,79 @@
 #ifndef _STACK_H_
 #define _STACK_H_
 #include "Apartment.h"
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#define STACK_CONTIGUOUS 0
+#define STACK_NEVER_SHRINK 0
+#define STACK_MIN_SHRINK_FACTOR 2.0
+#define STACK_MIN_SHRINK_CAPACITY 64
+
 /**
- * this class represents a stack
+ * this class represents a stack.
+ * By default the apartments are kept in one contiguous vector. A stack
+ * constructed with a chunk size keeps them in fixed size chunks instead:
+ * a push never moves the apartments already in the stack, so references
+ * returned by top () stay valid until that apartment is popped, and there
+ * is no reallocation spike when the stack grows.
+ * A shrink policy may be set to give memory back after many pops.
  */
 class Stack {
+  static_assert (std::is_trivially_destructible<Apartment>::value,
+                 "chunks release apartments without destructors");
+
+  /**
+   * Raw storage for one apartment in a chunk
+   */
+  struct slot {
+      alignas (Apartment) unsigned char storage[sizeof (Apartment)];
+  };
+
   std::vector<Apartment> vector;
+  std::vector<std::unique_ptr<slot[]>> _chunks;
+  size_t _chunk_shift;
+  size_t _chunk_size;
+  size_t _size;
+  double _shrink_factor;
+
+  /**
+   * @return true if the apartments are kept in chunks
+   */
+  bool chunked () const;
+
+  /**
+   * @param i index of an apartment, 0 is the bottom of the stack
+   * @return reference to apartment i
+   */
+  Apartment &at (size_t i);
+
+  /**
+   * @param i index of an apartment, 0 is the bottom of the stack
+   * @return const reference to apartment i
+   */
+  const Apartment &at (size_t i) const;
+
+  /**
+   * releases memory according to the shrink policy, called after a pop
+   */
+  void maybe_shrink ();
+
+  /**
+   * @return storage for the apartment above the top of a chunked stack,
+   * adding a chunk if the last one is full
+   */
+  void *next_slot ();
+
+  /**
+   * constructs a new apartment on top of the stack
+   * @param args arguments of the Apartment constructor
+   */
+  template<class... Args>
+  void construct_top (Args &&... args);
 
  public:
   /**
@@ -16,6 +82,26 @@ class Stack {
    */
   Stack ();
 
+  /**
+   * Constructor, constructs an empty stack with chunked storage
+   * @param chunk_size number of apartments in a chunk, rounded up to a power
+   * of 2. STACK_CONTIGUOUS keeps the apartments in one vector
+   */
+  explicit Stack (size_t chunk_size);
+
+  /**
+   * Copy constructor
+   * @param other stack to copy
+   */
+  Stack (const Stack &other);
+
+  /**
+   * Assignment operator - copies the contents of another stack to this
+   * @param rhs stack to copy values from
+   * @return reference to this stack
+   */
+  Stack &operator= (const Stack &rhs);
+
   /**
    * Constructor that gets vector of pairs, and pushes them as apartments to
    * the stack, when the first pair is pushed first.
@@ -29,6 +115,31 @@ class Stack {
    */
   void push (const Apartment &apartment);
 
+  /**
+   * Pushes the apartment at (x, y), constructing it in place on top of the
+   * stack
+   * @param x x coordinate of the apartment
+   * @param y y coordinate of the apartment
+   */
+  void emplace (double x, double y);
+
+  /**
+   * Pushes a range of apartments, or of pairs of coordinates, the first item
+   * is pushed first. When the size of the range is known the room for it is
+   * reserved up front.
+   * @param first iterator to the first item
+   * @param last iterator past the last item
+   */
+  template<class InputIt>
+  void push_range (InputIt first, InputIt last);
+
+  /**
+   * Pushes an apartment for every pair of coordinates, the first pair is
+   * pushed first
+   * @param coordinates vector of pairs
+   */
+  void push_range (const std::vector<std::pair<double, double>> &coordinates);
+
   /**
    * A method that deletes the item from the top of the stack.
    * Calling this method with an empty stack will throw an out of range
@@ -62,12 +173,128 @@ class Stack {
    */
   Apartment top () const;
 
+  /**
+   * Makes room for at least n apartments, so the next pushes up to n do not
+   * allocate
+   * @param n number of apartments
+   */
+  void reserve (size_t n);
+
+  /**
+   * @return number of apartments the stack can hold without allocating
+   */
+  size_t capacity () const;
+
+  /**
+   * Sets when pop () gives memory back. Once the size falls to
+   * capacity / factor, the capacity is cut to twice the size (whole chunks
+   * in chunked storage).
+   * @param factor at least STACK_MIN_SHRINK_FACTOR, or STACK_NEVER_SHRINK
+   */
+  void set_shrink_policy (double factor);
+
   /**
    * The stack should support the iterator (at least a forward iterator) so
    * that the item at the top of the stack is the first item.
+   * The iterator keeps the index of the apartment, so it works for both
+   * storages.
    */
-  typedef std::vector<Apartment>::reverse_iterator iterator;
-  typedef std::vector<Apartment>::const_reverse_iterator const_iterator;
+  template<class Value, class Owner>
+  class BasicIterator {
+    Owner *stack;
+    size_t index;
+
+   public:
+    typedef Value value_type;
+    typedef Value &reference;
+    typedef Value *pointer;
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::ptrdiff_t difference_type;
+
+    /**
+     * Constructor
+     * @param owner the stack
+     * @param position number of apartments from the bottom of the stack up
+     * to and including the current one, 0 for end
+     */
+    BasicIterator (Owner *owner, size_t position)
+        : stack (owner), index (position)
+    {}
+
+    /**
+     * Constructor, converts an iterator to a const iterator
+     * @param other iterator to convert
+     */
+    template<class OtherValue, class OtherOwner>
+    BasicIterator (const BasicIterator<OtherValue, OtherOwner> &other)
+        : stack (other.stack), index (other.index)
+    {}
+
+    /**
+     * pointer operator
+     * @return pointer to the current Apartment
+     */
+    pointer operator-> () const
+    {
+      return &stack->at (index - 1);
+    }
+
+    /**
+     * dereference operator
+     * @return reference to the current Apartment
+     */
+    reference operator* () const
+    {
+      return stack->at (index - 1);
+    }
+
+    /**
+     * Pre-increment operator, moves one apartment down the stack
+     * @return reference to this
+     */
+    BasicIterator &operator++ ()
+    {
+      index--;
+      return *this;
+    }
+
+    /**
+     *  Post-increment operator.
+     * @return this
+     */
+    BasicIterator operator++ (int)
+    {
+      BasicIterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    /**
+     * Operator ==
+     * @param rhs other iterator
+     * @return true if the two iterators are equal, false otherwise
+     */
+    bool operator== (const BasicIterator &rhs) const
+    {
+      return index == rhs.index && stack == rhs.stack;
+    }
+
+    /**
+     * Operator !=
+     * @param rhs other iterator
+     * @return true if the two iterators are not equal, false otherwise
+     */
+    bool operator!= (const BasicIterator &rhs) const
+    {
+      return !(rhs == *this);
+    }
+
+    template<class OtherValue, class OtherOwner> friend
+    class BasicIterator;
+  };
+
+  typedef BasicIterator<Apartment, Stack> iterator;
+  typedef BasicIterator<const Apartment, const Stack> const_iterator;
 
   /**
    * @return iterator object that corresponds to the beginning of the stack
@@ -102,4 +329,41 @@ class Stack {
   const_iterator cend () const;
 };
 
+/**
+ * constructs a new apartment on top of the stack
+ * @param args arguments of the Apartment constructor
+ */
+template<class... Args>
+void Stack::construct_top (Args &&... args)
+{
+  if (!chunked ())
+    {
+      vector.emplace_back (std::forward<Args> (args)...);
+      return;
+    }
+  new (next_slot ()) Apartment (std::forward<Args> (args)...);
+  _size++;
+}
+
+/**
+ * Pushes a range of apartments, or of pairs of coordinates, the first item
+ * is pushed first. When the size of the range is known the room for it is
+ * reserved up front.
+ * @param first iterator to the first item
+ * @param last iterator past the last item
+ */
+template<class InputIt>
+void Stack::push_range (InputIt first, InputIt last)
+{
+  typedef typename std::iterator_traits<InputIt>::iterator_category category;
+  if (std::is_base_of<std::forward_iterator_tag, category>::value)
+    {
+      reserve (size () + std::distance (first, last));
+    }
+  for (; first != last; ++first)
+    {
+      construct_top (*first);
+    }
+}
+
 #endif //_STACK_H_
@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Apartment.h"
+#include "AVL.h"
+#include "BufferedAVL.h"
+#include "CompactAVL.h"
+#include "DurableAVL.h"
+#include "ApartmentBTree.h"
+#include "OrderingContext.h"
+#include "ShardedAVL.h"
+#include "TopK.h"
+
+#define GRID_HALF_SIDE 40
+#define GRID_STEP 0.001
+#define TARGET_X 35.30
+#define TARGET_Y 31.80
+#define NEIGHBOUR_X 35.30005
+#define NEIGHBOUR_Y 31.80005
+#define TOPK_K 100
+#define RANDOM_SEED 2021
+#define RANDOM_APARTMENTS 200000
+#define RANDOM_SPREAD 0.01
+#define RANDOM_OPERATIONS 20000
+#define RANDOM_CELLS 200
+#define SHARDS 4
+#define BUFFER_SIZE 16
+#define BUFFER_TARGET_X 35.3001
+#define BUFFER_TARGET_Y 31.8001
+#define BUFFER_NEIGHBOUR_X 35.30015
+#define BUFFER_NEIGHBOUR_Y 31.80015
+#define LAZY_TOMBSTONE_RATIO 0.9
+#define LAZY_COPIES 3
+#define DURABLE_PATH "Tests.durable"
+#define DURABLE_SEEDS 5
+#define DURABLE_OPERATIONS 2000
+#define DURABLE_CHECKPOINT 100
+#define DURABLE_REOPEN 500
+#define DURABLE_DUPLICATE_PART 8
+#define FAILED_MSG "FAILED: "
+#define PASSED_MSG "passed: "
+
+/**
+ * prints the result of a check
+ * @param name name of the check
+ * @param ok true if the check passed
+ * @return ok
+ */
+static bool report (const std::string &name, bool ok)
+{
+  std::cout << (ok ? PASSED_MSG : FAILED_MSG) << name << std::endl;
+  return ok;
+}
+
+/**
+ * @return the apartments of a square grid centred on feelbox. the grid is
+ * symmetric, so most distances from feelbox are shared by several points
+ */
+static std::vector<Apartment> feelbox_grid ()
+{
+  std::vector<Apartment> grid;
+  for (int i = -GRID_HALF_SIDE; i <= GRID_HALF_SIDE; i++)
+    {
+      for (int j = -GRID_HALF_SIDE; j <= GRID_HALF_SIDE; j++)
+        {
+          grid.emplace_back (std::make_pair (X_FEEL_BOX + i * GRID_STEP,
+                                             Y_FEEL_BOX + j * GRID_STEP));
+        }
+    }
+  return grid;
+}
+
+/**
+ * finds and erases every other apartment of the grid in the B-tree
+ * @return true if all finds hit and the right number of apartments is left
+ */
+static bool check_btree_grid ()
+{
+  std::vector<Apartment> grid = feelbox_grid ();
+  ApartmentBTree tree;
+  for (const Apartment &apartment : grid)
+    {
+      tree.insert (apartment);
+    }
+
+  size_t found = 0;
+  for (const Apartment &apartment : grid)
+    {
+      found += (tree.find (apartment) != tree.end ());
+    }
+  for (size_t i = 0; i < grid.size (); i += 2)
+    {
+      tree.erase (grid[i]);
+    }
+  return found == grid.size () && tree.size () == grid.size () / 2;
+}
+
+/**
+ * compares every pair of apartments of the grid around feelbox
+ * @return true if operator< and operator> order them totally: for every
+ * pair with other coordinates exactly one of them is smaller
+ */
+static bool check_apartment_total_order ()
+{
+  std::vector<Apartment> grid = feelbox_grid ();
+  for (const Apartment &lhs : grid)
+    {
+      for (const Apartment &rhs : grid)
+        {
+          bool same = OrderingContext::same_coordinates (lhs, rhs);
+          if ((lhs < rhs) + (rhs < lhs) != (same ? 0 : 1)
+              || (lhs < rhs) != (rhs > lhs))
+            {
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+/**
+ * inserts random apartments close to feelbox into the B-tree. with fixed
+ * point coordinates many of them are at the same distance
+ * @return true if all of them are found
+ */
+static bool check_btree_random ()
+{
+  std::mt19937 generator (RANDOM_SEED);
+  std::uniform_real_distribution<double> offset (-RANDOM_SPREAD,
+                                                 RANDOM_SPREAD);
+  std::vector<Apartment> apartments;
+  ApartmentBTree tree;
+  for (int i = 0; i < RANDOM_APARTMENTS; i++)
+    {
+      double x = X_FEEL_BOX + offset (generator);
+      double y = Y_FEEL_BOX + offset (generator);
+      apartments.emplace_back (std::make_pair (x, y));
+      tree.insert (apartments.back ());
+    }
+  for (const Apartment &apartment : apartments)
+    {
+      if (tree.find (apartment) == tree.end ())
+        {
+          return false;
+        }
+    }
+  return tree.size () == apartments.size ();
+}
+
+/**
+ * streams the grid around feelbox into a TopK, in order and reversed. k
+ * cuts through a group of apartments at the same distance
+ * @return true if both keep the k smallest apartments by operator<, in
+ * that order
+ */
+static bool check_topk_ties ()
+{
+  std::vector<Apartment> grid = feelbox_grid ();
+  TopK forward (TOPK_K), backward (TOPK_K);
+  for (size_t i = 0; i < grid.size (); i++)
+    {
+      forward.push (grid[i]);
+      backward.push (grid[grid.size () - 1 - i]);
+    }
+  std::sort (grid.begin (), grid.end ());
+  grid.erase (grid.begin () + TOPK_K, grid.end ());
+  std::vector<Apartment> kept = forward.sorted ();
+  std::vector<Apartment> kept_backward = backward.sorted ();
+  for (size_t i = 0; i < grid.size (); i++)
+    {
+      if (!OrderingContext::same_coordinates (kept[i], grid[i])
+          || !OrderingContext::same_coordinates (kept_backward[i], grid[i]))
+        {
+          return false;
+        }
+    }
+  return kept.size () == grid.size () && kept_backward.size () == grid.size ();
+}
+
+/**
+ * erases one of two apartments that are less than EPSILON apart from the AVL
+ * @return true if the other one is left in the tree
+ */
+static bool check_avl_neighbour_erase ()
+{
+  Apartment neighbour (std::make_pair (NEIGHBOUR_X, NEIGHBOUR_Y));
+  Apartment target (std::make_pair (TARGET_X, TARGET_Y));
+  AVL tree;
+  tree.insert (neighbour);
+  tree.insert (target);
+  tree.erase (target);
+
+  size_t left = 0;
+  bool neighbour_left = false;
+  for (const Apartment &apartment : tree)
+    {
+      left++;
+      neighbour_left = OrderingContext::same_coordinates (apartment,
+                                                          neighbour);
+    }
+  return left == 1 && neighbour_left && tree.validate ();
+}
+
+/**
+ * erases a neighbour less than EPSILON away from the only apartment of a
+ * ShardedAVL, twice, and then the apartment itself
+ * @return true if the size counts only the apartment that was erased
+ */
+static bool check_sharded_neighbour_erase ()
+{
+  Apartment neighbour (std::make_pair (NEIGHBOUR_X, NEIGHBOUR_Y));
+  Apartment target (std::make_pair (TARGET_X, TARGET_Y));
+  ShardedAVL sharded (SHARDS);
+  sharded.insert (target);
+  sharded.erase (neighbour);
+  sharded.erase (neighbour);
+  bool kept = sharded.size () == 1 && sharded.contains (target);
+  sharded.erase (target);
+  return kept && sharded.size () == 0 && !sharded.contains (target);
+}
+
+/**
+ * @param tree tree to count
+ * @return how many times each pair of coordinates is in the tree
+ */
+static std::map<std::pair<double, double>, int> contents (const AVL &tree)
+{
+  std::map<std::pair<double, double>, int> counts;
+  for (const Apartment &apartment : tree)
+    {
+      counts[std::make_pair (apartment.get_x (), apartment.get_y ())]++;
+    }
+  return counts;
+}
+
+/**
+ * erases one of two apartments less than EPSILON apart, and in the same
+ * cell of the buffer, while both wait in the buffer of a BufferedAVL
+ * @return true if the other one is the only apartment after the merge
+ */
+static bool check_buffered_neighbour_erase ()
+{
+  Apartment neighbour (std::make_pair (BUFFER_NEIGHBOUR_X,
+                                       BUFFER_NEIGHBOUR_Y));
+  Apartment target (std::make_pair (BUFFER_TARGET_X, BUFFER_TARGET_Y));
+  BufferedAVL buffered (BUFFER_SIZE);
+  buffered.insert (target);
+  buffered.insert (neighbour);
+  buffered.erase (target);
+  std::map<std::pair<double, double>, int> expected;
+  expected[std::make_pair (neighbour.get_x (), neighbour.get_y ())] = 1;
+  return contents (buffered.by_distance ()) == expected;
+}
+
+/**
+ * random inserts and erases of apartments packed closer than EPSILON
+ * @param max_tombstone_ratio lazy erase ratio of the tree (see
+ * AVL::set_lazy_erase), 0 for structural erase
+ * @return true if the tree holds exactly the apartments that were inserted
+ * and not erased
+ */
+static bool check_avl_random_neighbours (double max_tombstone_ratio)
+{
+  std::mt19937 generator (RANDOM_SEED);
+  std::uniform_int_distribution<int> cell (0, RANDOM_CELLS);
+  std::map<std::pair<double, double>, int> expected;
+  AVL tree;
+  tree.set_lazy_erase (max_tombstone_ratio);
+  for (int i = 0; i < RANDOM_OPERATIONS; i++)
+    {
+      std::pair<double, double> coordinates (
+          TARGET_X + cell (generator) * EPSILON / 2,
+          TARGET_Y + cell (generator) * EPSILON / 2);
+      Apartment apartment (coordinates);
+      if (generator () % 2 == 0)
+        {
+          tree.insert (apartment);
+          expected[std::make_pair (apartment.get_x (), apartment.get_y ())]++;
+        }
+      else
+        {
+          tree.erase (apartment);
+          auto found = expected.find (std::make_pair (apartment.get_x (),
+                                                      apartment.get_y ()));
+          if (found != expected.end () && --found->second == 0)
+            {
+              expected.erase (found);
+            }
+        }
+    }
+  return contents (tree) == expected && tree.validate ();
+}
+
+/**
+ * inserts copies of one apartment into an AVL in lazy erase mode, and
+ * erases them one by one
+ * @return true if the copies that are left are found and erased, whatever
+ * tombstones of the apartment are in the way
+ */
+static bool check_avl_lazy_copies ()
+{
+  Apartment target (std::make_pair (TARGET_X, TARGET_Y));
+  AVL tree;
+  tree.set_lazy_erase (LAZY_TOMBSTONE_RATIO);
+  for (int i = 0; i < LAZY_COPIES; i++)
+    {
+      tree.insert (target);
+    }
+  for (int left = LAZY_COPIES; left > 0; left--)
+    {
+      std::map<std::pair<double, double>, int> counts = contents (tree);
+      if (counts[std::make_pair (TARGET_X, TARGET_Y)] != left
+          || !tree.contains (target) || tree.find (target) == tree.end ())
+        {
+          return false;
+        }
+      tree.erase (target);
+    }
+  return tree.begin () == tree.end () && !tree.contains (target)
+         && tree.validate ();
+}
+
+/**
+ * random inserts and erases of apartments packed closer than EPSILON on a
+ * CompactAVL, checking the balance factors after every update
+ * @return true if the tree holds exactly the apartments that were inserted
+ * and not erased, and stays a valid AVL tree
+ */
+static bool check_compact_random_neighbours ()
+{
+  std::mt19937 generator (RANDOM_SEED);
+  std::uniform_int_distribution<int> cell (0, RANDOM_CELLS);
+  std::map<std::pair<double, double>, int> expected;
+  CompactAVL tree;
+  for (int i = 0; i < RANDOM_OPERATIONS; i++)
+    {
+      std::pair<double, double> coordinates (
+          TARGET_X + cell (generator) * EPSILON / 2,
+          TARGET_Y + cell (generator) * EPSILON / 2);
+      Apartment apartment (coordinates);
+      auto key = std::make_pair (apartment.get_x (), apartment.get_y ());
+      if (generator () % 2 == 0)
+        {
+          tree.insert (apartment);
+          expected[key]++;
+        }
+      else
+        {
+          tree.erase (apartment);
+          auto found = expected.find (key);
+          if (found != expected.end () && --found->second == 0)
+            {
+              expected.erase (found);
+            }
+        }
+      if (!tree.validate () || tree.empty () != expected.empty ())
+        {
+          return false;
+        }
+    }
+  std::map<std::pair<double, double>, int> counts;
+  tree.for_each_in_order ([&counts] (const Apartment &apartment)
+                          {
+                            counts[std::make_pair (apartment.get_x (),
+                                                   apartment.get_y ())]++;
+                          });
+  return counts == expected;
+}
+
+/**
+ * random inserts and erases on a DurableAVL, with about one insert in
+ * DURABLE_DUPLICATE_PART a copy of an apartment that is already in the
+ * tree, a checkpoint every DURABLE_CHECKPOINT updates, and a reopen every
+ * DURABLE_REOPEN updates
+ * @param seed seed of the updates
+ * @return true if every reopen loads exactly the apartments of the tree
+ */
+static bool check_durable_duplicates (unsigned seed)
+{
+  std::mt19937 generator (seed);
+  std::uniform_real_distribution<double> coordinate (0, 100);
+  std::vector<Apartment> inserted;
+  DurableAVL::remove_files (DURABLE_PATH);
+  std::unique_ptr<DurableAVL> tree (new DurableAVL (DURABLE_PATH));
+  bool ok = true;
+  for (int i = 1; i <= DURABLE_OPERATIONS && ok; i++)
+    {
+      if (inserted.empty () || generator () % 3 != 0)
+        {
+          bool copy = !inserted.empty ()
+                      && generator () % DURABLE_DUPLICATE_PART == 0;
+          Apartment apartment = copy
+              ? inserted[generator () % inserted.size ()]
+              : Apartment (std::make_pair (coordinate (generator),
+                                           coordinate (generator)));
+          tree->insert (apartment);
+          inserted.push_back (apartment);
+        }
+      else
+        {
+          size_t victim = generator () % inserted.size ();
+          tree->erase (inserted[victim]);
+          inserted[victim] = inserted.back ();
+          inserted.pop_back ();
+        }
+      if (i % DURABLE_CHECKPOINT == 0)
+        {
+          tree->checkpoint ();
+        }
+      if (i % DURABLE_REOPEN == 0)
+        {
+          std::map<std::pair<double, double>, int> expected
+              = contents (tree->by_distance ());
+          tree.reset ();
+          try
+            {
+              tree.reset (new DurableAVL (DURABLE_PATH));
+              ok = contents (tree->by_distance ()) == expected;
+            }
+          catch (const std::runtime_error &)
+            {
+              ok = false;
+            }
+        }
+    }
+  tree.reset ();
+  DurableAVL::remove_files (DURABLE_PATH);
+  return ok;
+}
+
+int main ()
+{
+  bool ok = true;
+  ok &= report ("btree grid around feelbox", check_btree_grid ());
+  ok &= report ("btree random around feelbox", check_btree_random ());
+  ok &= report ("apartment total order", check_apartment_total_order ());
+  ok &= report ("topk ties around feelbox", check_topk_ties ());
+  ok &= report ("avl erase next to a neighbour",
+                check_avl_neighbour_erase ());
+  ok &= report ("sharded erase next to a neighbour",
+                check_sharded_neighbour_erase ());
+  ok &= report ("buffered erase next to a neighbour",
+                check_buffered_neighbour_erase ());
+  ok &= report ("avl random neighbours", check_avl_random_neighbours (0));
+  ok &= report ("avl random neighbours, lazy erase",
+                check_avl_random_neighbours (LAZY_TOMBSTONE_RATIO));
+  ok &= report ("avl lazy erase of copies", check_avl_lazy_copies ());
+  ok &= report ("compact random neighbours",
+                check_compact_random_neighbours ());
+  for (unsigned seed = 1; seed <= DURABLE_SEEDS; seed++)
+    {
+      ok &= report ("durable duplicates, seed " + std::to_string (seed),
+                    check_durable_duplicates (seed));
+    }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
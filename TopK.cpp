@@ -0,0 +1,185 @@
+#include "TopK.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#define EMPTY_TOPK_MSG_ERROR "Error: no apartment is kept. illegal operation"
+
+/**
+ * Constructor. Constructs an empty container
+ * @param k maximal number of apartments to keep
+ */
+TopK::TopK (size_t k) : _k (k)
+{
+  _heap.reserve (k);
+}
+
+/**
+ * Offers an apartment from the stream. If the container is full the
+ * farthest apartment is evicted to make room for a closer one.
+ * @param apartment apartment to offer
+ * @return true if the apartment was kept, false if it was rejected
+ */
+bool TopK::push (const Apartment &apartment)
+{
+  double distance = apartment.get_distance ();
+  if (_heap.size () < _k)
+    {
+      _heap.push_back (entry {distance, apartment});
+      sift_up (_heap.size () - 1);
+      return true;
+    }
+  entry offered {distance, apartment};
+  if (_k == 0 || !closer (offered, _heap.front ()))
+    {
+      return false;
+    }
+  // evict the farthest by putting the new apartment in its place
+  _heap.front () = offered;
+  sift_down (0);
+  return true;
+}
+
+/**
+ * The farthest of the kept apartments. Calling this method with an empty
+ * container will throw an out of range exception.
+ * @return reference to the farthest kept apartment
+ */
+const Apartment &TopK::worst () const
+{
+  if (empty ())
+    {
+      throw std::out_of_range (EMPTY_TOPK_MSG_ERROR);
+    }
+  return _heap.front ().apartment;
+}
+
+/**
+ * @return distance of worst () from feelbox, or +infinity while the
+ * container is not full, since then every apartment is kept
+ */
+double TopK::threshold () const
+{
+  if (!full () || _k == 0)
+    {
+      return std::numeric_limits<double>::infinity ();
+    }
+  return _heap.front ().distance;
+}
+
+/**
+ * @return the kept apartments, closest first
+ */
+std::vector<Apartment> TopK::sorted () const
+{
+  std::vector<entry> entries (_heap);
+  std::sort (entries.begin (), entries.end (), closer);
+  std::vector<Apartment> apartments;
+  apartments.reserve (entries.size ());
+  for (const entry &curr : entries)
+    {
+      apartments.push_back (curr.apartment);
+    }
+  return apartments;
+}
+
+/**
+ * @return number of kept apartments
+ */
+size_t TopK::size () const
+{
+  return _heap.size ();
+}
+
+/**
+ * @return maximal number of kept apartments
+ */
+size_t TopK::capacity () const
+{
+  return _k;
+}
+
+/**
+ * @return true if no apartment is kept
+ */
+bool TopK::empty () const
+{
+  return _heap.empty ();
+}
+
+/**
+ * @return true if k apartments are kept
+ */
+bool TopK::full () const
+{
+  return _heap.size () >= _k;
+}
+
+/**
+ * Drops all the kept apartments
+ */
+void TopK::clear ()
+{
+  _heap.clear ();
+}
+
+/**
+ * @param lhs entry to compare
+ * @param rhs entry to compare
+ * @return true if the apartment of lhs comes before the apartment of rhs
+ * in the order of Apartment::operator<
+ */
+bool TopK::closer (const entry &lhs, const entry &rhs)
+{
+  // the distances are in the order of operator<, only a tie needs it
+  return lhs.distance < rhs.distance
+         || (lhs.distance == rhs.distance && lhs.apartment < rhs.apartment);
+}
+
+/**
+ * moves the entry at index i down until the heap is valid again
+ * @param i index of the entry
+ */
+void TopK::sift_down (size_t i)
+{
+  entry moving = _heap[i];
+  size_t size = _heap.size ();
+  while (true)
+    {
+      size_t child = 2 * i + 1;
+      if (child >= size)
+        {
+          break;
+        }
+      if (child + 1 < size && closer (_heap[child], _heap[child + 1]))
+        {
+          child++;
+        }
+      if (!closer (moving, _heap[child]))
+        {
+          break;
+        }
+      _heap[i] = _heap[child];
+      i = child;
+    }
+  _heap[i] = moving;
+}
+
+/**
+ * moves the entry at index i up until the heap is valid again
+ * @param i index of the entry
+ */
+void TopK::sift_up (size_t i)
+{
+  entry moving = _heap[i];
+  while (i > 0)
+    {
+      size_t parent = (i - 1) / 2;
+      if (!closer (_heap[parent], moving))
+        {
+          break;
+        }
+      _heap[i] = _heap[parent];
+      i = parent;
+    }
+  _heap[i] = moving;
+}
@@ -0,0 +1,110 @@
+#ifndef _TOPK_H_
+#define _TOPK_H_
+#include <vector>
+#include "Apartment.h"
+
+/**
+ * this class keeps the k apartments closest to feelbox out of a stream of
+ * apartments, in the order of Apartment::operator<. It holds at most k
+ * apartments in a binary max heap by distance, so the farthest kept
+ * apartment is always at the root: reading it is O(1), an apartment that is
+ * not closer than it is rejected in O(1) once the container is full, and
+ * any other push costs O(log k). The distance of every kept apartment is
+ * stored next to it so the heap never recomputes a square root; only
+ * apartments at the same distance are compared with Apartment::operator<,
+ * which orders them by coordinates. Which apartments are kept and the
+ * order of sorted () therefore do not depend on the order of the stream.
+ * Apartments are not deduplicated, a listing seen twice takes two places.
+ */
+class TopK {
+  /**
+   * A kept apartment and its distance from feelbox
+   */
+  struct entry {
+      double distance;
+      Apartment apartment;
+  };
+
+  std::vector<entry> _heap;
+  size_t _k;
+
+  /**
+   * @param lhs entry to compare
+   * @param rhs entry to compare
+   * @return true if the apartment of lhs comes before the apartment of rhs
+   * in the order of Apartment::operator<
+   */
+  static bool closer (const entry &lhs, const entry &rhs);
+
+  /**
+   * moves the entry at index i down until the heap is valid again
+   * @param i index of the entry
+   */
+  void sift_down (size_t i);
+
+  /**
+   * moves the entry at index i up until the heap is valid again
+   * @param i index of the entry
+   */
+  void sift_up (size_t i);
+
+ public:
+  /**
+   * Constructor. Constructs an empty container
+   * @param k maximal number of apartments to keep
+   */
+  TopK (size_t k);
+
+  /**
+   * Offers an apartment from the stream. If the container is full the
+   * farthest apartment is evicted to make room for a closer one.
+   * @param apartment apartment to offer
+   * @return true if the apartment was kept, false if it was rejected
+   */
+  bool push (const Apartment &apartment);
+
+  /**
+   * The farthest of the kept apartments. Calling this method with an empty
+   * container will throw an out of range exception.
+   * @return reference to the farthest kept apartment
+   */
+  const Apartment &worst () const;
+
+  /**
+   * @return distance of worst () from feelbox, or +infinity while the
+   * container is not full, since then every apartment is kept
+   */
+  double threshold () const;
+
+  /**
+   * @return the kept apartments, closest first
+   */
+  std::vector<Apartment> sorted () const;
+
+  /**
+   * @return number of kept apartments
+   */
+  size_t size () const;
+
+  /**
+   * @return maximal number of kept apartments
+   */
+  size_t capacity () const;
+
+  /**
+   * @return true if no apartment is kept
+   */
+  bool empty () const;
+
+  /**
+   * @return true if k apartments are kept
+   */
+  bool full () const;
+
+  /**
+   * Drops all the kept apartments
+   */
+  void clear ();
+};
+
+#endif //_TOPK_H_
@@ -0,0 +1,148 @@
+#include "WorkStealingPool.h"
+
+/**
+ * the pool that the calling thread works for, and the index of its queue
+ */
+static thread_local const WorkStealingPool *worker_pool = nullptr;
+static thread_local size_t worker_index = 0;
+
+/**
+ * Constructor. Starts the worker threads
+ * @param workers number of worker threads; the thread that waits for a
+ * parallel algorithm works too, so 0 runs everything on that thread
+ */
+WorkStealingPool::WorkStealingPool (size_t workers)
+    : _queued (0), _stop (false)
+{
+  // one queue per worker, and the last one for the other threads
+  for (size_t i = 0; i <= workers; i++)
+    {
+      _queues.emplace_back (new task_queue);
+    }
+  for (size_t i = 0; i < workers; i++)
+    {
+      _threads.emplace_back (&WorkStealingPool::work, this, i);
+    }
+}
+
+/**
+ * Destructor. Stops the workers, the tasks that are still queued are not
+ * run
+ */
+WorkStealingPool::~WorkStealingPool ()
+{
+  {
+    std::lock_guard<std::mutex> lock (_sleep_lock);
+    _stop = true;
+  }
+  _wake.notify_all ();
+  for (std::thread &thread : _threads)
+    {
+      thread.join ();
+    }
+}
+
+/**
+ * @return a pool shared by the whole process, with one worker less than
+ * the number of hardware threads
+ */
+WorkStealingPool &WorkStealingPool::shared ()
+{
+  static WorkStealingPool pool ((std::thread::hardware_concurrency () > 1)
+                                ? std::thread::hardware_concurrency () - 1
+                                : 0);
+  return pool;
+}
+
+/**
+ * @return number of threads that run tasks, counting the waiting thread
+ */
+size_t WorkStealingPool::concurrency () const
+{
+  return _threads.size () + 1;
+}
+
+/**
+ * @return index of the queue of the calling thread
+ */
+size_t WorkStealingPool::own_queue () const
+{
+  return (worker_pool == this) ? worker_index : _queues.size () - 1;
+}
+
+/**
+ * runs tasks until the pool is destroyed
+ * @param index index of the worker
+ */
+void WorkStealingPool::work (size_t index)
+{
+  worker_pool = this;
+  worker_index = index;
+  while (!_stop)
+    {
+      if (!run_one ())
+        {
+          std::unique_lock<std::mutex> lock (_sleep_lock);
+          _wake.wait (lock, [this] ()
+          { return _stop || _queued > 0; });
+        }
+    }
+}
+
+/**
+ * Queues a task on the queue of the calling thread
+ * @param task function to run
+ */
+void WorkStealingPool::submit (std::function<void ()> task)
+{
+  task_queue &queue = *_queues[own_queue ()];
+  {
+    std::lock_guard<std::mutex> lock (queue.lock);
+    queue.tasks.push_back (std::move (task));
+  }
+  // a worker that just found no task is either asleep already or still
+  // holds the sleep lock, so it can not miss the wake up
+  {
+    std::lock_guard<std::mutex> lock (_sleep_lock);
+    _queued++;
+  }
+  _wake.notify_one ();
+}
+
+/**
+ * Runs one queued task on the calling thread: the newest task of its own
+ * queue, or else the oldest task of another queue
+ * @return false if there was no task to run
+ */
+bool WorkStealingPool::run_one ()
+{
+  size_t own = own_queue ();
+  std::function<void ()> task;
+  for (size_t i = 0; i < _queues.size () && !task; i++)
+    {
+      size_t index = (own + i) % _queues.size ();
+      task_queue &queue = *_queues[index];
+      std::lock_guard<std::mutex> lock (queue.lock);
+      if (queue.tasks.empty ())
+        {
+          continue;
+        }
+      if (i == 0) // own queue, newest first
+        {
+          task = std::move (queue.tasks.back ());
+          queue.tasks.pop_back ();
+        }
+      else // steal the oldest
+        {
+          task = std::move (queue.tasks.front ());
+          queue.tasks.pop_front ();
+        }
+    }
+  if (!task)
+    {
+      return false;
+    }
+  _queued--;
+  task ();
+  return true;
+}
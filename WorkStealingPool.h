@@ -0,0 +1,148 @@
+#ifndef _WORKSTEALINGPOOL_H_
+#define _WORKSTEALINGPOOL_H_
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * this class represents a pool of worker threads that run tasks, with work
+ * stealing: every worker has its own queue, pushes the tasks it spawns to
+ * the back of it and takes its next task from the back too, so it keeps
+ * working on the newest (and cache warm) part of its problem. A worker
+ * whose queue is empty steals the oldest task from the front of another
+ * queue, which for a divide and conquer problem is the largest piece left.
+ * Threads that are not workers push to a queue of their own, and help run
+ * tasks while they wait for a parallel algorithm to finish.
+ * for_each_range () runs a function on the pieces of a splittable range
+ * (see AVL::range), splitting it until the pieces are small.
+ */
+class WorkStealingPool {
+  /**
+   * A queue of tasks with its own lock
+   */
+  struct task_queue {
+      std::mutex lock;
+      std::deque<std::function<void ()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<task_queue>> _queues;
+  std::vector<std::thread> _threads;
+  std::atomic<size_t> _queued;
+  std::atomic<bool> _stop;
+  std::mutex _sleep_lock;
+  std::condition_variable _wake;
+
+  /**
+   * @return index of the queue of the calling thread
+   */
+  size_t own_queue () const;
+
+  /**
+   * runs tasks until the pool is destroyed
+   * @param index index of the worker
+   */
+  void work (size_t index);
+
+ public:
+  /**
+   * Constructor. Starts the worker threads
+   * @param workers number of worker threads; the thread that waits for a
+   * parallel algorithm works too, so 0 runs everything on that thread
+   */
+  explicit WorkStealingPool (size_t workers);
+
+  WorkStealingPool (const WorkStealingPool &other) = delete;
+  WorkStealingPool &operator= (const WorkStealingPool &rhs) = delete;
+
+  /**
+   * Destructor. Stops the workers, the tasks that are still queued are not
+   * run
+   */
+  ~WorkStealingPool ();
+
+  /**
+   * @return a pool shared by the whole process, with one worker less than
+   * the number of hardware threads
+   */
+  static WorkStealingPool &shared ();
+
+  /**
+   * @return number of threads that run tasks, counting the waiting thread
+   */
+  size_t concurrency () const;
+
+  /**
+   * Queues a task on the queue of the calling thread
+   * @param task function to run
+   */
+  void submit (std::function<void ()> task);
+
+  /**
+   * Runs one queued task on the calling thread: the newest task of its own
+   * queue, or else the oldest task of another queue
+   * @return false if there was no task to run
+   */
+  bool run_one ();
+
+  /**
+   * Splits a range into pieces that are not divisible and calls body on
+   * every piece, in parallel. The range is split in halves: one half is
+   * queued for another thread to steal and the other is split further, so
+   * idle threads take the largest pieces. Returns when every piece is done,
+   * the calling thread runs tasks meanwhile. body must not throw.
+   * @param whole range to visit, with empty (), is_divisible () and split ()
+   * (which keeps the first half and returns the second)
+   * @param body function that gets a const Range &
+   */
+  template<class Range, class Body>
+  void for_each_range (const Range &whole, const Body &body);
+};
+
+/**
+ * Splits a range into pieces that are not divisible and calls body on
+ * every piece, in parallel. The range is split in halves: one half is
+ * queued for another thread to steal and the other is split further, so
+ * idle threads take the largest pieces. Returns when every piece is done,
+ * the calling thread runs tasks meanwhile. body must not throw.
+ * @param whole range to visit, with empty (), is_divisible () and split ()
+ * (which keeps the first half and returns the second)
+ * @param body function that gets a const Range &
+ */
+template<class Range, class Body>
+void WorkStealingPool::for_each_range (const Range &whole, const Body &body)
+{
+  std::atomic<size_t> pending (0);
+  std::function<void (Range)> run;
+  run = [this, &run, &pending, &body] (Range piece)
+  {
+    while (piece.is_divisible ())
+      {
+        Range second = piece.split ();
+        pending++;
+        submit ([&run, &pending, second] ()
+                {
+                  run (second);
+                  pending--;
+                });
+      }
+    if (!piece.empty ())
+      {
+        body (piece);
+      }
+  };
+  run (whole);
+  while (pending > 0)
+    {
+      if (!run_one ())
+        {
+          std::this_thread::yield ();
+        }
+    }
+}
+
+#endif //_WORKSTEALINGPOOL_H_